@@ -0,0 +1,249 @@
+// ColourCensus.cpp
+//
+// Counts the unique colours in images. Used to decide if quantization is needed at all, by the details overlay, and
+// by the CLI probe. Counting is spread over threads and, when only a bound is needed, stops as soon as it is exceeded.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <atomic>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <Foundation/tFundamentals.h>
+#include <System/tMachine.h>
+#include "ColourCensus.h"
+#include "Parallel.h"
+
+
+namespace Viewer
+{
+namespace Census
+{
+	// Opaque colours, by far the most common, are recorded in a bitset over the 24-bit RGB space. Other colours go in
+	// a hash set. Each worker has its own so no locking is needed until they are merged. The bitset is split into
+	// blocks and only the blocks that were written to are merged, counted, and cleared.
+	struct ColourSet
+	{
+		ColourSet()										: OpaqueBits(NumOpaqueWords, 0), BlockUsed(NumBlocks, 0) { }
+		bool Add(const tPixel4b&);						// Returns true if the colour was not already in the set.
+		void Merge(const ColourSet&);
+		int Count() const;
+		void Clear();
+
+		static const int NumOpaqueWords					= (1 << 24) / 64;
+		static const int BlockShift						= 9;			// 512 words per block.
+		static const int NumBlocks						= NumOpaqueWords >> BlockShift;
+		bool RGBOnly									= false;		// All colours go in the bitset.
+		std::vector<uint64> OpaqueBits;
+		std::vector<uint8> BlockUsed;
+		std::unordered_set<uint32> Translucent;
+	};
+
+	// The sets are 2MB each so they are kept for reuse rather than allocated on every count. At most one per core is
+	// kept. Thread-safe.
+	std::unique_ptr<ColourSet> AcquireSet(bool rgbOnly);
+	void ReleaseSet(std::unique_ptr<ColourSet>);
+	std::mutex SetPoolMutex;
+	std::vector<std::unique_ptr<ColourSet>> SetPool;
+
+	// Counting this few pixels is quicker with a single hash set than with the bitsets.
+	int CountColoursSmall(const std::vector<Span>&, int64 numPixels, int limit, bool rgbOnly);
+	const int64 SmallNumPixels							= 1 << 16;
+
+	// Pixels are handed out in chunks of this size. Images smaller than this are counted on one thread.
+	const int ChunkSize									= 1 << 18;
+}
+}
+
+
+bool Viewer::Census::ColourSet::Add(const tPixel4b& pixel)
+{
+	if (RGBOnly || (pixel.A == 0xFF))
+	{
+		uint32 rgb = (uint32(pixel.R) << 16) | (uint32(pixel.G) << 8) | uint32(pixel.B);
+		uint32 index = rgb >> 6;
+		uint64& word = OpaqueBits[index];
+		uint64 bit = uint64(1) << (rgb & 63);
+		if (word & bit)
+			return false;
+		word |= bit;
+		BlockUsed[index >> BlockShift] = 1;
+		return true;
+	}
+
+	uint32 rgba = (uint32(pixel.R) << 24) | (uint32(pixel.G) << 16) | (uint32(pixel.B) << 8) | uint32(pixel.A);
+	return Translucent.insert(rgba).second;
+}
+
+
+void Viewer::Census::ColourSet::Merge(const ColourSet& src)
+{
+	const int blockWords = 1 << BlockShift;
+	for (int b = 0; b < NumBlocks; b++)
+	{
+		if (!src.BlockUsed[b])
+			continue;
+		for (int w = b*blockWords; w < (b+1)*blockWords; w++)
+			OpaqueBits[w] |= src.OpaqueBits[w];
+		BlockUsed[b] = 1;
+	}
+	Translucent.insert(src.Translucent.begin(), src.Translucent.end());
+}
+
+
+int Viewer::Census::ColourSet::Count() const
+{
+	const int blockWords = 1 << BlockShift;
+	int count = int(Translucent.size());
+	for (int b = 0; b < NumBlocks; b++)
+	{
+		if (!BlockUsed[b])
+			continue;
+		for (int w = b*blockWords; w < (b+1)*blockWords; w++)
+			count += std::popcount(OpaqueBits[w]);
+	}
+	return count;
+}
+
+
+void Viewer::Census::ColourSet::Clear()
+{
+	const int blockWords = 1 << BlockShift;
+	for (int b = 0; b < NumBlocks; b++)
+	{
+		if (!BlockUsed[b])
+			continue;
+		tStd::tMemset(&OpaqueBits[b*blockWords], 0, blockWords*sizeof(uint64));
+		BlockUsed[b] = 0;
+	}
+	Translucent.clear();
+}
+
+
+std::unique_ptr<Viewer::Census::ColourSet> Viewer::Census::AcquireSet(bool rgbOnly)
+{
+	std::unique_ptr<ColourSet> set;
+	{
+		std::lock_guard<std::mutex> lock(SetPoolMutex);
+		if (!SetPool.empty())
+		{
+			set = std::move(SetPool.back());
+			SetPool.pop_back();
+		}
+	}
+	if (!set)
+		set.reset(new ColourSet());
+	set->RGBOnly = rgbOnly;
+	return set;
+}
+
+
+void Viewer::Census::ReleaseSet(std::unique_ptr<ColourSet> set)
+{
+	set->Clear();
+	std::lock_guard<std::mutex> lock(SetPoolMutex);
+	if (int(SetPool.size()) < tMath::tClampMin(tSystem::tGetNumCores(), 1))
+		SetPool.push_back(std::move(set));
+}
+
+
+int Viewer::Census::CountColoursSmall(const std::vector<Span>& spans, int64 numPixels, int limit, bool rgbOnly)
+{
+	std::unordered_set<uint32> colours;
+	colours.reserve(size_t(numPixels));
+	for (const Span& span : spans)
+	{
+		for (int64 p = 0; p < span.NumPixels; p++)
+		{
+			const tPixel4b& pixel = span.Pixels[p];
+			uint32 alpha = rgbOnly ? 0xFF : uint32(pixel.A);
+			uint32 rgba = (uint32(pixel.R) << 24) | (uint32(pixel.G) << 16) | (uint32(pixel.B) << 8) | alpha;
+			if (colours.insert(rgba).second && (limit >= 0) && (int(colours.size()) > limit))
+				return limit+1;
+		}
+	}
+	return int(colours.size());
+}
+
+
+int Viewer::Census::CountColours(const std::vector<Span>& spans, int limit, bool rgbOnly)
+{
+	int64 numPixels = 0;
+	for (const Span& span : spans)
+		numPixels += span.NumPixels;
+	if (numPixels <= 0)
+		return 0;
+	if (numPixels <= SmallNumPixels)
+		return CountColoursSmall(spans, numPixels, limit, rgbOnly);
+
+	struct Chunk { const tPixel4b* Pixels; int NumPixels; };
+	std::vector<Chunk> chunks;
+	for (const Span& span : spans)
+		for (int64 start = 0; start < span.NumPixels; start += ChunkSize)
+			chunks.push_back({ span.Pixels + start, int(tMath::tMin(int64(ChunkSize), span.NumPixels - start)) });
+
+	// Each worker takes every numWorkers-th chunk. The colours a worker finds are a subset of all the colours so as
+	// soon as any one worker finds more than the limit we are done.
+	int numWorkers = tMath::tMin(int(chunks.size()), Parallel::GetMaxThreads());
+	std::vector<std::unique_ptr<ColourSet>> sets(numWorkers);
+	for (std::unique_ptr<ColourSet>& set : sets)
+		set = AcquireSet(rgbOnly);
+
+	std::atomic<bool> exceeded(false);
+	Parallel::For(numWorkers, [&](int w)
+	{
+		ColourSet& set = *sets[w];
+		int found = 0;
+		for (int c = w; (c < int(chunks.size())) && !exceeded; c += numWorkers)
+		{
+			const Chunk& chunk = chunks[c];
+			for (int p = 0; p < chunk.NumPixels; p++)
+			{
+				if (!set.Add(chunk.Pixels[p]))
+					continue;
+				found++;
+				if ((limit >= 0) && (found > limit))
+				{
+					exceeded = true;
+					return;
+				}
+			}
+		}
+	});
+
+	int count = limit+1;
+	if (!exceeded)
+	{
+		for (int w = 1; w < numWorkers; w++)
+			sets[0]->Merge(*sets[w]);
+		count = sets[0]->Count();
+		if (limit >= 0)
+			count = tMath::tMin(count, limit+1);
+	}
+
+	for (std::unique_ptr<ColourSet>& set : sets)
+		ReleaseSet(std::move(set));
+	return count;
+}
+
+
+int Viewer::Census::CountColours(const tImage::tPicture& picture, int limit, bool rgbOnly)
+{
+	if (!picture.IsValid())
+		return 0;
+
+	std::vector<Span> spans(1);
+	spans[0].Pixels = picture.GetPixelPointer();
+	spans[0].NumPixels = int64(picture.GetWidth()) * int64(picture.GetHeight());
+	return CountColours(spans, limit, rgbOnly);
+}
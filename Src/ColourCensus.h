@@ -0,0 +1,38 @@
+// ColourCensus.h
+//
+// Counts the unique colours in images. Used to decide if quantization is needed at all, by the details overlay, and
+// by the CLI probe. Counting is spread over threads and, when only a bound is needed, stops as soon as it is exceeded.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Math/tColour.h>
+#include <Image/tPicture.h>
+
+
+namespace Viewer
+{
+namespace Census
+{
+	struct Span
+	{
+		const tPixel4b* Pixels							= nullptr;
+		int64 NumPixels									= 0;
+	};
+
+	// Counts the unique RGBA colours over all the spans. If limit is >= 0 counting stops as soon as more than limit
+	// colours are found and limit+1 is returned. Use a limit whenever only a bound is needed as it is much faster. If
+	// rgbOnly is true alpha is ignored, matching what the quantizers consider a colour. Thread-safe.
+	int CountColours(const std::vector<Span>&, int limit = -1, bool rgbOnly = false);
+	int CountColours(const tImage::tPicture&, int limit = -1, bool rgbOnly = false);
+}
+}
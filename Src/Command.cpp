@@ -16,15 +16,37 @@
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
 #endif
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <string>
 #include <Foundation/tFundamentals.h>
 #include <System/tCmdLine.h>
 #include <System/tPrint.h>
 #include <System/tFile.h>
+#include <System/tMachine.h>
 #include "Version.cmake.h"
 #include "Command.h"
+#include "CommandBands.h"
+#include "CommandCache.h"
 #include "CommandHelp.h"
+#include "CommandJournal.h"
+#include "CommandMetrics.h"
 #include "CommandOps.h"
+#include "CommandServe.h"
+#include "ImageProbe.h"
+#include "Parallel.h"
 #include "TacentView.h"
 
 
@@ -48,6 +70,7 @@ namespace Command
 	tCmdLine::tOption OptionInKTX			("Load parameters for KTX files",	"inKTX",				1	);
 	tCmdLine::tOption OptionInPKM			("Load parameters for PKM files",	"inPKM",				1	);
 	tCmdLine::tOption OptionInPNG			("Load parameters for PNG files",	"inPNG",				1	);
+	tCmdLine::tOption OptionLoadReduce		("Approximate fast first resize",	"loadreduce",			0	);
 
 	tCmdLine::tOption OptionOperation		("Operation",						"op",					1	);
 	tCmdLine::tOption OptionPostOperation	("Post operation",					"po",					1	);
@@ -67,6 +90,18 @@ namespace Command
 	tCmdLine::tOption OptionAutoName		("Autogenerate output file names",	"autoname",		'a'			);
 	tCmdLine::tOption OptionEarlyExit		("Early exit / no skipping",		"earlyexit",	'e'			);
 	tCmdLine::tOption OptionSkipUnchanged	("Don't save unchanged files",		"skipunchanged",'k'			);
+	tCmdLine::tOption OptionJobs			("Number of parallel jobs",			"jobs",			'j',	1	);
+	tCmdLine::tOption OptionQueue			("Pipeline queue depth",			"queue",		'q',	1	);
+	tCmdLine::tOption OptionCache			("Incremental cache directory",		"cache",				1	);
+	tCmdLine::tOption OptionJournal			("Journal of completed inputs",		"journal",				1	);
+	tCmdLine::tOption OptionResume			("Skip inputs done in the journal",	"resume",				0	);
+	tCmdLine::tOption OptionMaxMem			("Memory budget for loaded images",	"maxmem",				1	);
+	tCmdLine::tOption OptionBandMem			("Memory for banded large images",	"bandmem",				1	);
+	tCmdLine::tOption OptionTiming			("Print per-stage timing report",	"timing",		't'			);
+	tCmdLine::tOption OptionMetricsOut		("Write timing metrics as JSON",	"metrics-out",			1	);
+	tCmdLine::tOption OptionServe			("Serve jobs from stdin or socket",	"serve",				1	);
+	tCmdLine::tOption OptionProbe			("Print header info as csv or json","probe",				1	);
+	tCmdLine::tOption OptionProbeColours	("Load and count colours in probe",	"probecolours",			0	);
 
 	void BeginConsoleOutput();
 	void EndConsoleOutput();
@@ -86,8 +121,17 @@ namespace Command
 	};
 	int ParseParamValuePairs(tList<ParamValuePair>& pairs, const tString& pairsStr);			// Parsed pairsStr of form "param1=value1,param2=value2,etc".
 
+	int DetermineVerbosity();																	// Sets the print channels and returns the level.
+	int RunJob();																				// Steps 1 to 6 then processing. Returns an ErrorCode.
+
+	// In server mode (--serve) each request is parsed as if it were a fresh command line and run as a job. All state
+	// left over from the previous job is cleared first. The process, and everything it has initialized, stays warm.
+	int ServeJobs(const tString& endpoint);
+	void ResetJobState();
+
 	void DetermineInputTypes();																	// Step 1.
-	void InputFilesAddUnique(const tSystem::tFileInfo&);
+	bool InputFilesAddUnique(const tSystem::tFileInfo&);										// Returns true if it was not already there.
+	std::unordered_set<std::string> InputFilesSeen;												// Keys of everything in InputFiles.
 	void DetermineInputLoadParameters();
 	void ParseLoadParametersASTC();
 	void ParseLoadParametersDDS();
@@ -98,13 +142,25 @@ namespace Command
 	void ParseLoadParametersPKM();
 	void ParseLoadParametersPNG();
 
-	void DetermineInputFiles();																	// Step 2.
-	void GetItemsFromManifest(tList<tStringItem>& manifestItems, const tString& manifestFile);
+	// Input files may be enumerated while images are already being processed. If supplied, fileAdded is called for
+	// every file as it is added to InputFiles. Enumeration stops early if it returns false. Manifests are streamed
+	// rather than read in full. A manifest of @- is read from stdin and may be null-delimited (find -print0).
+	typedef std::function<bool(const tSystem::tFileInfo&)> FileAddedFn;
+	void DetermineInputFiles(const FileAddedFn& fileAdded = nullptr);							// Step 2.
+	bool HasManifestInput();
+	bool AddInputItem(const tString& item, const FileAddedFn&);									// Returns false to stop.
+	bool AddManifestItems(const tString& manifestItem, const FileAddedFn&);						// Returns false to stop.
 	void ParseInputItem(tList<tSystem::tFileInfo>& inputFiles, const tString& item);
 
+	// With --probe the input files are not loaded. Their headers are read, in parallel, and a line per file is printed
+	// in input order. Nothing else is done.
+	int ProbeInputFiles();																		// Returns an ErrorCode.
+	int tPrintfProbe(const char* format, ...);													// Always printed. Captured in server mode.
+
 	void PopulateOperations();
 	void PopulatePostOperations();
 	void PopulateImagesList();																	// Step 3.
+	Viewer::Image* CreateImage(const tSystem::tFileInfo&);										// Sets load parameters. Does not load.
 	bool ProcessOperationsOnImage(Viewer::Image&);												// Applies all the operations (in order) to the supplied image.
 
 	void DetermineOutputTypes();																// Step 4.
@@ -122,6 +178,122 @@ namespace Command
 
 	tString DetermineOutputFilename(const tString& inName, tSystem::tFileType outType);
 
+	// Output filenames are claimed before an image is saved and released afterwards. This is what prevents two jobs
+	// from writing the same file at the same time and allows autoname to skip names that are about to be written.
+	// Returns false if the name exists (or is being written) and the overwrite option is not set. Since
+	// DetermineOutputFilename reads the claimed names it must only be called with OutputNamesMutex held.
+	bool ClaimOutputFilename(tString& outFilename, const tString& inName, tSystem::tFileType outType);
+	void ReleaseOutputFilename(const tString& outFilename);
+	std::mutex OutputNamesMutex;
+	std::condition_variable OutputNamesReleased;
+	std::unordered_set<std::string> OutputNamesClaimed;
+
+	int DetermineNumJobs();
+	int DetermineQueueDepth();
+	void DetermineOperationsCanonical();
+	void DetermineCache();
+	tuint256 GetCacheSettingsHash(tSystem::tFileType outType);										// Everything but the input contents that affects an output.
+	tString OperationsCanonical;
+	struct CacheScoped
+	{
+		~CacheScoped()					{ Cache::Close(); }
+	};
+
+	// With --journal every completed input is recorded. With --resume as well, inputs recorded by an earlier run
+	// with the same settings are skipped by the restore stage. Outputs are not checked.
+	void DetermineJournal();
+	tuint256 GetJournalSettingsHash();																// Everything that affects the outputs of a job.
+	void JournalDone(const Viewer::Image&, const std::vector<tString>& outFiles);
+	struct JournalScoped
+	{
+		~JournalScoped()				{ Journal::Close(); }
+	};
+
+	// Timing metrics are collected while this is in scope if --timing or --metrics-out is set. The report is printed
+	// when it goes out of scope so it includes the post-operations and any early exit.
+	struct MetricsScoped
+	{
+		MetricsScoped()					{ if (OptionTiming || OptionMetricsOut) Metrics::Begin(); }
+		~MetricsScoped()				{ Metrics::End(OptionMetricsOut ? OptionMetricsOut.Arg1() : tString()); }
+	};
+
+	// Processing an image is split into three stages so that the stages for different images may overlap. The load
+	// stage reads and decodes, the process stage applies the operations, and the save stage encodes and writes. Each
+	// stage returns an ErrorCode and unloads the image if it fails. ProcessImage runs all three. When the cache is
+	// enabled the restore stage runs first and, if it can produce all outputs from the cache, the others are skipped.
+	int RestoreImageStage(Viewer::Image&, bool& restored);
+	int LoadImageStage(Viewer::Image&);
+	int ProcessImageStage(Viewer::Image&, bool& wantSave);
+	int SaveImageStage(Viewer::Image&);
+	int ProcessImage(Viewer::Image&);
+	int ProcessImagesPipelined(int numJobs, int queueDepth, bool streamInputs);					// Returns an ErrorCode.
+
+	// Admission control for --maxmem. Before an image is loaded its decoded size is estimated from a header probe and
+	// that much of the budget is acquired. It is released when the image is done. Requests are admitted in order. An
+	// image larger than the whole budget waits until nothing else is in flight and then takes all of it, so it is
+	// processed alone.
+	int64 DetermineMemoryBudget();																// Returns 0 for no limit.
+	int64 GetPhysicalMemory();																	// Returns 0 if unknown.
+	int64 ParseMemorySize(tString sizeStr);														// MB unless followed by K, M, or G.
+	int64 EstimateImageMemory(const Viewer::Image&);
+	class MemoryBudget
+	{
+	public:
+		MemoryBudget(int64 budget)																: Budget(budget) { }
+		bool Acquire(int64& bytes);																// May reduce bytes to the budget. False if closed.
+		void Release(int64 bytes);
+		void Close();
+
+	private:
+		int64 Budget;
+		int64 InUse = 0;
+		uint64 NextTicket = 0;
+		uint64 ServingTicket = 0;
+		bool Closed = false;
+		std::mutex Mutex;
+		std::condition_variable Changed;
+	};
+
+	// Very large images whose operations and output types allow it are processed a band of rows at a time and never
+	// fully loaded. See CommandBands.h. The band stage replaces the load, process, and save stages for such an image.
+	// Images are only banded if fully loading them would take more than BandMinBytes.
+	void DetermineBands();
+	int BandImageStage(Viewer::Image&, const Bands::Info&);
+	int64 BandMinBytes = 0;
+
+	// A blocking FIFO with a maximum size used to pass images between pipeline stages. Push blocks while full and Pop
+	// blocks while empty. Once closed, Push fails and Pop fails when there is nothing left to pop.
+	template<typename T> class BoundedQueue
+	{
+	public:
+		BoundedQueue(int maxSize)																: MaxSize(tMath::tClampMin(maxSize, 1)) { }
+		bool Push(const T&);
+		bool Pop(T&);
+		void Close();
+
+	private:
+		int MaxSize;
+		bool Closed = false;
+		std::deque<T> Items;
+		std::mutex Mutex;
+		std::condition_variable NotFull;
+		std::condition_variable NotEmpty;
+	};
+
+	struct CapturedLine : public tLink<CapturedLine>
+	{
+		CapturedLine(tSystem::tChannel channels) : Channels(channels)											{ }
+		tSystem::tChannel Channels;
+		tString Text;
+	};
+	thread_local tList<CapturedLine>* CaptureList = nullptr;
+	void PrintCaptured(tList<CapturedLine>&);
+
+	// Set while a served job runs. Every thread without a capture list of its own, including the main thread and
+	// helper threads like encoders, enumerators, and parallel workers, adds its output here under the mutex.
+	std::atomic<tList<CapturedLine>*> JobCaptureList(nullptr);
+	std::mutex JobCaptureMutex;
+
 	tImage::tImageAPNG::SaveParams	SaveParamsAPNG;
 	tImage::tImageBMP::SaveParams	SaveParamsBMP;
 	tImage::tImageGIF::SaveParams	SaveParamsGIF;
@@ -240,6 +412,87 @@ void Command::EndConsoleOutput()
 }
 
 
+int Command::tvPrintfCLI(tSystem::tChannel channels, const char* format, va_list args)
+{
+	tList<CapturedLine>* captureList = CaptureList;
+	std::unique_lock<std::mutex> lock(JobCaptureMutex, std::defer_lock);
+	if (!captureList && JobCaptureList)
+	{
+		lock.lock();
+		captureList = JobCaptureList;
+	}
+	if (!captureList)
+		return tvPrintf(channels, format, args);
+
+	// Consecutive prints to the same channels are accumulated on the same captured line.
+	CapturedLine* line = captureList->Last();
+	if (!line || (line->Channels != channels))
+	{
+		line = new CapturedLine(channels);
+		captureList->Append(line);
+	}
+
+	tString text;
+	tvsPrintf(text, format, args);
+	line->Text += text;
+	return text.Length();
+}
+
+
+void Command::PrintCaptured(tList<CapturedLine>& lines)
+{
+	// Called once no other thread can add to the lines. Workers capture rather than print directly so there is no
+	// interleaving. If the calling thread is itself capturing, or a served job is, the lines are handed on to that
+	// capture buffer.
+	while (CapturedLine* line = lines.Remove())
+	{
+		if (CaptureList)
+		{
+			CaptureList->Append(line);
+			continue;
+		}
+		if (JobCaptureList)
+		{
+			std::lock_guard<std::mutex> lock(JobCaptureMutex);
+			JobCaptureList.load()->Append(line);
+			continue;
+		}
+		tPrintf(line->Channels, "%s", line->Text.Chr());
+		delete line;
+	}
+}
+
+
+tString Command::EscapeJSON(const tString& str)
+{
+	std::string escaped;
+	for (const char* c = str.Chr(); c && *c; c++)
+	{
+		switch (*c)
+		{
+			case '"':	escaped += "\\\"";	break;
+			case '\\':	escaped += "\\\\";	break;
+			case '\n':	escaped += "\\n";	break;
+			case '\r':	escaped += "\\r";	break;
+			case '\t':	escaped += "\\t";	break;
+			default:
+				if (uint8(*c) < 0x20)
+				{
+					char code[8];
+					snprintf(code, sizeof(code), "\\u%04x", int(*c));
+					escaped += code;
+				}
+				else
+				{
+					escaped += *c;
+				}
+				break;
+		}
+	}
+	return tString(escaped.c_str());
+}
+
+
 int Command::ParseParamValuePairs(tList<ParamValuePair>& pairs, const tString& pairsStr)
 {
 	if (pairsStr.IsEmpty())
@@ -310,58 +563,102 @@ void Command::DetermineInputTypes()
 }
 
 
-void Command::InputFilesAddUnique(const tSystem::tFileInfo& infoToAdd)
+bool Command::InputFilesAddUnique(const tSystem::tFileInfo& infoToAdd)
 {
-	bool alreadyAdded = false;
-	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
-	{
-		#ifdef PLAYFORM_WINDOWS
-		if (info->FileName.IsEqualCI(infoToAdd.FileName))
-		#else
-		if (info->FileName.IsEqual(infoToAdd.FileName))
-		#endif
-		{
-			alreadyAdded = true;
-			break;
-		}
-	}
+	// A hash set of the names already added keeps this constant time so manifests with millions of entries are fine.
+	#ifdef PLATFORM_WINDOWS
+	tString keyName = infoToAdd.FileName;
+	keyName.ToLower();
+	std::string key(keyName.Chr());
+	#else
+	std::string key(infoToAdd.FileName.Chr());
+	#endif
+	if (!InputFilesSeen.insert(key).second)
+		return false;
 
-	if (!alreadyAdded)
-		InputFiles.Append(new tSystem::tFileInfo(infoToAdd));
+	InputFiles.Append(new tSystem::tFileInfo(infoToAdd));
+	return true;
 }
 
 
-void Command::GetItemsFromManifest(tList<tStringItem>& manifestItems, const tString& manifestFile)
+bool Command::AddManifestItems(const tString& manifestItem, const FileAddedFn& fileAdded)
 {
-	// The manifest file still has the @ symbol in it.
-	tString manFile = manifestFile;
+	// The manifest item still has the @ symbol in it.
+	tString manFile = manifestItem;
 	manFile.ExtractLeft(1);
-	if (!tSystem::tFileExists(manFile))
-		return;
+	bool fromStdin = (manFile == "-");
+	std::FILE* file = nullptr;
+	if (fromStdin && Serve::IsServingStdio())
+	{
+		tPrintfNorm("Warning: Manifest @- can not be used when serving on stdin. Ignoring.\n");
+		return true;
+	}
+	if (fromStdin)
+	{
+		#ifdef PLATFORM_WINDOWS
+		_setmode(_fileno(stdin), _O_BINARY);
+		#endif
+		file = stdin;
+	}
+	else
+	{
+		if (!tSystem::tFileExists(manFile))
+			return true;
+		file = tSystem::tOpenFile(manFile.Chr(), "rb");
+		if (!file)
+			return true;
+	}
 
-	tString manifest;
-	bool loaded = tSystem::tLoadFile(manFile, manifest);
-	if (!loaded)
-		return;
+	// Items are added as they are read so the manifest is never held in memory and, with a pipe, the first items may
+	// be processed while the rest are still being written. Whichever of a null or a newline comes first decides the
+	// delimiter. Null-delimited manifests hold exact filenames. Otherwise empty lines are skipped, carriage returns
+	// are removed, and lines starting with a semicolon are comments.
+	int delimiter = -1;
+	bool keepGoing = true;
+	std::string item;
+	while (keepGoing)
+	{
+		int c = std::getc(file);
+		if ((delimiter < 0) && ((c == '\0') || (c == '\n')))
+			delimiter = c;
 
-	manifest.Remove('\r');
+		bool endOfItem = (c == EOF) || (c == delimiter);
+		if (!endOfItem)
+		{
+			if ((delimiter == '\0') || (c != '\r'))
+				item.push_back(char(c));
+			continue;
+		}
 
-	tList<tStringItem> lines;
-	int numLines = tStd::tExplode(lines, manifest, '\n');
-	if (numLines <= 0)
-		return;
+		bool comment = (delimiter != '\0') && !item.empty() && (item[0] == ';');
+		if (!item.empty() && !comment)
+			keepGoing = AddInputItem(tString(item.c_str()), fileAdded);
+		item.clear();
 
-	for (tStringItem* line = lines.First(); line; line = line->Next())
-	{
-		if (line->IsEmpty())
-			continue;
+		if (c == EOF)
+			break;
+	}
 
-		// Line comments in manifest files start with a semicolon.
-		if (line->Left(1) == ";")
+	if (!fromStdin)
+		tSystem::tCloseFile(file);
+	return keepGoing;
+}
+
+
+bool Command::AddInputItem(const tString& item, const FileAddedFn& fileAdded)
+{
+	tList<tSystem::tFileInfo> itemFiles;
+	ParseInputItem(itemFiles, item);
+	for (tSystem::tFileInfo* info = itemFiles.First(); info; info = info->Next())
+	{
+		if (!InputFilesAddUnique(*info))
 			continue;
 
-		manifestItems.Append(new tStringItem(*line));
+		if (fileAdded && !fileAdded(*InputFiles.Last()))
+			return false;
 	}
+
+	return true;
 }
 
 
@@ -749,34 +1046,29 @@ void Command::ParseLoadParametersPNG()
 }
 
 
-void Command::DetermineInputFiles()
+void Command::DetermineInputFiles(const FileAddedFn& fileAdded)
 {
-	tList<tSystem::tFileInfo> inputFiles;
-
 	// If no input files specified, use the current directory.
 	if (!ParamInputFiles)
-		tSystem::tFindFiles(inputFiles, "", InputTypes);
+	{
+		tList<tSystem::tFileInfo> currDirFiles;
+		tSystem::tFindFiles(currDirFiles, "", InputTypes);
+		for (tSystem::tFileInfo* info = currDirFiles.First(); info; info = info->Next())
+			if (InputFilesAddUnique(*info) && fileAdded && !fileAdded(*InputFiles.Last()))
+				return;
+	}
 
 	for (tStringItem* fileItem = ParamInputFiles.Values.First(); fileItem; fileItem = fileItem->Next())
 	{
 		// If the fileItem starts with an 'at' symbol (@), we interpret it as a manifest file.
-		if (fileItem->Left(1) == "@")
-		{
-			tList<tStringItem> manifestItems;
-			GetItemsFromManifest(manifestItems, *fileItem);
-			for (tStringItem* manifestItem = manifestItems.First(); manifestItem; manifestItem = manifestItem->Next())
-				ParseInputItem(inputFiles, *manifestItem);
-		}
-		else
-		{
-			ParseInputItem(inputFiles, *fileItem);
-		}
+		bool keepGoing = (fileItem->Left(1) == "@") ? AddManifestItems(*fileItem, fileAdded) : AddInputItem(*fileItem, fileAdded);
+		if (!keepGoing)
+			return;
 	}
 
-	for (tSystem::tFileInfo* info = inputFiles.First(); info; info = info->Next())
-	{
-		InputFilesAddUnique(*info);
-	}
+	// When streaming, the files are being processed (and reported) as they are found.
+	if (fileAdded)
+		return;
 
 	tPrintfFull("Input files:\n");
 	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
@@ -784,35 +1076,92 @@ void Command::DetermineInputFiles()
 }
 
 
+bool Command::HasManifestInput()
+{
+	for (tStringItem* fileItem = ParamInputFiles.Values.First(); fileItem; fileItem = fileItem->Next())
+		if (fileItem->Left(1) == "@")
+			return true;
+
+	return false;
+}
+
+
 void Command::PopulateImagesList()
 {
 	// This doesn't actually load the images. It just prepares them on the Images list.
+	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
+		Images.Append(CreateImage(*info));
+}
+
+
+Viewer::Image* Command::CreateImage(const tSystem::tFileInfo& info)
+{
 	// a) Depending of the filetype it may set custom load parameters.
 	// b) It also turns off the undo-stack since we don't use that in CLI mode.
-	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
+	Viewer::Image* newImage = new Viewer::Image(info);
+	newImage->SetUndoEnabled(false);
+
+	tSystem::tFileType fileType = tSystem::tGetFileType(info.FileName);
+	switch (fileType)
 	{
-		Viewer::Image* newImage = new Viewer::Image(*info);
-		newImage->SetUndoEnabled(false);
+		case tSystem::tFileType::ASTC:	newImage->LoadParams_ASTC = LoadParamsASTC;		break;
+		case tSystem::tFileType::DDS:	newImage->LoadParams_DDS  = LoadParamsDDS;		break;
+		case tSystem::tFileType::PVR:	newImage->LoadParams_PVR  = LoadParamsPVR;		break;
+		case tSystem::tFileType::EXR:	newImage->LoadParams_EXR  = LoadParamsEXR;		break;
+		case tSystem::tFileType::HDR:	newImage->LoadParams_HDR  = LoadParamsHDR;		break;
+		case tSystem::tFileType::JPG:	newImage->LoadParams_JPG  = LoadParamsJPG;		break;
+		case tSystem::tFileType::KTX:	newImage->LoadParams_KTX  = LoadParamsKTX;		break;
+		case tSystem::tFileType::PKM:	newImage->LoadParams_PKM  = LoadParamsPKM;		break;
+		case tSystem::tFileType::PNG:
+			newImage->LoadParams_PNG = LoadParamsPNG;
+			newImage->LoadParams_DetectAPNGInsidePNG = LoadParams_DetectAPNGInsidePNG;
+			break;
+	}
 
-		tSystem::tFileType fileType = tSystem::tGetFileType(info->FileName);
-		switch (fileType)
+	// With --loadreduce a first operation of resize lets the image be reduced as soon as it is decoded.
+	if (OptionLoadReduce)
+	{
+		Operation* first = Operations.First();
+		while (first && !first->Valid)
+			first = first->Next();
+		OperationResize* resize = dynamic_cast<OperationResize*>(first);
+		if (resize)
 		{
-			case tSystem::tFileType::ASTC:	newImage->LoadParams_ASTC = LoadParamsASTC;		break;
-			case tSystem::tFileType::DDS:	newImage->LoadParams_DDS  = LoadParamsDDS;		break;
-			case tSystem::tFileType::PVR:	newImage->LoadParams_PVR  = LoadParamsPVR;		break;
-			case tSystem::tFileType::EXR:	newImage->LoadParams_EXR  = LoadParamsEXR;		break;
-			case tSystem::tFileType::HDR:	newImage->LoadParams_HDR  = LoadParamsHDR;		break;
-			case tSystem::tFileType::JPG:	newImage->LoadParams_JPG  = LoadParamsJPG;		break;
-			case tSystem::tFileType::KTX:	newImage->LoadParams_KTX  = LoadParamsKTX;		break;
-			case tSystem::tFileType::PKM:	newImage->LoadParams_PKM  = LoadParamsPKM;		break;
-			case tSystem::tFileType::PNG:
-				newImage->LoadParams_PNG = LoadParamsPNG;
-				newImage->LoadParams_DetectAPNGInsidePNG = LoadParams_DetectAPNGInsidePNG;
-				break;
+			newImage->LoadParams_ReduceWidth = resize->Width;
+			newImage->LoadParams_ReduceHeight = resize->Height;
 		}
+	}
 
-		Images.Append(newImage);
+	// A first operation of crop lets uncompressed files read just the cropped region. The result is identical so this
+	// is always done. Image::Crop leaves the image untouched when the crop size matches the source size, whatever the
+	// origin, so the region read is only enabled when the sizes differ. The header is probed here for that check and
+	// unsupported file layouts are left to a normal full load.
+	Operation* first = Operations.First();
+	while (first && !first->Valid)
+		first = first->Next();
+	OperationCrop* crop = dynamic_cast<OperationCrop*>(first);
+	int srcWidth = 0, srcHeight = 0;
+	if (crop && Viewer::Region::CanLoad(info.FileName, srcWidth, srcHeight))
+	{
+		Viewer::Region::Rect region;
+		region.Width		= crop->WidthOrMaxX;
+		region.Height		= crop->HeightOrMaxY;
+		if (crop->Mode == OperationCrop::CropMode::Absolute)
+		{
+			region.Width	= crop->WidthOrMaxX+1 - crop->OriginX;
+			region.Height	= crop->HeightOrMaxY+1 - crop->OriginY;
+		}
+		region.OriginX		= crop->OriginX;
+		region.OriginY		= crop->OriginY;
+		region.FillColour	= crop->FillColour;
+		if ((region.Width != srcWidth) || (region.Height != srcHeight))
+		{
+			newImage->LoadParams_Region = region;
+			newImage->LoadParams_RegionEnabled = true;
+		}
 	}
+
+	return newImage;
 }
 
 
@@ -855,6 +1204,9 @@ void Command::PopulateOperations()
 			case tHash::tHashCT("extract"):		Operations.Append(new OperationExtract(args));		break;
 		}
 	}
+
+	// Consecutive point-wise operations like levels, contrast, channel, and swizzle are compiled into a single pass.
+	FusePointwiseOperations(Operations);
 }
 
 
@@ -893,10 +1245,20 @@ bool Command::ProcessOperationsOnImage(Viewer::Image& image)
 		return false;
 
 	bool somethingFailed = false;
+	bool skipCrop = image.IsLoadRegionApplied();
 	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
 	{
 		if (!operation->Valid)
 			continue;
+
+		// When only the cropped region was loaded the first operation (the crop) has already been done.
+		if (skipCrop)
+		{
+			skipCrop = false;
+			tPrintfFull("Crop | Done while loading.\n");
+			continue;
+		}
+		Metrics::ScopedTimer timer(image.Filename, tString("op:") + operation->GetName());
 		bool success = operation->Apply(image);
 		if (!success)
 			somethingFailed = true;
@@ -1328,7 +1690,8 @@ tString Command::DetermineOutputFilename(const tString& inName, tSystem::tFileTy
 		else
 			tsPrintf(contender, "%s%s_%03d.%s", tSystem::tGetDir(inName).Chr(), baseName.Chr(), nameIter, outExt.Chr());
 
-		if (!tSystem::tFileExists(contender))
+		// The caller holds OutputNamesMutex so the claimed names are stable.
+		if (!tSystem::tFileExists(contender) && (OutputNamesClaimed.find(std::string(contender.Chr())) == OutputNamesClaimed.end()))
 			return contender;
 	}
 
@@ -1336,177 +1699,1243 @@ tString Command::DetermineOutputFilename(const tString& inName, tSystem::tFileTy
 }
 
 
-int Command::Process()
+bool Command::ClaimOutputFilename(tString& outFilename, const tString& inName, tSystem::tFileType outType)
 {
-	ConsoleOutputScoped scopedConsoleOutput;
+	std::unique_lock<std::mutex> lock(OutputNamesMutex);
+	outFilename = DetermineOutputFilename(inName, outType);
+	std::string key(outFilename.Chr());
+
+	// With overwrite we wait for any other job writing the same file to finish before claiming it. Without
+	// overwrite a name that is being written is treated the same as a name that exists.
+	if (OptionOverwrite)
+		OutputNamesReleased.wait(lock, [&key] { return OutputNamesClaimed.find(key) == OutputNamesClaimed.end(); });
+	else if ((OutputNamesClaimed.find(key) != OutputNamesClaimed.end()) || tSystem::tFileExists(outFilename))
+		return false;
 
-	// Default is normal (1) verbosity.
-	int verbLevel = 1;
-	if (OptionVerbosity)
-	{
-		tString verbStr = OptionVerbosity.Arg1();
-		if (verbStr == "*")
-			verbLevel = 1;
-		else
-			verbLevel = tMath::tClamp(verbStr.AsInt(), 0, 2);
-	}
+	OutputNamesClaimed.insert(key);
+	return true;
+}
 
-	// Uncomment to debug force verbosity level.
-	// verbLevel = 2;
-	switch (verbLevel)
+
+void Command::ReleaseOutputFilename(const tString& outFilename)
+{
 	{
-		case 0: tSystem::tSetChannels(tSystem::tChannel_Default);																break;
-		case 1: tSystem::tSetChannels(tSystem::tChannel_Default | tSystem::tChannel_Verbosity0);								break;
-		case 2: tSystem::tSetChannels(tSystem::tChannel_Default | tSystem::tChannel_Verbosity0 | tSystem::tChannel_Verbosity1);	break;
+		std::lock_guard<std::mutex> lock(OutputNamesMutex);
+		OutputNamesClaimed.erase(std::string(outFilename.Chr()));
 	}
+	OutputNamesReleased.notify_all();
+}
 
-	if (OptionMarkdown)
+
+int Command::tPrintfProbe(const char* f, ...)
+{
+	va_list l;			va_start(l, f);
+	int n = tvPrintfCLI	(tSystem::tChannel_Default, f, l);
+	va_end(l);			return n;
+}
+
+
+int Command::ProbeInputFiles()
+{
+	tString format = OptionProbe.Arg1();
+	format.ToLower();
+	bool json = (format == "json");
+	if (!json && (format != "csv"))
+		tPrintfNorm("Warning: Unknown probe format %s. Using csv.\n", format.Chr());
+
+	std::vector<tSystem::tFileInfo*> files;
+	for (tSystem::tFileInfo* file = InputFiles.First(); file; file = file->Next())
+		files.push_back(file);
+	int numFiles = int(files.size());
+
+	// Probing is almost all waiting on the file system so, unless told otherwise, every core is used. The order of
+	// the output does not depend on the number of jobs.
+	std::vector<Viewer::Probe::HeaderInfo> headers(numFiles);
+	std::vector<char> probed(numFiles, 0);
+	std::vector<int> colours(numFiles, -1);
+	int numJobs = DetermineNumJobs();
+	numJobs = tMath::tClamp(numJobs, 1, tMath::tClampMin(numFiles, 1));
+	Viewer::Parallel::SetMaxThreads(tMath::tClampMin(tSystem::tGetNumCores(), 1) / numJobs);
+	std::atomic<int> nextFile(0);
+	auto worker = [&]()
 	{
-		Command::PrintExamplesMarkdown();
-		return Viewer::ErrorCode_Success;
-	}
+		for (int f = nextFile++; f < numFiles; f = nextFile++)
+		{
+			Metrics::ScopedTimer timer(files[f]->FileName, "probe");
+			probed[f] = Viewer::Probe::ProbeHeader(headers[f], files[f]->FileName) ? 1 : 0;
+
+			// Counting colours needs the pixels so this is a full load.
+			if (OptionProbeColours)
+			{
+				Viewer::Image* image = CreateImage(*files[f]);
+				image->Load(false);
+				if (image->IsLoaded())
+					colours[f] = image->CountUniqueColours();
+				delete image;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int j = 1; j < numJobs; j++)
+		workers.push_back(std::thread(worker));
+	worker();
+	for (std::thread& w : workers)
+		w.join();
+
+	if (json)
+		tPrintfProbe("[\n");
 	else
+		tPrintfProbe("file,type,ok,width,height,frames,mipmaps,format,bytes%s\n", OptionProbeColours ? ",colours" : "");
+
+	bool somethingFailed = false;
+	for (int f = 0; f < numFiles; f++)
 	{
-		tPrintf("\n");
-		tPrintfNorm("Tacent View %d.%d.%d by Tristan Grimmer\n", ViewerVersion::Major, ViewerVersion::Minor, ViewerVersion::Revision);
-		tString platform	= tGetPlatformNameShort( tGetPlatform() );
-		tString architec	= tGetArchitectureName( tGetArchitecture() );
-		tString config		= tGetConfigurationName( tGetConfiguration() );
-		#ifdef TACENT_UTF16_API_CALLS
-		tString api			= "UTF-16";
-		#else
-		tString api			= "UTF-8";
-		#endif
-		tPrintfNorm("%s %s %s %s API\n", platform.Chr(), architec.Chr(), config.Chr(), api.Chr());
+		const Viewer::Probe::HeaderInfo& header = headers[f];
+		tString filename = files[f]->FileName;
+		tString typeName = tSystem::tGetFileTypeName(tSystem::tGetFileType(filename));
+		const char* formatName = (header.PixelFormat != tImage::tPixelFormat::Invalid) ? tImage::tGetPixelFormatName(header.PixelFormat) : "";
+		// No warning is printed for files that could not be probed as it would end up in the middle of the records.
+		// The ok field says so instead.
+		if (!probed[f])
+			somethingFailed = true;
+
+		// The colour count is -1 if the image could not be loaded.
+		tString coloursField;
+		if (OptionProbeColours)
+			tsPrintf(coloursField, json ? ",\"colours\":%d" : ",%d", colours[f]);
 
-		if (OptionHelp)
-			tPrintfNorm("CLI Mode\n");
+		if (json)
+		{
+			tPrintfProbe
+			(
+				"  {\"file\":\"%s\",\"type\":\"%s\",\"ok\":%s,\"width\":%d,\"height\":%d,\"frames\":%d,\"mipmaps\":%d,\"format\":\"%s\",\"bytes\":%|64d%s}%s\n",
+				EscapeJSON(filename).Chr(), typeName.Chr(), probed[f] ? "true" : "false",
+				header.Width, header.Height, header.NumFrames, header.NumMipmaps, formatName,
+				int64(files[f]->FileSize), coloursField.Chr(), (f < numFiles-1) ? "," : ""
+			);
+		}
 		else
-			tPrintfNorm("CLI Mode Details: tacentview --help\n");
-		tPrintfNorm("\n");
+		{
+			// Filenames are always quoted. Quotes inside them are doubled.
+			tString quoted = filename;
+			quoted.Replace("\"", "\"\"");
+			tPrintfProbe
+			(
+				"\"%s\",%s,%s,%d,%d,%d,%d,%s,%|64d%s\n",
+				quoted.Chr(), typeName.Chr(), probed[f] ? "true" : "false", header.Width, header.Height, header.NumFrames, header.NumMipmaps,
+				formatName, int64(files[f]->FileSize), coloursField.Chr()
+			);
+		}
 	}
 
-	if (OptionHelp)
-	{
-		Command::PrintHelp();
-		return Viewer::ErrorCode_Success;
-	}
+	if (json)
+		tPrintfProbe("]\n");
 
-	if (OptionSyntax)
-	{
-		tCmdLine::tPrintSyntax();
-		return Viewer::ErrorCode_Success;
-	}
+	return somethingFailed ? Viewer::ErrorCode_CLI_FailImageLoad : Viewer::ErrorCode_Success;
+}
 
-	if (OptionExamples)
-	{
-		Command::PrintExamples();
-		return Viewer::ErrorCode_Success;
-	}
 
-	// Determine what input types will be processed when specifying a directory.
-	DetermineInputTypes();
-	DetermineInputLoadParameters();
+int Command::DetermineNumJobs()
+{
+	// The default, if --jobs is not specified, is one job per core, as is a value of 0 or *. Console output is in
+	// input order regardless so only the speed and peak memory depend on this.
+	int numCores = tMath::tClampMin(tSystem::tGetNumCores(), 1);
+	if (!OptionJobs)
+		return numCores;
 
-	// Collect all input files into a single list.
-	DetermineInputFiles();
+	tString jobsStr = OptionJobs.Arg1();
+	if ((jobsStr == "*") || (jobsStr.AsInt() <= 0))
+		return numCores;
 
-	// Populates the Images list. Each added image gets its load-parameters set correctly and the undo-stack turned
-	// off. Does not load the images.
-	PopulateImagesList();
+	return tMath::tClamp(jobsStr.AsInt(), 1, 256);
+}
 
-	// Populates the Operations list.
-	PopulateOperations();
 
-	// Populates the PostOperations list.
-	PopulatePostOperations();
+int Command::DetermineQueueDepth()
+{
+	// The queue depth is the number of images that may wait between two pipeline stages. The default of 1 allows the
+	// next image to be loaded while the current one is processed and the previous one is saved. A depth of 0 turns
+	// the pipeline off so each image is loaded, processed, and saved before the next is started.
+	if (!OptionQueue)
+		return 1;
 
-	DetermineOutputTypes();
-	DetermineOutputNameParameters();
-	DetermineOutputSaveParameters();
+	tString depthStr = OptionQueue.Arg1();
+	if (depthStr == "*")
+		return 1;
 
-	// Process standard operations.
-	// We do the images one at a time to save memory. That is, we only need to load one image in at a time
-	// and can unload them when done.
-	bool somethingFailed = false;
-	for (Viewer::Image* image = Images.First(); image; image = image->Next())
-	{
-		// We do not read the config file when using the CLI. All parameters need to com from the command-line.
-		bool loadParamsFromConfig = false;
-		image->Load(loadParamsFromConfig);
+	return tMath::tClamp(depthStr.AsInt(), 0, 1024);
+}
 
-		tString inNameShort = tSystem::tGetFileName(image->Filename);
-		if (!image->IsLoaded())
-		{
-			tPrintfNorm("Warning: Failed load: %s. Skipping.\n", inNameShort.Chr());
-			somethingFailed = true;
-			if (OptionEarlyExit)
-				return Viewer::ErrorCode_CLI_FailImageLoad;
-			continue;
-		}
 
-		// Process the standard operations on the current image.
-		tPrintfNorm("Processing: %s\n", inNameShort.Chr());
-		bool processed = ProcessOperationsOnImage(*image);
-		if (!processed)
-		{
-			image->Unload();
-			somethingFailed = true;
-			if (OptionEarlyExit)
-				return Viewer::ErrorCode_CLI_FailImageProcess;
-			continue;
-		}
+template<typename T> bool Command::BoundedQueue<T>::Push(const T& item)
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	NotFull.wait(lock, [this] { return Closed || (int(Items.size()) < MaxSize); });
+	if (Closed)
+		return false;
 
-		// Some operations do not modify the input image at all. For example, the extract operation saves every frame
-		// of the input image but does not modify it. In these cases the image dirty flag is not set so we can
-		// skip saving if OptionSkipUnchanged is true.
-		if (OptionSkipUnchanged && !image->IsDirty())
-		{
-			tPrintfNorm("Skipping unchanged: %s\n", inNameShort.Chr());
-			image->Unload();
-			continue;
-		}
+	Items.push_back(item);
+	lock.unlock();
+	NotEmpty.notify_one();
+	return true;
+}
 
-		// Now we iterate through the output types, saving if needed.
-		tAssert(OutTypes.Count() >= 1);
-		for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
-		{
-			tSystem::tFileType outType = typeItem->FileType;
 
-			// Determine out filename.
-			tString outFilename = DetermineOutputFilename(image->Filename, outType);
-			tString outNameShort = tSystem::tGetFileName(outFilename);
-			if (!OptionOverwrite && tSystem::tFileExists(outFilename))
-			{
-				tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
-				somethingFailed = true;
-				if (OptionEarlyExit)
-				{
-					image->Unload();
-					return Viewer::ErrorCode_CLI_FailEarlyExit;
-				}
-				continue;
-			}
+template<typename T> bool Command::BoundedQueue<T>::Pop(T& item)
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	NotEmpty.wait(lock, [this] { return Closed || !Items.empty(); });
+	if (Items.empty())
+		return false;
 
-			// Set the image save parameters correctly. The user may have modified them from the command line.
-			SetImageSaveParameters(*image, outType);
-			bool success = image->Save(outFilename, outType, false);
-			if (success)
-			{
-				tPrintfNorm("Saved File: %s\n", outNameShort.Chr());
-			}
-			else
-			{
-				tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
-				somethingFailed = true;
-				if (OptionEarlyExit)
+	item = Items.front();
+	Items.pop_front();
+	lock.unlock();
+	NotFull.notify_one();
+	return true;
+}
+
+
+template<typename T> void Command::BoundedQueue<T>::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Closed = true;
+	}
+	NotFull.notify_all();
+	NotEmpty.notify_all();
+}
+
+
+int64 Command::DetermineMemoryBudget()
+{
+	// The budget is in MB unless followed by K, M, or G. For example 512, 512M, and 0.5G are all the same. Without
+	// --maxmem the budget is half the physical memory so the default of one job per core can't have an unbounded
+	// amount of decoded images resident. A value of 0 or * means no limit.
+	if (!OptionMaxMem)
+		return GetPhysicalMemory() / 2;
+
+	return ParseMemorySize(OptionMaxMem.Arg1());
+}
+
+
+int64 Command::GetPhysicalMemory()
+{
+	#ifdef PLATFORM_WINDOWS
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status))
+		return int64(status.ullTotalPhys);
+	return 0;
+	#else
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long pageSize = sysconf(_SC_PAGE_SIZE);
+	if ((pages <= 0) || (pageSize <= 0))
+		return 0;
+	return int64(pages) * int64(pageSize);
+	#endif
+}
+
+
+int64 Command::ParseMemorySize(tString sizeStr)
+{
+	if (sizeStr.IsEmpty() || (sizeStr == "*"))
+		return 0;
+
+	double scale = 1024.0*1024.0;
+	char unit = sizeStr[sizeStr.Length()-1];
+	switch (unit)
+	{
+		case 'k': case 'K':	scale = 1024.0;					sizeStr.ExtractRight(1);	break;
+		case 'm': case 'M':	scale = 1024.0*1024.0;			sizeStr.ExtractRight(1);	break;
+		case 'g': case 'G':	scale = 1024.0*1024.0*1024.0;	sizeStr.ExtractRight(1);	break;
+	}
+
+	return tMath::tClampMin(int64(sizeStr.AsDouble() * scale), int64(0));
+}
+
+
+int64 Command::EstimateImageMemory(const Viewer::Image& image)
+{
+	Viewer::Probe::HeaderInfo info;
+	if (!Viewer::Probe::ProbeHeader(info, image.Filename))
+	{
+		// No header probe for this type. An 8:1 compression ratio is pessimistic for most formats.
+		return int64(tSystem::tGetFileSize(image.Filename)) * 8;
+	}
+
+	int64 framePixels = int64(info.Width) * int64(info.Height);
+	int64 pixels = framePixels * tMath::tClampMin(info.NumFrames, 1);
+	if (info.NumMipmaps > 1)
+		pixels += pixels / 3;
+
+	// Decoded pictures are 4 bytes per pixel. Decoding also needs a transient buffer for a frame. Float formats decode
+	// through a 16 byte per pixel buffer.
+	return pixels*4 + framePixels*(info.HighDynamicRange ? 16 : 4);
+}
+
+
+bool Command::MemoryBudget::Acquire(int64& bytes)
+{
+	if (Budget <= 0)
+		return true;
+
+	bytes = tMath::tClamp(bytes, int64(0), Budget);
+	std::unique_lock<std::mutex> lock(Mutex);
+	uint64 ticket = NextTicket++;
+	Changed.wait(lock, [&] { return Closed || ((ticket == ServingTicket) && ((InUse == 0) || (InUse + bytes <= Budget))); });
+	if (Closed)
+		return false;
+
+	InUse += bytes;
+	ServingTicket++;
+	lock.unlock();
+	Changed.notify_all();
+	return true;
+}
+
+
+void Command::MemoryBudget::Release(int64 bytes)
+{
+	if (Budget <= 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		InUse -= bytes;
+	}
+	Changed.notify_all();
+}
+
+
+void Command::MemoryBudget::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Closed = true;
+	}
+	Changed.notify_all();
+}
+
+
+void Command::DetermineBands()
+{
+	// The band memory defaults to 64 MB. Images are banded if loading them would take more than 16 times that, or more
+	// than the whole --maxmem budget. With --skipunchanged nothing may be written until it is known whether the image
+	// changed, so banding is not used.
+	Bands::Clear();
+	BandMinBytes = 0;
+	if (OptionSkipUnchanged)
+		return;
+
+	int64 bandBytes = OptionBandMem ? ParseMemorySize(OptionBandMem.Arg1()) : 0;
+	if (bandBytes <= 0)
+		bandBytes = 64*1024*1024;
+
+	BandMinBytes = bandBytes*16;
+	int64 budgetBytes = DetermineMemoryBudget();
+	if (budgetBytes > 0)
+		BandMinBytes = tMath::tMin(BandMinBytes, budgetBytes);
+
+	if (Bands::Plan(Operations, OutTypes, bandBytes))
+		tPrintfFull("Images over %.1f MB are processed in bands of %.1f MB.\n", double(BandMinBytes)/(1024.0*1024.0), double(bandBytes)/(1024.0*1024.0));
+}
+
+
+void Command::DetermineCache()
+{
+	if (!OptionCache)
+		return;
+
+	// Operations that write their own files can't be skipped on a cache hit.
+	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
+	{
+		if (operation->Valid && operation->HasSideEffects())
+		{
+			tPrintfNorm("Warning: Cache disabled. Operations with side effects were specified.\n");
+			return;
+		}
+	}
+
+	Cache::Open(OptionCache.Arg1());
+}
+
+
+void Command::DetermineOperationsCanonical()
+{
+	OperationsCanonical.Clear();
+	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
+		if (operation->Valid)
+			OperationsCanonical += operation->GetCanonical();
+}
+
+
+void Command::DetermineJournal()
+{
+	if (OptionResume && !OptionJournal)
+		tPrintfNorm("Warning: --resume requires --journal. Nothing will be skipped.\n");
+
+	if (!OptionJournal)
+		return;
+
+	Journal::Open(OptionJournal.Arg1(), GetJournalSettingsHash(), OptionResume);
+}
+
+
+tuint256 Command::GetJournalSettingsHash()
+{
+	// The same settings as the cache for every output type, plus how the output files are named.
+	tuint256 hash = 0;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		tuint256 typeHash = GetCacheSettingsHash(typeItem->FileType);
+		hash = tHash::tHashData256((uint8*)&typeHash, sizeof(typeHash), hash);
+	}
+	hash = tHash::tHashString256(OptionOutName ? OptionOutName.Arg1().Chr() : "*", hash);
+	hash = tHash::tHashString256(OptionAutoName ? "autoname" : "*", hash);
+	return hash;
+}
+
+
+void Command::JournalDone(const Viewer::Image& image, const std::vector<tString>& outFiles)
+{
+	if (Journal::IsOpen())
+		Journal::RecordDone(image.Filename, outFiles);
+}
+
+
+tuint256 Command::GetCacheSettingsHash(tSystem::tFileType outType)
+{
+	// The load and save parameters are hashed in their option-string form. The parse from option string to
+	// parameters is deterministic so this is equivalent to hashing the parameters themselves. All load options are
+	// included since it is the type of the input file that selects which is used. Only the save options for the
+	// output type are included so that changing the settings for one output type does not invalidate the others.
+	tuint256 hash = 0;
+	int version[] = { ViewerVersion::Major, ViewerVersion::Minor, ViewerVersion::Revision, int(outType), OptionSkipUnchanged ? 1 : 0, OptionLoadReduce ? 1 : 0 };
+	hash = tHash::tHashData256((uint8*)version, sizeof(version), hash);
+	hash = tHash::tHashString256(OperationsCanonical.Chr(), hash);
+
+	tCmdLine::tOption* loadOptions[] =
+	{
+		&OptionInASTC, &OptionInDDS, &OptionInEXR, &OptionInHDR, &OptionInJPG, &OptionInKTX, &OptionInPKM, &OptionInPNG
+	};
+	for (tCmdLine::tOption* option : loadOptions)
+		hash = tHash::tHashString256((*option) ? option->Arg1().Chr() : "*", hash);
+
+	tCmdLine::tOption* saveOption = nullptr;
+	switch (outType)
+	{
+		case tSystem::tFileType::APNG: saveOption = &OptionOutAPNG; break;
+		case tSystem::tFileType::BMP:  saveOption = &OptionOutBMP;  break;
+		case tSystem::tFileType::GIF:  saveOption = &OptionOutGIF;  break;
+		case tSystem::tFileType::JPG:  saveOption = &OptionOutJPG;  break;
+		case tSystem::tFileType::PNG:  saveOption = &OptionOutPNG;  break;
+		case tSystem::tFileType::QOI:  saveOption = &OptionOutQOI;  break;
+		case tSystem::tFileType::TGA:  saveOption = &OptionOutTGA;  break;
+		case tSystem::tFileType::TIFF: saveOption = &OptionOutTIFF; break;
+		case tSystem::tFileType::WEBP: saveOption = &OptionOutWEBP; break;
+	}
+	if (saveOption && *saveOption)
+		hash = tHash::tHashString256(saveOption->Arg1().Chr(), hash);
+
+	return hash;
+}
+
+
+int Command::RestoreImageStage(Viewer::Image& image, bool& restored)
+{
+	restored = false;
+	if (Journal::IsDone(image.Filename))
+	{
+		tPrintfNorm("Already done: %s\n", tSystem::tGetFileName(image.Filename).Chr());
+		restored = true;
+		return Viewer::ErrorCode_Success;
+	}
+
+	if (!Cache::IsOpen())
+		return Viewer::ErrorCode_Success;
+	Metrics::ScopedTimer timer(image.Filename, "restore");
+
+	// Every output type must be in the cache. If any is missing the image is processed normally and the save stage
+	// adds the outputs to the cache.
+	std::vector<tuint256> keys;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		tuint256 key = Cache::GetKey(image.Filename, GetCacheSettingsHash(typeItem->FileType));
+		if (!Cache::Contains(key, typeItem->FileType))
+			return Viewer::ErrorCode_Success;
+		keys.push_back(key);
+	}
+
+	restored = true;
+	int result = Viewer::ErrorCode_Success;
+	std::vector<tString> outFiles;
+	int keyIndex = 0;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next(), keyIndex++)
+	{
+		tSystem::tFileType outType = typeItem->FileType;
+		const tuint256& key = keys[keyIndex];
+
+		// An output that is already what we would write is left alone, even without overwrite. This is what makes a
+		// rerun over unchanged inputs fast. Autoname always writes a new file so it can't be up to date.
+		if (!OptionAutoName)
+		{
+			tString outFilename;
+			{
+				std::lock_guard<std::mutex> lock(OutputNamesMutex);
+				outFilename = DetermineOutputFilename(image.Filename, outType);
+			}
+			if (Cache::IsCurrent(outFilename, key))
+			{
+				tPrintfNorm("Up to date: %s\n", tSystem::tGetFileName(outFilename).Chr());
+				outFiles.push_back(outFilename);
+				continue;
+			}
+		}
+
+		tString outFilename;
+		bool claimed = ClaimOutputFilename(outFilename, image.Filename, outType);
+		tString outNameShort = tSystem::tGetFileName(outFilename);
+		if (!claimed)
+		{
+			tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailEarlyExit;
+			if (OptionEarlyExit)
+				break;
+			continue;
+		}
+
+		bool success = Cache::Restore(outFilename, key, outType);
+		ReleaseOutputFilename(outFilename);
+		if (success)
+		{
+			tPrintfNorm("Saved File: %s (cached)\n", outNameShort.Chr());
+			outFiles.push_back(outFilename);
+		}
+		else
+		{
+			tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailImageSave;
+			if (OptionEarlyExit)
+				break;
+		}
+	}
+
+	if (result == Viewer::ErrorCode_Success)
+		JournalDone(image, outFiles);
+	return result;
+}
+
+
+int Command::LoadImageStage(Viewer::Image& image)
+{
+	// We do not read the config file when using the CLI. All parameters need to com from the command-line.
+	bool loadParamsFromConfig = false;
+	{
+		Metrics::ScopedTimer timer(image.Filename, "load");
+		image.Load(loadParamsFromConfig);
+	}
+	if (!image.IsLoaded())
+	{
+		tPrintfNorm("Warning: Failed load: %s. Skipping.\n", tSystem::tGetFileName(image.Filename).Chr());
+		return Viewer::ErrorCode_CLI_FailImageLoad;
+	}
+
+	if (Metrics::IsEnabled())
+	{
+		int64 numPixels = 0;
+		for (tImage::tPicture* pic = image.GetPictures().First(); pic; pic = pic->Next())
+			numPixels += int64(pic->GetWidth()) * int64(pic->GetHeight());
+		Metrics::RecordImage(numPixels);
+	}
+
+	return Viewer::ErrorCode_Success;
+}
+
+
+int Command::ProcessImageStage(Viewer::Image& image, bool& wantSave)
+{
+	wantSave = false;
+	tString inNameShort = tSystem::tGetFileName(image.Filename);
+
+	// Process the standard operations on the current image.
+	tPrintfNorm("Processing: %s\n", inNameShort.Chr());
+	bool processed = ProcessOperationsOnImage(image);
+	if (!processed)
+	{
+		image.Unload();
+		return Viewer::ErrorCode_CLI_FailImageProcess;
+	}
+
+	// Some operations do not modify the input image at all. For example, the extract operation saves every frame
+	// of the input image but does not modify it. In these cases the image dirty flag is not set so we can
+	// skip saving if OptionSkipUnchanged is true.
+	if (OptionSkipUnchanged && !image.IsDirty())
+	{
+		tPrintfNorm("Skipping unchanged: %s\n", inNameShort.Chr());
+		image.Unload();
+		JournalDone(image, std::vector<tString>());
+		return Viewer::ErrorCode_Success;
+	}
+
+	wantSave = true;
+	return Viewer::ErrorCode_Success;
+}
+
+
+int Command::SaveImageStage(Viewer::Image& image)
+{
+	// Each output type gets an encode slot. The filenames are claimed in output-type order on this thread so that
+	// autoname results do not depend on thread timing. The encodes then run concurrently since they only read the
+	// pictures. Without early-exit we keep going after a failure and return the code of the first one.
+	struct Encode
+	{
+		tSystem::tFileType Type = tSystem::tFileType::Invalid;
+		tString Filename;
+		bool Claimed = false;
+		bool Success = false;
+	};
+
+	tAssert(OutTypes.Count() >= 1);
+	std::vector<Encode> encodes;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		Encode encode;
+		encode.Type = typeItem->FileType;
+		encode.Claimed = ClaimOutputFilename(encode.Filename, image.Filename, encode.Type);
+		encodes.push_back(encode);
+
+		// Early-exit stops at the first name that can't be used. Types before it are still saved.
+		if (!encode.Claimed && OptionEarlyExit)
+			break;
+
+		// Set the image save parameters correctly. The user may have modified them from the command line. Each
+		// type has its own parameters member so setting them all up-front is fine.
+		if (encode.Claimed)
+			SetImageSaveParameters(image, encode.Type);
+	}
+
+	// Each encode captures its own output. It is printed, in output-type order, once they are all done. The caller's
+	// capture list is restored afterwards since the first encode runs on this thread.
+	std::deque<tList<CapturedLine>> outputs(encodes.size());
+	auto encodeFn = [&image](Encode& encode, tList<CapturedLine>& output)
+	{
+		tList<CapturedLine>* callerCapture = CaptureList;
+		CaptureList = &output;
+		{
+			Metrics::ScopedTimer timer(image.Filename, tString("save:") + tSystem::tGetExtension(encode.Type));
+			encode.Success = image.Save(encode.Filename, encode.Type, false);
+		}
+		if (encode.Success && Cache::IsOpen())
+			Cache::Store(encode.Filename, Cache::GetKey(image.Filename, GetCacheSettingsHash(encode.Type)), encode.Type);
+		ReleaseOutputFilename(encode.Filename);
+		CaptureList = callerCapture;
+	};
+
+	// The first claimed encode runs on this thread.
+	std::vector<std::thread> encoders;
+	int localEncode = -1;
+	for (int e = 0; e < int(encodes.size()); e++)
+	{
+		if (!encodes[e].Claimed)
+			continue;
+		if (localEncode < 0)
+			localEncode = e;
+		else
+			encoders.push_back(std::thread(encodeFn, std::ref(encodes[e]), std::ref(outputs[e])));
+	}
+	if (localEncode >= 0)
+		encodeFn(encodes[localEncode], outputs[localEncode]);
+	for (std::thread& encoder : encoders)
+		encoder.join();
+	for (tList<CapturedLine>& output : outputs)
+		PrintCaptured(output);
+
+	int result = Viewer::ErrorCode_Success;
+	for (Encode& encode : encodes)
+	{
+		tString outNameShort = tSystem::tGetFileName(encode.Filename);
+		if (!encode.Claimed)
+		{
+			tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailEarlyExit;
+		}
+		else if (encode.Success)
+		{
+			tPrintfNorm("Saved File: %s\n", outNameShort.Chr());
+		}
+		else
+		{
+			tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailImageSave;
+		}
+	}
+
+	image.Unload();
+	if (result == Viewer::ErrorCode_Success)
+	{
+		std::vector<tString> outFiles;
+		for (Encode& encode : encodes)
+			outFiles.push_back(encode.Filename);
+		JournalDone(image, outFiles);
+	}
+	return result;
+}
+
+
+int Command::BandImageStage(Viewer::Image& image, const Bands::Info& info)
+{
+	tString inNameShort = tSystem::tGetFileName(image.Filename);
+	tPrintfNorm("Processing: %s\n", inNameShort.Chr());
+	tPrintfFull
+	(
+		"Bands | Process[src:%dx%d out:%dx%d bands:%d rows:%d mem:%.1fMB]\n",
+		info.SrcWidth, info.SrcHeight, info.Width, info.Height, info.NumBands, info.BandRows, double(info.Memory)/(1024.0*1024.0)
+	);
+
+	// Filenames are claimed in output-type order as in the save stage. Every claimed output is written in the same
+	// pass over the bands.
+	std::vector<Bands::Target> targets;
+	std::vector<tString> typeFiles;
+	std::vector<int> typeTargets;																// -1 if not claimed.
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		Bands::Target target;
+		target.Type = typeItem->FileType;
+		bool claimed = ClaimOutputFilename(target.Filename, image.Filename, target.Type);
+		typeFiles.push_back(target.Filename);
+		typeTargets.push_back(claimed ? int(targets.size()) : -1);
+		if (claimed)
+			targets.push_back(target);
+		else if (OptionEarlyExit)
+			break;
+	}
+
+	{
+		Metrics::ScopedTimer timer(image.Filename, "bands");
+		Bands::Process(targets, image.Filename);
+	}
+	if (Metrics::IsEnabled())
+		Metrics::RecordImage(int64(info.SrcWidth) * int64(info.SrcHeight));
+
+	int result = Viewer::ErrorCode_Success;
+	std::vector<tString> outFiles;
+	for (int t = 0; t < int(typeTargets.size()); t++)
+	{
+		tString outNameShort = tSystem::tGetFileName(typeFiles[t]);
+		if (typeTargets[t] < 0)
+		{
+			tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailEarlyExit;
+			continue;
+		}
+
+		const Bands::Target& target = targets[ typeTargets[t] ];
+		if (target.Success)
+		{
+			if (Cache::IsOpen())
+				Cache::Store(target.Filename, Cache::GetKey(image.Filename, GetCacheSettingsHash(target.Type)), target.Type);
+			tPrintfNorm("Saved File: %s\n", outNameShort.Chr());
+			outFiles.push_back(target.Filename);
+		}
+		else
+		{
+			tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
+			if (result == Viewer::ErrorCode_Success)
+				result = Viewer::ErrorCode_CLI_FailImageSave;
+		}
+		ReleaseOutputFilename(target.Filename);
+	}
+
+	if (result == Viewer::ErrorCode_Success)
+		JournalDone(image, outFiles);
+	return result;
+}
+
+
+int Command::ProcessImage(Viewer::Image& image)
+{
+	bool restored = false;
+	int result = RestoreImageStage(image, restored);
+	if (restored)
+		return result;
+
+	Bands::Info bandInfo;
+	if (Bands::ShouldProcess(bandInfo, image.Filename, BandMinBytes))
+		return BandImageStage(image, bandInfo);
+
+	result = LoadImageStage(image);
+	if (result != Viewer::ErrorCode_Success)
+		return result;
+
+	bool wantSave = false;
+	result = ProcessImageStage(image, wantSave);
+	if ((result != Viewer::ErrorCode_Success) || !wantSave)
+		return result;
+
+	return SaveImageStage(image);
+}
+
+
+int Command::ProcessImagesPipelined(int numJobs, int queueDepth, bool streamInputs)
+{
+	// Each image gets a slot for its result and captured output. Every stage has numJobs worker threads and the
+	// stages are connected by bounded queues of image indices. Loaders grab the next image using an atomic counter,
+	// processors pop from the loaded queue, and savers pop from the processed queue. At most numJobs images are in
+	// each stage and at most queueDepth wait in each queue, so that is what bounds memory use. The main thread waits
+	// for the slots in input order and prints their output so the console reads exactly as it would if the images
+	// were processed one at a time.
+	//
+	// When streaming, an enumerator thread finds the input files and appends an image and a slot for each one as it
+	// goes, so loading starts as soon as the first file is known. The images and slots are deques so references stay
+	// valid while they grow, and they are only accessed with slotsMutex held. Unless post operations need them,
+	// streamed images are deleted once reported so memory does not grow with the number of inputs.
+	struct Slot
+	{
+		int Result = Viewer::ErrorCode_Success;
+		bool Done = false;
+		bool Saving = false;
+		int64 Reserved = 0;
+		tList<CapturedLine> Output;
+	};
+
+	std::deque<Viewer::Image*> images;
+	std::deque<Slot> slots;
+	bool enumerated = false;
+	bool keepImages = !streamInputs || !PostOperations.IsEmpty();
+	if (!streamInputs)
+	{
+		for (Viewer::Image* image = Images.First(); image; image = image->Next())
+		{
+			images.push_back(image);
+			slots.emplace_back();
+		}
+		enumerated = true;
+	}
+
+	std::atomic<int> nextIndex(0);
+	std::atomic<bool> abort(false);
+	std::mutex slotsMutex;
+	std::condition_variable slotsChanged;
+	BoundedQueue<int> loadedQueue(queueDepth);
+	BoundedQueue<int> processedQueue(queueDepth);
+	int64 budgetBytes = DetermineMemoryBudget();
+	MemoryBudget budget(budgetBytes);
+
+	// Waits until there is an image at index or there never will be. Returns false in the latter case.
+	auto waitForImage = [&](int index) -> bool
+	{
+		std::unique_lock<std::mutex> lock(slotsMutex);
+		slotsChanged.wait(lock, [&] { return (index < int(images.size())) || enumerated || abort; });
+		return (index < int(images.size())) && !abort;
+	};
+	auto imageAt = [&](int index) -> Viewer::Image&
+	{
+		std::lock_guard<std::mutex> lock(slotsMutex);
+		return *images[index];
+	};
+	auto slotAt = [&](int index) -> Slot&
+	{
+		std::lock_guard<std::mutex> lock(slotsMutex);
+		return slots[index];
+	};
+
+	auto finishSlot = [&](int index, int result)
+	{
+		Slot& slot = slotAt(index);
+		budget.Release(slot.Reserved);
+		{
+			std::lock_guard<std::mutex> lock(slotsMutex);
+			slot.Result = result;
+			slot.Done = true;
+		}
+		slotsChanged.notify_all();
+	};
+
+	// The last worker to leave a stage closes the queue it feeds so the next stage knows to finish.
+	std::atomic<int> activeLoaders(numJobs);
+	auto loader = [&]()
+	{
+		while (!abort)
+		{
+			int index = nextIndex++;
+			if (!waitForImage(index))
+				break;
+
+			Viewer::Image& image = imageAt(index);
+			Slot& slot = slotAt(index);
+			bool restored = false;
+			CaptureList = &slot.Output;
+			int result = RestoreImageStage(image, restored);
+			Bands::Info bandInfo;
+			bool banded = !restored && Bands::ShouldProcess(bandInfo, image.Filename, BandMinBytes);
+			if (!restored && (budgetBytes > 0))
+			{
+				int64 estimate = banded ? bandInfo.Memory : EstimateImageMemory(image);
+				if (estimate > budgetBytes)
+					tPrintfFull("Over memory budget: %s (%.1f MB). Processing alone.\n", tSystem::tGetFileName(image.Filename).Chr(), double(estimate)/(1024.0*1024.0));
+				if (!budget.Acquire(estimate))
 				{
-					image->Unload();
-					return Viewer::ErrorCode_CLI_FailImageSave;
+					CaptureList = nullptr;
+					break;
 				}
+				slot.Reserved = estimate;
+			}
+			// A banded image is done entirely by the loader.
+			if (banded)
+				result = BandImageStage(image, bandInfo);
+			else if (!restored)
+				result = LoadImageStage(image);
+			CaptureList = nullptr;
+			if (restored || banded || (result != Viewer::ErrorCode_Success))
+				finishSlot(index, result);
+			else if (!loadedQueue.Push(index))
+				image.Unload();
+		}
+		if (--activeLoaders == 0)
+			loadedQueue.Close();
+	};
+
+	std::atomic<int> activeProcessors(numJobs);
+	auto processor = [&]()
+	{
+		int index = -1;
+		while (!abort && loadedQueue.Pop(index))
+		{
+			Viewer::Image& image = imageAt(index);
+			bool wantSave = false;
+			CaptureList = &slotAt(index).Output;
+			int result = ProcessImageStage(image, wantSave);
+			CaptureList = nullptr;
+			if ((result != Viewer::ErrorCode_Success) || !wantSave)
+				finishSlot(index, result);
+			else if (!processedQueue.Push(index))
+				image.Unload();
+		}
+		if (--activeProcessors == 0)
+			processedQueue.Close();
+	};
+
+	auto saver = [&]()
+	{
+		int index = -1;
+		while (!abort && processedQueue.Pop(index))
+		{
+			Viewer::Image& image = imageAt(index);
+			Slot& slot = slotAt(index);
+			{
+				std::lock_guard<std::mutex> lock(slotsMutex);
+				slot.Saving = true;
+			}
+			CaptureList = &slot.Output;
+			int result = SaveImageStage(image);
+			CaptureList = nullptr;
+			finishSlot(index, result);
+		}
+	};
+
+	// Enumeration stops early on abort. The images go on the Images list as well if post operations will need them.
+	auto enumerator = [&]()
+	{
+		DetermineInputFiles
+		(
+			[&](const tSystem::tFileInfo& info) -> bool
+			{
+				if (abort)
+					return false;
+
+				Viewer::Image* image = CreateImage(info);
+				if (keepImages)
+					Images.Append(image);
+				{
+					std::lock_guard<std::mutex> lock(slotsMutex);
+					images.push_back(image);
+					slots.emplace_back();
+				}
+				slotsChanged.notify_all();
+				return true;
+			}
+		);
+
+		{
+			std::lock_guard<std::mutex> lock(slotsMutex);
+			enumerated = true;
+		}
+		slotsChanged.notify_all();
+	};
+
+	if (streamInputs)
+		tPrintfFull("Processing images as input files are found. Jobs per stage: %d. Queue depth: %d.\n", numJobs, queueDepth);
+	else
+		tPrintfFull("Processing %d images. Jobs per stage: %d. Queue depth: %d.\n", int(images.size()), numJobs, queueDepth);
+	if (budgetBytes > 0)
+		tPrintfFull("Memory budget: %.1f MB\n", double(budgetBytes)/(1024.0*1024.0));
+	std::vector<std::thread> workers;
+	if (streamInputs)
+		workers.push_back(std::thread(enumerator));
+	for (int j = 0; j < numJobs; j++)
+	{
+		workers.push_back(std::thread(loader));
+		workers.push_back(std::thread(processor));
+		workers.push_back(std::thread(saver));
+	}
+
+	// With early-exit the first failure (in input order) stops new images from being started. Images already in a
+	// stage are allowed to finish that stage. Later images that had already reached the save stage may have written
+	// files, so their output is printed once the workers are done. Output of the others is dropped.
+	int firstFailure = Viewer::ErrorCode_Success;
+	int failureIndex = -1;
+	int numReported = 0;
+	for (int index = 0; ; index++)
+	{
+		Slot* slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(slotsMutex);
+			slotsChanged.wait(lock, [&] { return ((index < int(slots.size())) && slots[index].Done) || (enumerated && (index >= int(slots.size()))); });
+			if (index >= int(slots.size()))
+				break;
+			slot = &slots[index];
+		}
+
+		PrintCaptured(slot->Output);
+		numReported++;
+		if (!keepImages)
+		{
+			std::lock_guard<std::mutex> lock(slotsMutex);
+			delete images[index];
+			images[index] = nullptr;
+		}
+
+		if ((slot->Result != Viewer::ErrorCode_Success) && (firstFailure == Viewer::ErrorCode_Success))
+		{
+			firstFailure = slot->Result;
+			if (OptionEarlyExit)
+			{
+				failureIndex = index;
+				abort = true;
+				loadedQueue.Close();
+				processedQueue.Close();
+				budget.Close();
+				slotsChanged.notify_all();
+				break;
+			}
+		}
+	}
+
+	for (std::thread& w : workers)
+		w.join();
+
+	if (failureIndex >= 0)
+	{
+		for (int index = failureIndex + 1; index < int(slots.size()); index++)
+		{
+			if (!slots[index].Saving)
+				continue;
+			PrintCaptured(slots[index].Output);
+			numReported++;
+		}
+	}
+
+	if (streamInputs)
+		tPrintfFull("Input files found: %d. Images reported: %d.\n", int(images.size()), numReported);
+
+	// On abort some images may still be sitting in a queue. Unloading an unloaded image is harmless. Streamed images
+	// that are not kept are deleted here if they were never reported.
+	for (Viewer::Image*& image : images)
+	{
+		if (!image)
+			continue;
+		if (abort)
+			image->Unload();
+		if (!keepImages)
+		{
+			delete image;
+			image = nullptr;
+		}
+	}
+
+	if (firstFailure == Viewer::ErrorCode_Success)
+		return Viewer::ErrorCode_Success;
+
+	return OptionEarlyExit ? firstFailure : Viewer::ErrorCode_CLI_FailUnknown;
+}
+
+
+int Command::DetermineVerbosity()
+{
+	// Default is normal (1) verbosity.
+	int verbLevel = 1;
+	if (OptionVerbosity)
+	{
+		tString verbStr = OptionVerbosity.Arg1();
+		if (verbStr == "*")
+			verbLevel = 1;
+		else
+			verbLevel = tMath::tClamp(verbStr.AsInt(), 0, 2);
+	}
+
+	// Uncomment to debug force verbosity level.
+	// verbLevel = 2;
+	switch (verbLevel)
+	{
+		case 0: tSystem::tSetChannels(tSystem::tChannel_Default);																break;
+		case 1: tSystem::tSetChannels(tSystem::tChannel_Default | tSystem::tChannel_Verbosity0);								break;
+		case 2: tSystem::tSetChannels(tSystem::tChannel_Default | tSystem::tChannel_Verbosity0 | tSystem::tChannel_Verbosity1);	break;
+	}
+
+	return verbLevel;
+}
+
+
+int Command::Process()
+{
+	ConsoleOutputScoped scopedConsoleOutput;
+	DetermineVerbosity();
+
+	if (OptionMarkdown)
+	{
+		Command::PrintExamplesMarkdown();
+		return Viewer::ErrorCode_Success;
+	}
+
+	// In server mode stdout may be carrying replies so the banner is not printed.
+	if (OptionServe)
+		return ServeJobs(OptionServe.Arg1());
+
+	// Probe output is meant to be consumed by other tools so it is not mixed with the banner either.
+	if (OptionProbe && !OptionHelp && !OptionSyntax && !OptionExamples)
+	{
+		MetricsScoped scopedMetrics;
+		return RunJob();
+	}
+
+	tPrintf("\n");
+	tPrintfNorm("Tacent View %d.%d.%d by Tristan Grimmer\n", ViewerVersion::Major, ViewerVersion::Minor, ViewerVersion::Revision);
+	tString platform	= tGetPlatformNameShort( tGetPlatform() );
+	tString architec	= tGetArchitectureName( tGetArchitecture() );
+	tString config		= tGetConfigurationName( tGetConfiguration() );
+	#ifdef TACENT_UTF16_API_CALLS
+	tString api			= "UTF-16";
+	#else
+	tString api			= "UTF-8";
+	#endif
+	tPrintfNorm("%s %s %s %s API\n", platform.Chr(), architec.Chr(), config.Chr(), api.Chr());
+
+	if (OptionHelp)
+		tPrintfNorm("CLI Mode\n");
+	else
+		tPrintfNorm("CLI Mode Details: tacentview --help\n");
+	tPrintfNorm("\n");
+
+	if (OptionHelp)
+	{
+		Command::PrintHelp();
+		return Viewer::ErrorCode_Success;
+	}
+
+	if (OptionSyntax)
+	{
+		tCmdLine::tPrintSyntax();
+		return Viewer::ErrorCode_Success;
+	}
+
+	if (OptionExamples)
+	{
+		Command::PrintExamples();
+		return Viewer::ErrorCode_Success;
+	}
+
+	// Timing, if requested, covers the whole job. The report is printed on exit from this function.
+	MetricsScoped scopedMetrics;
+	return RunJob();
+}
+
+
+int Command::RunJob()
+{
+	// Determine what input types will be processed when specifying a directory.
+	DetermineInputTypes();
+	DetermineInputLoadParameters();
+
+	// Collect all input files into a single list. If there is a manifest and images are pipelined, the files are
+	// instead found while the first ones are already being processed. See ProcessImagesPipelined.
+	int numJobs = DetermineNumJobs();
+	int queueDepth = DetermineQueueDepth();
+	// A queue depth of 0 always means the serial loop. The number of jobs only applies to the pipeline.
+	bool pipelined = (queueDepth > 0);
+	bool streamInputs = pipelined && !OptionProbe && HasManifestInput();
+	int numCores = tMath::tClampMin(tSystem::tGetNumCores(), 1);
+	if (!streamInputs)
+	{
+		DetermineInputFiles();
+		if (OptionProbe)
+			return ProbeInputFiles();
+	}
+
+	// Populates the Operations list.
+	PopulateOperations();
+	DetermineOperationsCanonical();
+
+	// Populates the PostOperations list.
+	PopulatePostOperations();
+
+	// Populates the Images list. Each added image gets its load-parameters set correctly and the undo-stack turned
+	// off. Does not load the images. This comes after the operations since they may affect how images are loaded.
+	if (!streamInputs)
+		PopulateImagesList();
+
+	DetermineOutputTypes();
+	DetermineOutputNameParameters();
+	DetermineOutputSaveParameters();
+	DetermineBands();
+
+	// The cache, if enabled, is closed on exit from this function. Closing it writes the index.
+	DetermineCache();
+	CacheScoped scopedCache;
+
+	// The journal, if enabled, is closed on exit from this function.
+	DetermineJournal();
+	JournalScoped scopedJournal;
+
+	// Process standard operations.
+	// We do the images one at a time to save memory. That is, we only need to load one image in at a time
+	// and can unload them when done. When pipelined (the default) a few more images are in memory at once so that
+	// loading, processing, and saving of different images can overlap. See ProcessImagesPipelined.
+	//
+	// Work inside a single image, like resampling or banding, shares the cores with the other jobs. There are never
+	// more jobs than images so a few images still get many threads each. Run serially an image gets every core.
+	bool somethingFailed = false;
+	if (streamInputs || (pipelined && (Images.Count() > 1)))
+	{
+		int activeJobs = streamInputs ? numJobs : tMath::tClamp(Images.Count(), 1, numJobs);
+		Viewer::Parallel::SetMaxThreads(numCores / activeJobs);
+		int result = ProcessImagesPipelined(activeJobs, queueDepth, streamInputs);
+		if (result != Viewer::ErrorCode_Success)
+		{
+			somethingFailed = true;
+			if (OptionEarlyExit)
+				return result;
+		}
+	}
+	else
+	{
+		Viewer::Parallel::SetMaxThreads(numCores);
+		for (Viewer::Image* image = Images.First(); image; image = image->Next())
+		{
+			int result = ProcessImage(*image);
+			if (result != Viewer::ErrorCode_Success)
+			{
+				somethingFailed = true;
+				if (OptionEarlyExit)
+					return result;
 			}
 		}
-		image->Unload();
 	}
 
 	// Do post save operations here --po. These are operations that take more than a single image as input.
@@ -1518,6 +2947,8 @@ int Command::Process()
 	// a contact sheet from multiple images.
 	if (!PostOperations.IsEmpty())
 	{
+		// The post operations run one at a time so they get every core.
+		Viewer::Parallel::SetMaxThreads(numCores);
 		if (Images.Count() < 2)
 		{
 			tPrintfNorm("Warning: Post operations require 2+ input images. Skipping.\n");
@@ -1531,7 +2962,11 @@ int Command::Process()
 					continue;
 
 				tPrintfNorm("Processing post operation: %s\n", postop->GetName());
-				bool success = postop->Apply(Images);
+				bool success = false;
+				{
+					Metrics::ScopedTimer timer(tString(), tString("post:") + postop->GetName());
+					success = postop->Apply(Images);
+				}
 				if (!success)
 				{
 					tPrintfNorm("Warning: Failed post operation: %s\n", postop->GetName());
@@ -1546,3 +2981,108 @@ int Command::Process()
 
 	return somethingFailed ? Viewer::ErrorCode_CLI_FailUnknown : Viewer::ErrorCode_Success;
 }
+
+
+void Command::ResetJobState()
+{
+	// Everything the determine and populate steps fill in goes back to how it was before the first job.
+	InputTypes.Clear();
+	InputFiles.Clear();
+	InputFilesSeen.clear();
+	Images.Clear();
+	Operations.Clear();
+	PostOperations.Clear();
+	OutTypes.Clear();
+	OperationsCanonical.Clear();
+	Bands::Clear();
+	BandMinBytes = 0;
+
+	OutNamePrefix.Clear();
+	OutNameSuffix.Clear();
+	OutNameSearch.Clear();
+	OutNameReplace.Clear();
+
+	LoadParamsASTC	= tImage::tImageASTC::LoadParams();
+	LoadParamsDDS	= tImage::tImageDDS::LoadParams();
+	LoadParamsPVR	= tImage::tImagePVR::LoadParams();
+	LoadParamsEXR	= tImage::tImageEXR::LoadParams();
+	LoadParamsHDR	= tImage::tImageHDR::LoadParams();
+	LoadParamsJPG	= tImage::tImageJPG::LoadParams();
+	LoadParamsKTX	= tImage::tImageKTX::LoadParams();
+	LoadParamsPKM	= tImage::tImagePKM::LoadParams();
+	LoadParamsPNG	= tImage::tImagePNG::LoadParams();
+	LoadParams_DetectAPNGInsidePNG = false;
+
+	SaveParamsAPNG	= tImage::tImageAPNG::SaveParams();
+	SaveParamsBMP	= tImage::tImageBMP::SaveParams();
+	SaveParamsGIF	= tImage::tImageGIF::SaveParams();
+	SaveParamsJPG	= tImage::tImageJPG::SaveParams();
+	SaveParamsPNG	= tImage::tImagePNG::SaveParams();
+	SaveParamsQOI	= tImage::tImageQOI::SaveParams();
+	SaveParamsTGA	= tImage::tImageTGA::SaveParams();
+	SaveParamsTIFF	= tImage::tImageTIFF::SaveParams();
+	SaveParamsWEBP	= tImage::tImageWEBP::SaveParams();
+}
+
+
+int Command::ServeJobs(const tString& endpoint)
+{
+	if (!Serve::Open(endpoint))
+		return Viewer::ErrorCode_CLI_FailServe;
+
+	Serve::Request request;
+	while (Serve::ReadRequest(request))
+	{
+		if (request.Quit)
+			break;
+
+		// The job arguments are parsed exactly as a command line would be. tParse resets every option and parameter
+		// before parsing so nothing carries over from the previous job. --cli is added since it is required.
+		std::vector<std::string> argStrings = { "tacentview", "--cli" };
+		for (tStringItem* arg = request.Args.First(); arg; arg = arg->Next())
+			argStrings.push_back(std::string(arg->Chr()));
+		std::vector<char*> argv;
+		for (std::string& arg : argStrings)
+			argv.push_back(&arg[0]);
+		tCmdLine::tParse(int(argv.size()), argv.data());
+
+		ResetJobState();
+		int verbLevel = DetermineVerbosity();
+
+		// All output for the job is captured and returned in the reply rather than printed. This includes output from
+		// any threads the job starts. The job has joined them all by the time it returns.
+		tList<CapturedLine> output;
+		JobCaptureList = &output;
+		Metrics::Begin();
+		int result = RunJob();
+		tString metrics = Metrics::GetJSON(false, true);
+		Metrics::End(OptionMetricsOut ? OptionMetricsOut.Arg1() : tString(), OptionTiming);
+		JobCaptureList = nullptr;
+
+		// The log respects the verbosity of the job.
+		tString log;
+		for (CapturedLine* line = output.First(); line; line = line->Next())
+		{
+			bool wanted =
+				(line->Channels == tSystem::tChannel_Default) ||
+				((line->Channels == tSystem::tChannel_Verbosity0) && (verbLevel >= 1)) ||
+				((line->Channels == tSystem::tChannel_Verbosity1) && (verbLevel >= 2));
+			if (wanted)
+				log += line->Text;
+		}
+
+		tString reply;
+		tsPrintf
+		(
+			reply, "{\"id\":%s,\"status\":%d,\"metrics\":%s,\"log\":\"%s\"}",
+			request.Id.Chr(), result, metrics.Chr(), EscapeJSON(log).Chr()
+		);
+		Serve::WriteReply(reply);
+
+		// Free the images and operations now rather than holding them until the next request arrives.
+		ResetJobState();
+	}
+
+	Serve::Close();
+	return Viewer::ErrorCode_Success;
+}
@@ -33,6 +33,14 @@ namespace Command
 	int tPrintfNorm(const char* format, ...);		// Appears for verbosity level 1.
 	int tPrintfFull(const char* format, ...);		// Appears for verbosily level 1 and 2.
 
+	// When images are processed by multiple jobs (--jobs) the output printed while working on an image is captured by
+	// the thread doing the work and is printed, in input order, when the image is done. This function either prints
+	// immediately or appends to the capture buffer of the calling thread. It is thread-safe.
+	int tvPrintfCLI(tSystem::tChannel channels, const char* format, va_list);
+
+	// Escapes quotes, backslashes, and control characters so the string may be placed inside a JSON string.
+	tString EscapeJSON(const tString&);
+
 	extern tSystem::tFileTypes OutTypes;
 	extern tCmdLine::tOption OptionOverwrite;
 	extern tCmdLine::tOption OptionEarlyExit;
@@ -57,7 +65,7 @@ namespace Command
 inline int Command::tPrintfNorm(const char* f, ...)
 {
 	va_list l;			va_start(l, f);
-	int n = tvPrintf	(tSystem::tChannel_Verbosity0, f, l);
+	int n = tvPrintfCLI	(tSystem::tChannel_Verbosity0, f, l);
 	va_end(l);			return n;
 }
 
@@ -65,6 +73,6 @@ inline int Command::tPrintfNorm(const char* f, ...)
 inline int Command::tPrintfFull(const char* f, ...)
 {
 	va_list l;			va_start(l, f);
-	int n = tvPrintf	(tSystem::tChannel_Verbosity1, f, l);
+	int n = tvPrintfCLI	(tSystem::tChannel_Verbosity1, f, l);
 	va_end(l);			return n;
 }
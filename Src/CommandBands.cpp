@@ -0,0 +1,382 @@
+// CommandBands.cpp
+//
+// Out-of-core processing of very large images in CLI mode. When the source can be read a region at a time, every
+// operation in the chain works on horizontal bands, and every output type can be written a band at a time, the image
+// is never fully loaded. Peak memory depends on the band size rather than the image size.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <memory>
+#include <vector>
+#include <System/tFile.h>
+#include "CommandBands.h"
+#include "Command.h"
+#include "ImageProbe.h"
+#include "ImageRegion.h"
+#include "Parallel.h"
+
+
+namespace Command
+{
+namespace Bands
+{
+	// A stage is applied to each band on its own. Point-wise operations, fused or not, become a lookup table.
+	struct Stage
+	{
+		enum class Kind { Remap, FlipHorizontal };
+		Kind StageKind									= Kind::Remap;
+		uint8 Lut[4][256];
+		int Source[4]									= { 0, 1, 2, 3 };
+	};
+
+	// The plan is made once per job and is read-only while images are processed.
+	bool Planned										= false;
+	int64 BandBytes										= 0;
+	bool HasCrop										= false;
+	Viewer::Region::Rect Crop;														// Height is the crop height.
+	bool FlipVertical									= false;
+	std::vector<Stage> Stages;
+
+	// Band rows are in picture order, from the bottom up, and are relative to the cropped image. Every stage maps a
+	// band row to the same output row, so each band only needs its own rows from the source.
+	struct Geometry
+	{
+		Viewer::Region::Rect Read;													// Height is unused.
+		int SrcWidth									= 0;
+		int SrcHeight									= 0;
+		int Width										= 0;		// After the crop.
+		int Height										= 0;
+		int BandRows									= 0;
+		int NumBands									= 0;
+		int64 Memory									= 0;
+	};
+
+	bool GetGeometry(Geometry&, int srcWidth, int srcHeight);
+	bool ProcessBand(tImage::tPicture&, const Geometry&, int band, const tString& filename);
+	void ApplyStages(tImage::tPicture&, const std::vector<Stage>&);
+}
+}
+
+
+Viewer::Strip::Format Command::GetStripFormat(tSystem::tFileType outType, bool& rle)
+{
+	rle = false;
+	switch (outType)
+	{
+		case tSystem::tFileType::TGA:
+			rle = (SaveParamsTGA.Compression == tImage::tImageTGA::tCompression::RLE);
+			switch (SaveParamsTGA.Format)
+			{
+				case tImage::tImageTGA::tFormat::BPP24:	return Viewer::Strip::Format::TGA24;
+				case tImage::tImageTGA::tFormat::BPP32:	return Viewer::Strip::Format::TGA32;
+				default:								break;
+			}
+			break;
+
+		case tSystem::tFileType::BMP:
+			if (SaveParamsBMP.Format == tImage::tImageBMP::tFormat::BPP24)
+				return Viewer::Strip::Format::BMP24;
+			break;
+
+		default:
+			break;
+	}
+	return Viewer::Strip::Format::Invalid;
+}
+
+
+void Command::Bands::Clear()
+{
+	Planned			= false;
+	BandBytes		= 0;
+	HasCrop			= false;
+	Crop			= Viewer::Region::Rect();
+	FlipVertical	= false;
+	Stages.clear();
+}
+
+
+bool Command::Bands::IsPlanned()
+{
+	return Planned;
+}
+
+
+bool Command::Bands::Plan(const tList<Operation>& operations, const tSystem::tFileTypes& outTypes, int64 bandBytes)
+{
+	Clear();
+	if (outTypes.IsEmpty() || (bandBytes <= 0))
+		return false;
+
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = outTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		bool rle = false;
+		if (GetStripFormat(typeItem->FileType, rle) == Viewer::Strip::Format::Invalid)
+			return false;
+	}
+
+	// A vertical flip is done by writing the bands in the opposite order. Since it commutes with everything else
+	// supported here, where it appears in the chain doesn't matter. A resize is not supported. Its filters read rows
+	// beyond the band edges and banded output has not been shown to match resizing the whole image.
+	bool first = true;
+	bool supported = true;
+	for (const Operation* operation = operations.First(); operation && supported; operation = operation->Next())
+	{
+		if (!operation->Valid)
+			continue;
+
+		Stage stage;
+		if (const OperationCrop* crop = dynamic_cast<const OperationCrop*>(operation))
+		{
+			if (!first)
+			{
+				supported = false;
+				break;
+			}
+			Crop.Width		= crop->WidthOrMaxX;
+			Crop.Height		= crop->HeightOrMaxY;
+			if (crop->Mode == OperationCrop::CropMode::Absolute)
+			{
+				Crop.Width	= crop->WidthOrMaxX+1 - crop->OriginX;
+				Crop.Height	= crop->HeightOrMaxY+1 - crop->OriginY;
+			}
+			Crop.OriginX	= crop->OriginX;
+			Crop.OriginY	= crop->OriginY;
+			Crop.FillColour	= crop->FillColour;
+			supported = (Crop.Width > 0) && (Crop.Height > 0);
+			HasCrop = true;
+		}
+		else if (const OperationFlip* flip = dynamic_cast<const OperationFlip*>(operation))
+		{
+			if (flip->Mode == OperationFlip::FlipMode::Vertical)
+			{
+				FlipVertical = !FlipVertical;
+			}
+			else
+			{
+				stage.StageKind = Stage::Kind::FlipHorizontal;
+				Stages.push_back(stage);
+			}
+		}
+		else if (const OperationFused* fused = dynamic_cast<const OperationFused*>(operation))
+		{
+			tStd::tMemcpy(stage.Lut, fused->Lut, sizeof(stage.Lut));
+			tStd::tMemcpy(stage.Source, fused->Source, sizeof(stage.Source));
+			Stages.push_back(stage);
+		}
+		else if (operation->IsPointwise() && OperationFused::Probe(*operation, stage.Lut, stage.Source))
+		{
+			Stages.push_back(stage);
+		}
+		else
+		{
+			supported = false;
+		}
+		first = false;
+	}
+
+	if (!supported)
+	{
+		Clear();
+		return false;
+	}
+
+	Planned = true;
+	BandBytes = bandBytes;
+	return true;
+}
+
+
+bool Command::Bands::GetGeometry(Geometry& geom, int srcWidth, int srcHeight)
+{
+	geom = Geometry();
+	geom.SrcWidth		= srcWidth;
+	geom.SrcHeight		= srcHeight;
+	geom.Read.Width		= srcWidth;
+	geom.Width			= srcWidth;
+	geom.Height			= srcHeight;
+
+	// Image::Crop does nothing when the crop is the same size as the source, whatever the origin, so neither do we.
+	if (HasCrop && ((Crop.Width != srcWidth) || (Crop.Height != srcHeight)))
+	{
+		geom.Read		= Crop;
+		geom.Width		= Crop.Width;
+		geom.Height		= Crop.Height;
+	}
+
+	// Bands in flight at the same time share the band memory. Each band is read and then copied for the writers.
+	int numThreads = Viewer::Parallel::GetMaxThreads();
+	int64 perBand = tMath::tClampMin(BandBytes / numThreads, int64(1));
+	int64 rowBytes = int64(geom.Width) * 4;
+	int64 rows = tMath::tClamp(perBand / (2*rowBytes), int64(1), int64(geom.Height));
+	geom.BandRows = int(rows);
+	int64 bandMemory = rows * 2*rowBytes;
+
+	geom.NumBands = (geom.Height + geom.BandRows - 1) / geom.BandRows;
+	geom.Memory = tMath::tMin(numThreads, geom.NumBands) * bandMemory;
+	return (geom.Width > 0) && (geom.Height > 0) && (geom.NumBands > 0);
+}
+
+
+bool Command::Bands::ShouldProcess(Info& info, const tString& filename, int64 minBytes)
+{
+	if (!Planned || !Viewer::Region::CanLoad(filename))
+		return false;
+
+	Viewer::Probe::HeaderInfo header;
+	if (!Viewer::Probe::ProbeHeader(header, filename) || !header.IsValid())
+		return false;
+
+	int64 fullBytes = int64(header.Width) * int64(header.Height) * 4;
+	if (fullBytes <= minBytes)
+		return false;
+
+	Geometry geom;
+	if (!GetGeometry(geom, header.Width, header.Height) || (geom.Memory*2 > fullBytes))
+		return false;
+
+	info.SrcWidth	= geom.SrcWidth;
+	info.SrcHeight	= geom.SrcHeight;
+	info.Width		= geom.Width;
+	info.Height		= geom.Height;
+	info.BandRows	= geom.BandRows;
+	info.NumBands	= geom.NumBands;
+	info.Memory		= geom.Memory;
+	return true;
+}
+
+
+void Command::Bands::ApplyStages(tImage::tPicture& picture, const std::vector<Stage>& stages)
+{
+	for (const Stage& stage : stages)
+	{
+		switch (stage.StageKind)
+		{
+			case Stage::Kind::FlipHorizontal:
+				picture.Flip(true);
+				break;
+
+			case Stage::Kind::Remap:
+			{
+				uint8* pixels = (uint8*)picture.GetPixelPointer();
+				int64 numPixels = int64(picture.GetWidth()) * int64(picture.GetHeight());
+				for (int64 p = 0; p < numPixels; p++, pixels += 4)
+				{
+					uint8 src[4] = { pixels[0], pixels[1], pixels[2], pixels[3] };
+					pixels[0] = stage.Lut[0][ src[stage.Source[0]] ];
+					pixels[1] = stage.Lut[1][ src[stage.Source[1]] ];
+					pixels[2] = stage.Lut[2][ src[stage.Source[2]] ];
+					pixels[3] = stage.Lut[3][ src[stage.Source[3]] ];
+				}
+				break;
+			}
+		}
+	}
+}
+
+
+bool Command::Bands::ProcessBand(tImage::tPicture& picture, const Geometry& geom, int band, const tString& filename)
+{
+	int y0 = band * geom.BandRows;
+	int y1 = tMath::tMin(y0 + geom.BandRows, geom.Height);
+
+	Viewer::Region::Rect rect = geom.Read;
+	rect.OriginY += y0;
+	rect.Height = y1 - y0;
+	tImage::tPixelFormat srcFormat = tImage::tPixelFormat::Invalid;
+	int srcWidth = 0;
+	int srcHeight = 0;
+	if (!Viewer::Region::Load(picture, srcFormat, srcWidth, srcHeight, filename, rect))
+		return false;
+
+	// The source may have changed since the header was read.
+	if ((srcWidth != geom.SrcWidth) || (srcHeight != geom.SrcHeight))
+		return false;
+
+	ApplyStages(picture, Stages);
+	return picture.IsValid();
+}
+
+
+bool Command::Bands::Process(std::vector<Target>& targets, const tString& filename)
+{
+	for (Target& target : targets)
+		target.Success = false;
+
+	Viewer::Probe::HeaderInfo header;
+	Geometry geom;
+	if (!Planned || !Viewer::Probe::ProbeHeader(header, filename) || !GetGeometry(geom, header.Width, header.Height))
+		return false;
+
+	int numTargets = int(targets.size());
+	std::vector<Viewer::Strip::Writer> writers(numTargets);
+	for (int t = 0; t < numTargets; t++)
+	{
+		bool rle = false;
+		Viewer::Strip::Format format = GetStripFormat(targets[t].Type, rle);
+		targets[t].Success = writers[t].Open(targets[t].Filename, format, rle, geom.Width, geom.Height);
+	}
+
+	// Writers take rows from the top down and bands are bottom-up, so normally the last band goes first and its rows
+	// are written in reverse. A vertical flip is the same thing backwards.
+	std::vector<int> order(geom.NumBands);
+	for (int b = 0; b < geom.NumBands; b++)
+		order[b] = FlipVertical ? b : (geom.NumBands - 1 - b);
+
+	// Bands are processed in batches, in parallel, and written in order.
+	int batchSize = Viewer::Parallel::GetMaxThreads();
+	bool ok = true;
+	for (int start = 0; (start < geom.NumBands) && ok; start += batchSize)
+	{
+		int count = tMath::tMin(batchSize, geom.NumBands - start);
+		std::vector<std::unique_ptr<tImage::tPicture>> bands(count);
+		std::vector<char> bandOK(count);
+		Viewer::Parallel::For(count, [&](int i)
+		{
+			bands[i].reset(new tImage::tPicture());
+			bandOK[i] = ProcessBand(*bands[i], geom, order[start+i], filename);
+		});
+
+		for (int i = 0; (i < count) && ok; i++)
+		{
+			ok = bandOK[i];
+			if (!ok)
+				break;
+
+			const tPixel4b* pixels = bands[i]->GetPixelPointer();
+			int width = bands[i]->GetWidth();
+			int height = bands[i]->GetHeight();
+			for (Viewer::Strip::Writer& writer : writers)
+			{
+				if (!writer.IsOpen())
+					continue;
+				if (FlipVertical)
+					writer.WriteRowsTopDown(pixels, height);
+				else
+					for (int y = height-1; y >= 0; y--)
+						writer.WriteRowsTopDown(pixels + y*width, 1);
+			}
+		}
+	}
+
+	bool allSucceeded = true;
+	for (int t = 0; t < numTargets; t++)
+	{
+		bool opened = targets[t].Success;
+		targets[t].Success = writers[t].Close() && ok;
+		if (opened && !targets[t].Success)
+			tSystem::tDeleteFile(targets[t].Filename);
+		if (!targets[t].Success)
+			allSucceeded = false;
+	}
+
+	return allSucceeded;
+}
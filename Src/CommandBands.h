@@ -0,0 +1,70 @@
+// CommandBands.h
+//
+// Out-of-core processing of very large images in CLI mode. When the source can be read a region at a time, every
+// operation in the chain works on horizontal bands, and every output type can be written a band at a time, the image
+// is never fully loaded. Peak memory depends on the band size rather than the image size.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Foundation/tString.h>
+#include <System/tFile.h>
+#include "CommandOps.h"
+#include "ImageStrip.h"
+
+
+namespace Command
+{
+	// Returns the band-at-a-time format for saving outType with the current save parameters, or Invalid if it must be
+	// saved from a whole picture. Auto formats need to see every pixel first so they are never streamed.
+	Viewer::Strip::Format GetStripFormat(tSystem::tFileType outType, bool& rle);
+
+namespace Bands
+{
+	// Works out whether the operations can be run a band at a time and how. Supported are a crop as the first
+	// operation, flips, and any point-wise operations (levels, contrast, brightness, channel, swizzle). A resize is not
+	// supported. Every output type must have a strip format. Call after the operations and the save parameters are
+	// determined. bandBytes is the target memory for a single band. Returns true if a plan was made. Clear drops the
+	// plan.
+	bool Plan(const tList<Operation>&, const tSystem::tFileTypes& outTypes, int64 bandBytes);
+	void Clear();
+	bool IsPlanned();
+
+	struct Info
+	{
+		int SrcWidth									= 0;
+		int SrcHeight									= 0;
+		int Width										= 0;		// Of the output.
+		int Height										= 0;
+		int BandRows									= 0;		// Output rows per band.
+		int NumBands									= 0;
+		int64 Memory									= 0;		// Estimated peak use in bytes.
+	};
+
+	// Returns true if the file should be processed in bands. There must be a plan, the file layout must support region
+	// reads, and the decoded image must be bigger than minBytes. The band geometry must also save memory, which is not
+	// the case for images only a few rows tall. Only the header is read. Thread-safe.
+	bool ShouldProcess(Info&, const tString& filename, int64 minBytes);
+
+	struct Target
+	{
+		tSystem::tFileType Type							= tSystem::tFileType::Invalid;
+		tString Filename;
+		bool Success									= false;
+	};
+
+	// Reads, processes, and writes the image a band at a time. Each target gets its own writer and its Success member
+	// is set. Files that fail are deleted. The caller claims the filenames. The bands in flight at once are processed
+	// in parallel. Does not print. Returns true if every target succeeded. Thread-safe.
+	bool Process(std::vector<Target>&, const tString& filename);
+}
+}
@@ -0,0 +1,406 @@
+// CommandCache.cpp
+//
+// An optional content-addressed cache for command line processing. The key for an output file is made from a hash of
+// the input file contents and a hash of everything that affects the result (operations, load parameters, and save
+// parameters). On a hit the previously generated output is copied instead of loading, processing, and saving the
+// input image again. A small index in the cache directory maps file stats to content hashes so unchanged inputs do
+// not need to be re-read and up-to-date outputs do not need to be re-copied.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <Foundation/tHash.h>
+#include <System/tFile.h>
+#include <System/tPrint.h>
+#include "CommandCache.h"
+#include "Command.h"
+
+
+namespace Command
+{
+namespace Cache
+{
+	// The index is a text file with one record per line. Later records override earlier ones.
+	// I <stat-hash> <content-hash>		An input file with the given name, size, and modification time has the content hash.
+	// O <stat-hash> <key>				An output file with the given name, size, and modification time was made for key.
+	// The index is only ever appended to while the cache is open. It is rewritten without stale records on Close. The
+	// rewrite goes to a temporary file that is renamed into place, and includes records other processes appended.
+	const char* IndexFilename		= "Index.txt";
+	const int IndexVersion			= 1;
+
+	// An input that can't be read gets this key and is never cached.
+	const tuint256 InvalidKey		= 0;
+
+	tString StatHash(const tString& file);
+	tString HashString(const tuint256&);
+	bool HashFileContents(tuint256& hash, const tString& file);
+	tString GetEntryFilename(const tuint256& key, tSystem::tFileType outType);
+	tString GetTempName(const tString& destName);
+	bool RenameReplace(const tString& dir, const tString& tempName, const tString& destName);
+	bool CopyFileReplace(const tString& destFile, const tString& srcFile);
+	void ReadIndex
+	(
+		std::unordered_map<std::string, std::string>& inputs, std::unordered_map<std::string, std::string>& outputs,
+		const tString& indexFile
+	);
+	bool WriteIndex(const tString& indexFile);
+	void AppendRecord(char type, const tString& statHash, const tString& value);
+
+	std::mutex Mutex;
+	tString Directory;
+	tSystem::tFileHandle IndexFile	= nullptr;
+	int NumRecordsAppended			= 0;
+	std::unordered_map<std::string, std::string> InputContentHashes;
+	std::unordered_map<std::string, std::string> OutputKeys;
+	std::atomic<int> TempCounter(0);
+}
+}
+
+
+tString Command::Cache::StatHash(const tString& file)
+{
+	// The same things the thumbnail cache and image-list hashes use. Returns an empty string if the file is missing.
+	tSystem::tFileInfo info;
+	if (!tSystem::tGetFileInfo(info, file))
+		return tString();
+
+	tuint256 hash = 0;
+	hash = tHash::tHashData256((uint8*)&IndexVersion, sizeof(IndexVersion));
+	hash = tHash::tHashString256(info.FileName.Chr(), hash);
+	hash = tHash::tHashData256((uint8*)&info.FileSize, sizeof(info.FileSize), hash);
+	hash = tHash::tHashData256((uint8*)&info.ModificationTime, sizeof(info.ModificationTime), hash);
+	return HashString(hash);
+}
+
+
+tString Command::Cache::HashString(const tuint256& hash)
+{
+	tString str;
+	tsPrintf(str, "%064|256X", hash);
+	return str;
+}
+
+
+bool Command::Cache::HashFileContents(tuint256& hash, const tString& file)
+{
+	// Read in chunks so files of any size can be hashed without loading them whole. The hash of each chunk seeds the
+	// next so a file that fits in one chunk hashes the same as a single tHashData256 call.
+	const int chunkSize = 1 << 24;
+	tSystem::tFileHandle handle = tSystem::tOpenFile(file.Chr(), "rb");
+	if (!handle)
+		return false;
+
+	std::vector<uint8> chunk(chunkSize);
+	bool ok = true;
+	for (bool first = true; ; first = false)
+	{
+		int numBytes = tSystem::tReadFile(handle, chunk.data(), chunkSize);
+		if (numBytes < 0)
+		{
+			ok = false;
+			break;
+		}
+		if (first || (numBytes > 0))
+			hash = first ? tHash::tHashData256(chunk.data(), numBytes) : tHash::tHashData256(chunk.data(), numBytes, hash);
+		if (numBytes < chunkSize)
+			break;
+	}
+	tSystem::tCloseFile(handle);
+	return ok;
+}
+
+
+tString Command::Cache::GetEntryFilename(const tuint256& key, tSystem::tFileType outType)
+{
+	return Directory + HashString(key) + "." + tSystem::tGetExtension(outType);
+}
+
+
+tString Command::Cache::GetTempName(const tString& destName)
+{
+	// The temporary name is unique across threads and across processes sharing the cache.
+	size_t unique = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+		size_t(std::chrono::steady_clock::now().time_since_epoch().count()) ^ size_t(TempCounter++);
+	tString tempName;
+	tsPrintf(tempName, "%s.%016|64X.tmp", destName.Chr(), uint64(unique));
+	return tempName;
+}
+
+
+bool Command::Cache::RenameReplace(const tString& dir, const tString& tempName, const tString& destName)
+{
+	// Renaming does not replace an existing file on all platforms. The temporary file is deleted on failure.
+	bool renamed = tSystem::tRenameFile(dir, tempName, destName);
+	if (!renamed && tSystem::tFileExists(dir + destName))
+	{
+		tSystem::tDeleteFile(dir + destName);
+		renamed = tSystem::tRenameFile(dir, tempName, destName);
+	}
+	if (!renamed)
+		tSystem::tDeleteFile(dir + tempName);
+	return renamed;
+}
+
+
+bool Command::Cache::CopyFileReplace(const tString& destFile, const tString& srcFile)
+{
+	// The copy is made to a temporary file in the destination directory and then renamed into place. A crash or a
+	// concurrent copy can then never leave a truncated destination file.
+	tString dir = tSystem::tGetDir(destFile);
+	tString destName = tSystem::tGetFileName(destFile);
+	tString tempName = GetTempName(destName);
+	if (!tSystem::tCopyFile(dir + tempName, srcFile, true))
+	{
+		tSystem::tDeleteFile(dir + tempName);
+		return false;
+	}
+
+	return RenameReplace(dir, tempName, destName);
+}
+
+
+void Command::Cache::ReadIndex
+(
+	std::unordered_map<std::string, std::string>& inputs, std::unordered_map<std::string, std::string>& outputs,
+	const tString& indexFile
+)
+{
+	tString index;
+	if (!tSystem::tFileExists(indexFile) || !tSystem::tLoadFile(indexFile, index))
+		return;
+
+	index.Remove('\r');
+	tList<tStringItem> lines;
+	tStd::tExplode(lines, index, '\n');
+	for (tStringItem* line = lines.First(); line; line = line->Next())
+	{
+		tList<tStringItem> fields;
+		if (tStd::tExplode(fields, *line, ' ') != 3)
+			continue;
+
+		tStringItem* type = fields.First();
+		std::string statHash(type->Next()->Chr());
+		std::string value(type->Next()->Next()->Chr());
+		if (*type == "I")
+			inputs[statHash] = value;
+		else if (*type == "O")
+			outputs[statHash] = value;
+	}
+}
+
+
+bool Command::Cache::WriteIndex(const tString& indexFile)
+{
+	// Mutex must be held by caller. Another process may have appended records since we opened the index, or even
+	// replaced it, in which case our own appends went to the file it replaced. Reading it again and adding our records
+	// on top keeps both. A crash part way through leaves the old index in place.
+	std::unordered_map<std::string, std::string> inputs;
+	std::unordered_map<std::string, std::string> outputs;
+	ReadIndex(inputs, outputs, indexFile);
+	for (auto& record : InputContentHashes)
+		inputs[record.first] = record.second;
+	for (auto& record : OutputKeys)
+		outputs[record.first] = record.second;
+
+	tString dir = tSystem::tGetDir(indexFile);
+	tString indexName = tSystem::tGetFileName(indexFile);
+	tString tempName = GetTempName(indexName);
+	tSystem::tFileHandle file = tSystem::tOpenFile((dir + tempName).Chr(), "wb");
+	if (!file)
+		return false;
+
+	for (auto& record : inputs)
+		tfPrintf(file, "I %s %s\n", record.first.c_str(), record.second.c_str());
+	for (auto& record : outputs)
+		tfPrintf(file, "O %s %s\n", record.first.c_str(), record.second.c_str());
+	bool ok = (std::fflush(file) == 0) && !std::ferror(file);
+	tSystem::tCloseFile(file);
+	if (!ok)
+	{
+		tSystem::tDeleteFile(dir + tempName);
+		return false;
+	}
+
+	return RenameReplace(dir, tempName, indexName);
+}
+
+
+bool Command::Cache::Open(const tString& cacheDir)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (IndexFile)
+		return true;
+
+	Directory = cacheDir.IsEmpty() ? tString(".") : cacheDir;
+	Directory = tSystem::tGetAbsolutePath(Directory);
+	Directory.Replace('\\', '/');
+	if (Directory[Directory.Length()-1] != '/')
+		Directory += "/";
+
+	if (!tSystem::tDirExists(Directory) && !tSystem::tCreateDir(Directory))
+	{
+		tPrintfNorm("Warning: Could not create cache directory %s\n", Directory.Chr());
+		return false;
+	}
+
+	tString indexFile = Directory + IndexFilename;
+	ReadIndex(InputContentHashes, OutputKeys, indexFile);
+
+	IndexFile = tSystem::tOpenFile(indexFile.Chr(), "ab");
+	if (!IndexFile)
+	{
+		tPrintfNorm("Warning: Could not open cache index %s\n", indexFile.Chr());
+		return false;
+	}
+
+	NumRecordsAppended = 0;
+	tPrintfFull("Cache: %s Inputs:%d Outputs:%d\n", Directory.Chr(), int(InputContentHashes.size()), int(OutputKeys.size()));
+	return true;
+}
+
+
+void Command::Cache::Close()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (!IndexFile)
+		return;
+
+	tSystem::tCloseFile(IndexFile);
+	IndexFile = nullptr;
+
+	// Since records are only ever appended, the index accumulates stale entries for files that have since changed.
+	// Rewriting it keeps only the current record for each stat hash.
+	if ((NumRecordsAppended > 0) && !WriteIndex(Directory + IndexFilename))
+		tPrintfNorm("Warning: Could not rewrite cache index %s%s\n", Directory.Chr(), IndexFilename);
+
+	InputContentHashes.clear();
+	OutputKeys.clear();
+}
+
+
+bool Command::Cache::IsOpen()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return IndexFile != nullptr;
+}
+
+
+void Command::Cache::AppendRecord(char type, const tString& statHash, const tString& value)
+{
+	// Mutex must be held by caller.
+	if (!IndexFile)
+		return;
+
+	tfPrintf(IndexFile, "%c %s %s\n", type, statHash.Chr(), value.Chr());
+	NumRecordsAppended++;
+}
+
+
+tuint256 Command::Cache::GetKey(const tString& inFile, const tuint256& settingsHash)
+{
+	tString statHash = StatHash(inFile);
+	tString contentHash;
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		auto found = InputContentHashes.find(std::string(statHash.Chr()));
+		if (found != InputContentHashes.end())
+			contentHash = found->second.c_str();
+	}
+
+	// Not in the index. We need to read the file. This is done without holding the mutex.
+	if (contentHash.IsEmpty())
+	{
+		tuint256 hash = 0;
+		if (!HashFileContents(hash, inFile))
+			return InvalidKey;
+		contentHash = HashString(hash);
+
+		std::lock_guard<std::mutex> lock(Mutex);
+		if (statHash.IsValid())
+		{
+			InputContentHashes[std::string(statHash.Chr())] = std::string(contentHash.Chr());
+			AppendRecord('I', statHash, contentHash);
+		}
+	}
+
+	tuint256 key = tHash::tHashString256(contentHash.Chr(), settingsHash);
+	return key;
+}
+
+
+bool Command::Cache::Contains(const tuint256& key, tSystem::tFileType outType)
+{
+	if (key == InvalidKey)
+		return false;
+
+	return tSystem::tFileExists(GetEntryFilename(key, outType));
+}
+
+
+bool Command::Cache::IsCurrent(const tString& outFile, const tuint256& key)
+{
+	tString outStatHash = StatHash(outFile);
+	if (outStatHash.IsEmpty() || (key == InvalidKey))
+		return false;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	auto found = OutputKeys.find(std::string(outStatHash.Chr()));
+	return (found != OutputKeys.end()) && (HashString(key) == found->second.c_str());
+}
+
+
+bool Command::Cache::Restore(const tString& outFile, const tuint256& key, tSystem::tFileType outType)
+{
+	// We copy rather than hardlink. A hardlinked output shares its data with the cache entry so anything that
+	// modifies the output in place would silently corrupt the cache.
+	if (key == InvalidKey)
+		return false;
+
+	tString entryFile = GetEntryFilename(key, outType);
+	if (!CopyFileReplace(outFile, entryFile))
+		return false;
+
+	tString keyStr = HashString(key);
+	tString outStatHash = StatHash(outFile);
+	std::lock_guard<std::mutex> lock(Mutex);
+	OutputKeys[std::string(outStatHash.Chr())] = std::string(keyStr.Chr());
+	AppendRecord('O', outStatHash, keyStr);
+	return true;
+}
+
+
+bool Command::Cache::Store(const tString& outFile, const tuint256& key, tSystem::tFileType outType)
+{
+	if (key == InvalidKey)
+		return false;
+
+	tString keyStr = HashString(key);
+	tString entryFile = GetEntryFilename(key, outType);
+	if (!tSystem::tFileExists(entryFile) && !CopyFileReplace(entryFile, outFile))
+		return false;
+
+	tString outStatHash = StatHash(outFile);
+	if (outStatHash.IsEmpty())
+		return false;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	OutputKeys[std::string(outStatHash.Chr())] = std::string(keyStr.Chr());
+	AppendRecord('O', outStatHash, keyStr);
+	return true;
+}
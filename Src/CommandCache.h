@@ -0,0 +1,51 @@
+// CommandCache.h
+//
+// An optional content-addressed cache for command line processing. The key for an output file is made from a hash of
+// the input file contents and a hash of everything that affects the result (operations, load parameters, and save
+// parameters). On a hit the previously generated output is copied instead of loading, processing, and saving the
+// input image again. A small index in the cache directory maps file stats to content hashes so unchanged inputs do
+// not need to be re-read and up-to-date outputs do not need to be re-copied.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+#include <Foundation/tHash.h>
+#include <System/tFile.h>
+
+
+namespace Command
+{
+namespace Cache
+{
+	// Opens (creating if necessary) the cache in the supplied directory and reads its index. Returns success.
+	bool Open(const tString& cacheDir);
+	void Close();
+	bool IsOpen();
+
+	// Returns the key for the output of the supplied input file. The settingsHash must include everything other than
+	// the input file contents that affects the output, including the output type. If the input can't be read an invalid
+	// key is returned and the functions below treat it as never cached. All functions below are thread-safe.
+	tuint256 GetKey(const tString& inFile, const tuint256& settingsHash);
+
+	// Returns true if there is a cached output for the key.
+	bool Contains(const tuint256& key, tSystem::tFileType outType);
+
+	// Returns true if outFile is known to be the output for the key and has not changed since it was written.
+	bool IsCurrent(const tString& outFile, const tuint256& key);
+
+	// Copies the cached output for the key to outFile. Returns success.
+	bool Restore(const tString& outFile, const tuint256& key, tSystem::tFileType outType);
+
+	// Adds a freshly saved output file to the cache.
+	bool Store(const tString& outFile, const tuint256& key, tSystem::tFileType outType);
+}
+}
@@ -877,6 +877,15 @@ e.g. @list.txt will load files from a manifest file called list.txt. Each line
 of a manifest file should be the name of a file to process, the name of a dir
 to process, start with a line-comment semicolon, or simply be empty.
 
+Use @- to read the manifest from stdin. If the manifest contains a null
+character before its first newline it is taken to be null-delimited, like the
+output of find -print0, and each entry is an exact file or dir name with no
+comments. Manifests are read as they are processed, so very large ones are not
+held in memory and, with the pipeline enabled (the default), the first images
+are processed while the rest of the list is still being read. In that case the
+full input file list is not printed up front. Repeated inputs are only
+processed once.
+
 You may specify what types of input images to process. If you do not specify
 any types, ALL supported imgage types are processed. A type like 'tif' may have
 more than one accepted extension (tif and tiff). The extension is not
@@ -1408,6 +1417,11 @@ included in the inputs, the new file is not used by the post operation.
   format supports it. When there are fewer input images than cols*rows, empty
   pages are needed. These empty pages are filled with a specified fill colour.
   Pages start at the top-left, one line at a time, from left to right.
+  The sheet is built one row of pages at a time. The pages of a row are loaded
+  in parallel and each source is unloaded as soon as it is placed. For tga
+  output with an explicit bpp (for example --outTGA bpp=24) and for bmp output
+  with bpp=24, the sheet is written one row of pages at a time and never held
+  in memory as a whole. Other output types need the whole sheet in memory.
   cols: Specify the number of columns you want in the contact sheet. This value
         should be bigger or equal to 0*. When set to 0 (the default) it will
         be computed for you based on the number of rows entered so that all
@@ -1574,6 +1588,131 @@ with save parameters:
 	);
 	tPrintf
 	(
+R"PERFORMANCE010(
+PERFORMANCE
+-----------
+Images are processed in a pipeline of three stages: load, process, and save.
+While one image is having its operations applied, the next one is being loaded
+and the previous one is being saved. The stages are connected by queues. Use
+--queue N (-q N) to set how many images may wait in each queue. The default is
+1. A larger queue smooths out uneven load and save times at the cost of memory.
+A queue depth of 0 turns the pipeline off so each image is loaded, processed,
+and saved before the next is started. --jobs is ignored in that case.
+
+Each stage runs more than one image at the same time. Use --jobs N (-j N) to
+set the number of jobs per stage. The default, like a value of 0 or *, is one
+job per CPU core. Use -j 1 for one image per stage. The most images in memory
+at once is 3*jobs + 2*queue, so memory use grows with both. Console output is
+still printed in input order. If two input images would be saved to the same
+output file, only one job writes it at a time. With --autoname each gets a
+distinct name, although which input gets which name is not guaranteed when
+jobs > 1. With --earlyexit, no new images are started after the first failure
+but images already in a stage are allowed to finish it.
+
+Very large inputs, like 16k EXRs or long animations, can use a lot of memory
+when several are in flight at once. Use --maxmem size to set a budget for
+loaded images. The size is in MB unless it ends in K, M, or G, so 512, 512M,
+and 0.5G are the same. Without --maxmem the budget is half the physical memory.
+Use --maxmem 0 for no limit. Before an image is loaded, its decoded size is
+estimated from its header without decoding it. It is only loaded once the
+estimate fits in what is left of the budget. Images are admitted in input
+order. An image bigger than the whole budget waits until nothing else is in
+flight and is then processed alone. Operations that grow an image, like resize,
+are not part of the estimate. The budget only matters when images overlap, so
+it has no effect with -q 0.
+
+When the first operation is a resize to a much smaller size, use --loadreduce
+for an approximate but faster resize. Each image is still fully decoded, so
+decode time and peak memory are the same as without it. Straight after the
+decode, mipmapped DDS, KTX, and PVR files switch to the smallest mipmap that is
+still at least the target size. Other images are box filtered down by a power
+of two, again staying at least the target size. The resize operation then
+resamples from the smaller image, which is much faster, and the smaller image
+is what waits in the pipeline. When resize computes one dimension from the
+aspect ratio, an image is only reduced by factors that keep its aspect ratio
+exact, so the output size is always the same as without --loadreduce. The
+output pixels are not the same as a plain resize and may differ slightly.
+
+When the first operation is a crop, uncompressed 24-bit TGA and BMP inputs
+only read the rows and columns inside the crop rectangle. A small region can
+be cut from a very large image quickly and without loading all of it. Other
+file types are fully decoded and then cropped. The output is the same either
+way.
+
+Very large uncompressed 24-bit TGA and BMP inputs can be processed a band of
+rows at a time so they are never fully loaded. This happens when every
+operation allows it and every output type can be written a band at a time.
+The operations allowed are a crop (only as the first operation), flip, and
+the point-wise levels, contrast, brightness, channel, and swizzle. Any resize
+turns banding off. The outputs must be tga with bpp=24 or bpp=32, or bmp with
+bpp=24. Use --bandmem size to set the memory used for bands. It takes the
+same sizes as --maxmem and defaults to 64M. Images that would take more than
+16 times that, or more than the --maxmem budget, when loaded are banded. Peak
+memory then depends on the band memory rather than the image size. Bands are
+processed in parallel. Banding is not used with --skipunchanged.
+
+When more than one output type is specified, the encodes for an image run at
+the same time since they all read the same processed image. The time to save
+an image approaches that of the slowest encoder rather than the sum of them.
+With --earlyexit, a failed save does not stop the other types for the same
+image from being saved.
+
+For repeated runs over mostly unchanged inputs use --cache dir. Each output is
+keyed by a hash of the input file contents, the operations, the load parameters
+and the save parameters. If every output for an input image is in the cache,
+the cached files are copied and the image is not loaded at all. If the output
+file already exists and is what would be written, it is left untouched and
+reported as up to date, even without --overwrite. Misses are added to the
+cache after saving. An index in the cache directory records the content hashes
+of inputs by name, size, and modification time so unchanged inputs are not
+re-read. The cache is disabled if an operation writes its own files (extract).
+Delete the directory to clear the cache.
+
+For very long batches use --journal file to record each input as it completes,
+along with its output files and a hash of the settings. Records are appended
+and flushed as they are written. If the batch is stopped or killed, run the
+same command again with --resume added. Inputs the journal says were completed
+with the same settings are skipped without being loaded and without their
+outputs being checked, so a restart costs almost nothing. Changing the
+operations, load or save parameters, output types, or output naming starts
+over. A record cut off by a crash is ignored and that input is redone.
+
+Use --timing (-t) to print a timing report when processing finishes. Each image
+is timed separately for load (read and decode), each operation, and each save
+(encode and write) by output type. Post operations are also timed. The report
+lists files/s, megapixels/s, peak memory, and the count, total, median (p50),
+p95, and maximum time for every stage. Use --metrics-out file.json to also
+write the report along with every individual timing to a JSON file. Timing
+adds very little overhead but is off by default.
+
+For many small jobs, process startup can dominate. Use --serve - to keep one
+process running and read jobs from stdin, one JSON object per line. On Linux,
+--serve path listens on a Unix domain socket at path instead. Each request has
+the form {"id":1,"args":["-o","png","--op","resize[640,*]","in.tga"]} where
+args are exactly what would follow --cli on the command line. Every job starts
+from default settings. The reply is one line of JSON with the same id, the
+exit status of the job, its timing metrics, and its console output:
+{"id":1,"status":0,"metrics":{...},"log":"..."}. Send {"quit":true} to stop.
+Jobs served on stdin can not use an @- manifest.
+
+To plan a batch, use --probe csv (or --probe json) to list the inputs without
+loading them. Only the file headers are read so this is fast even for very
+large images. Each file gets one line with its type, whether the header could
+be read, width, height, frame count, mipmap count, pixel format (if the header
+says), and size in bytes. The headers are read in parallel but the output is in
+input order. Nothing is processed or saved. The viewer uses the same header
+reads so that sorting by width, height, or area does not have to wait for
+thumbnails.
+
+With --probecolours each input is also fully loaded and a colours field is
+added with the number of unique RGB colours over all frames. This is much
+slower than a plain probe. It shows which images already fit in a palette.
+The same count is used by quantize operations with checkExact, where it stops
+as soon as there are more colours than requested.
+)PERFORMANCE010"
+	);
+	tPrintf
+	(
 R"EXITCODE010(
 EXIT CODE
 ---------
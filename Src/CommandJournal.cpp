@@ -0,0 +1,224 @@
+// CommandJournal.cpp
+//
+// An append-only journal of completed inputs for long command line batches. Each record holds the input file, the
+// output files written for it, and a hash of the job settings. With --resume the journal is replayed and inputs that
+// were already completed by a job with the same settings are skipped without loading them or checking their outputs.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef PLATFORM_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <System/tFile.h>
+#include <System/tPrint.h>
+#include "CommandJournal.h"
+#include "Command.h"
+
+
+namespace Command
+{
+namespace Journal
+{
+	// The journal is a text file with one record per line. Fields are separated by tabs. Tabs, newlines, and
+	// backslashes in filenames are escaped.
+	// D <settings-hash> <input-file> [<output-file> ...]
+	// A line without its terminating newline was cut off by a crash and is ignored.
+	std::string Escape(const tString&);
+	std::string Unescape(const std::string&);
+	void ReadRecords(std::FILE*);
+	void Sync(std::FILE*);
+
+	std::mutex Mutex;
+	tSystem::tFileHandle JournalFile = nullptr;
+	std::string SettingsHash;
+	std::unordered_set<std::string> DoneInputs;
+}
+}
+
+
+std::string Command::Journal::Escape(const tString& str)
+{
+	std::string escaped;
+	for (const char* c = str.Chr(); *c; c++)
+	{
+		switch (*c)
+		{
+			case '\\':	escaped += "\\\\";	break;
+			case '\t':	escaped += "\\t";	break;
+			case '\n':	escaped += "\\n";	break;
+			default:	escaped += *c;		break;
+		}
+	}
+	return escaped;
+}
+
+
+std::string Command::Journal::Unescape(const std::string& str)
+{
+	std::string unescaped;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if ((str[i] != '\\') || (i+1 >= str.size()))
+		{
+			unescaped += str[i];
+			continue;
+		}
+
+		i++;
+		switch (str[i])
+		{
+			case 't':	unescaped += '\t';		break;
+			case 'n':	unescaped += '\n';		break;
+			default:	unescaped += str[i];	break;
+		}
+	}
+	return unescaped;
+}
+
+
+void Command::Journal::ReadRecords(std::FILE* file)
+{
+	// Read a line at a time. Journals for big batches have millions of records so they are not loaded in full.
+	std::string prefix = std::string("D\t") + SettingsHash + "\t";
+	std::string line;
+	for (int c = std::getc(file); c != EOF; c = std::getc(file))
+	{
+		if (c != '\n')
+		{
+			line += char(c);
+			continue;
+		}
+
+		if (line.compare(0, prefix.size(), prefix) == 0)
+		{
+			size_t end = line.find('\t', prefix.size());
+			DoneInputs.insert(Unescape(line.substr(prefix.size(), end - prefix.size())));
+		}
+		line.clear();
+	}
+}
+
+
+void Command::Journal::Sync(std::FILE* file)
+{
+	// Flushing only hands the record to the OS, where a power loss could still drop it. The file is also synced so a
+	// completed input is never lost from the journal and redone on resume.
+	std::fflush(file);
+	#ifdef PLATFORM_WINDOWS
+	_commit(_fileno(file));
+	#else
+	fsync(fileno(file));
+	#endif
+}
+
+
+bool Command::Journal::Open(const tString& journalFile, const tuint256& settingsHash, bool resume)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (JournalFile)
+		return true;
+
+	tString hashStr;
+	tsPrintf(hashStr, "%064|256X", settingsHash);
+	SettingsHash = hashStr.Chr();
+	DoneInputs.clear();
+
+	if (resume && tSystem::tFileExists(journalFile))
+	{
+		tSystem::tFileHandle file = tSystem::tOpenFile(journalFile.Chr(), "rb");
+		if (file)
+		{
+			ReadRecords(file);
+			tSystem::tCloseFile(file);
+		}
+	}
+
+	// A run that crashed may have left a partial last line. It is terminated so the first new record starts on a line
+	// of its own. The partial record is ignored when read back.
+	bool partialLine = false;
+	if (tSystem::tFileExists(journalFile))
+	{
+		tSystem::tFileHandle file = tSystem::tOpenFile(journalFile.Chr(), "rb");
+		if (file)
+		{
+			char last = '\n';
+			if ((tSystem::tFileSeek(file, -1, tSystem::tSeekOrigin::End) == 0) && (tSystem::tReadFile(file, &last, 1) == 1))
+				partialLine = (last != '\n');
+			tSystem::tCloseFile(file);
+		}
+	}
+
+	JournalFile = tSystem::tOpenFile(journalFile.Chr(), "ab");
+	if (!JournalFile)
+	{
+		tPrintfNorm("Warning: Could not open journal %s\n", journalFile.Chr());
+		DoneInputs.clear();
+		return false;
+	}
+
+	if (partialLine)
+	{
+		tSystem::tWriteFile(JournalFile, "\n", 1);
+		Sync(JournalFile);
+	}
+
+	tPrintfFull("Journal: %s Done:%d\n", journalFile.Chr(), int(DoneInputs.size()));
+	return true;
+}
+
+
+void Command::Journal::Close()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (!JournalFile)
+		return;
+
+	tSystem::tCloseFile(JournalFile);
+	JournalFile = nullptr;
+	DoneInputs.clear();
+}
+
+
+bool Command::Journal::IsOpen()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return JournalFile != nullptr;
+}
+
+
+bool Command::Journal::IsDone(const tString& inFile)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return DoneInputs.find(std::string(inFile.Chr())) != DoneInputs.end();
+}
+
+
+void Command::Journal::RecordDone(const tString& inFile, const std::vector<tString>& outFiles)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (!JournalFile)
+		return;
+
+	std::string record = std::string("D\t") + SettingsHash + "\t" + Escape(inFile);
+	for (const tString& outFile : outFiles)
+		record += "\t" + Escape(outFile);
+	record += "\n";
+
+	// A single write per record keeps records from different threads from interleaving.
+	tSystem::tWriteFile(JournalFile, record.c_str(), int(record.size()));
+	Sync(JournalFile);
+}
@@ -0,0 +1,41 @@
+// CommandJournal.h
+//
+// An append-only journal of completed inputs for long command line batches. Each record holds the input file, the
+// output files written for it, and a hash of the job settings. With --resume the journal is replayed and inputs that
+// were already completed by a job with the same settings are skipped without loading them or checking their outputs.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Foundation/tString.h>
+#include <Foundation/tHash.h>
+
+
+namespace Command
+{
+namespace Journal
+{
+	// Opens (creating if necessary) the journal file for appending. If resume is true the existing records are read
+	// first and those with a matching settingsHash mark their inputs as done. Returns success.
+	bool Open(const tString& journalFile, const tuint256& settingsHash, bool resume);
+	void Close();
+	bool IsOpen();
+
+	// All functions below are thread-safe. IsDone is a lookup only. It does not touch the file system.
+	bool IsDone(const tString& inFile);
+
+	// Appends a record for a completed input. The record is flushed and synced to disk right away so it survives the
+	// process being killed or the machine losing power. An input with no outputs (for example, skipped as unchanged) is
+	// still recorded.
+	void RecordDone(const tString& inFile, const std::vector<tString>& outFiles);
+}
+}
@@ -0,0 +1,298 @@
+// CommandMetrics.cpp
+//
+// Optional timing and throughput metrics for command line processing. Each stage of each image (load, every
+// operation, every save, post-operations) is timed. At the end of the run aggregate statistics are printed and may
+// also be written to a JSON file.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <Foundation/tFundamentals.h>
+#include <System/tFile.h>
+#include <System/tPrint.h>
+#include "CommandMetrics.h"
+#include "Command.h"
+
+
+namespace Command
+{
+namespace Metrics
+{
+	struct Sample
+	{
+		std::string File;
+		std::string Stage;
+		double Seconds;
+	};
+
+	struct StageStats
+	{
+		int Count			= 0;
+		double Total		= 0.0;
+		double P50			= 0.0;
+		double P95			= 0.0;
+		double Max			= 0.0;
+	};
+	void ComputeStats(std::map<std::string, StageStats>&);
+	tString BuildJSON(bool withSamples, bool singleLine);
+
+	std::atomic<bool> Enabled(false);					// Read by worker threads through IsEnabled and ScopedTimer.
+	std::mutex Mutex;
+	std::vector<Sample> Samples;
+	int NumImages = 0;
+	int64 NumPixels = 0;
+	std::chrono::steady_clock::time_point StartTime;
+}
+}
+
+
+void Command::Metrics::Begin()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Enabled = true;
+	Samples.clear();
+	NumImages = 0;
+	NumPixels = 0;
+	StartTime = std::chrono::steady_clock::now();
+}
+
+
+bool Command::Metrics::IsEnabled()
+{
+	return Enabled;
+}
+
+
+void Command::Metrics::Record(const tString& file, const tString& stage, double seconds)
+{
+	if (!Enabled)
+		return;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	Samples.push_back({ std::string(file.Chr()), std::string(stage.Chr()), seconds });
+}
+
+
+void Command::Metrics::RecordImage(int64 numPixels)
+{
+	if (!Enabled)
+		return;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	NumImages++;
+	NumPixels += numPixels;
+}
+
+
+int64 Command::Metrics::GetPeakMemory()
+{
+	#ifdef PLATFORM_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return int64(counters.PeakWorkingSetSize);
+	return 0;
+	#else
+	// On Linux ru_maxrss is in kilobytes.
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return int64(usage.ru_maxrss) * 1024;
+	return 0;
+	#endif
+}
+
+
+void Command::Metrics::ComputeStats(std::map<std::string, StageStats>& stats)
+{
+	// Mutex must be held by caller.
+	std::map<std::string, std::vector<double>> durations;
+	for (const Sample& sample : Samples)
+		durations[sample.Stage].push_back(sample.Seconds);
+
+	for (auto& stage : durations)
+	{
+		std::vector<double>& d = stage.second;
+		std::sort(d.begin(), d.end());
+		StageStats& s = stats[stage.first];
+		s.Count = int(d.size());
+		for (double v : d)
+			s.Total += v;
+
+		// Nearest-rank percentiles.
+		auto rank = [&d](double pct) { return d[ tMath::tClamp(int(pct * d.size() + 0.999999) - 1, 0, int(d.size())-1) ]; };
+		s.P50 = rank(0.50);
+		s.P95 = rank(0.95);
+		s.Max = d.back();
+	}
+}
+
+
+tString Command::Metrics::BuildJSON(bool withSamples, bool singleLine)
+{
+	// Mutex must be held by caller.
+	const char* nl = singleLine ? "" : "\n";
+	const char* in1 = singleLine ? "" : "  ";
+	const char* in2 = singleLine ? "" : "    ";
+	const char* sp = singleLine ? "" : " ";
+
+	double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+	double megaPixels = double(NumPixels) / 1000000.0;
+	std::map<std::string, StageStats> stats;
+	ComputeStats(stats);
+
+	tString json;
+	tString str;
+	tsPrintf(str, "{%s", nl);
+	json += str;
+	tsPrintf(str, "%s\"wall_seconds\":%s%.6f,%s", in1, sp, wallTime, nl);
+	json += str;
+	tsPrintf(str, "%s\"images\":%s%d,%s", in1, sp, NumImages, nl);
+	json += str;
+	tsPrintf(str, "%s\"files_per_second\":%s%.6f,%s", in1, sp, (wallTime > 0.0) ? NumImages/wallTime : 0.0, nl);
+	json += str;
+	tsPrintf(str, "%s\"megapixels\":%s%.6f,%s", in1, sp, megaPixels, nl);
+	json += str;
+	tsPrintf(str, "%s\"megapixels_per_second\":%s%.6f,%s", in1, sp, (wallTime > 0.0) ? megaPixels/wallTime : 0.0, nl);
+	json += str;
+	tsPrintf(str, "%s\"peak_rss_bytes\":%s%|64d,%s", in1, sp, GetPeakMemory(), nl);
+	json += str;
+
+	tsPrintf(str, "%s\"stages\":%s{", in1, sp);
+	json += str;
+	bool first = true;
+	for (auto& stage : stats)
+	{
+		const StageStats& s = stage.second;
+		tsPrintf
+		(
+			str, "%s%s%s\"%s\":%s{%s\"count\":%s%d,%s\"total_seconds\":%s%.6f,%s\"p50_seconds\":%s%.6f,%s\"p95_seconds\":%s%.6f,%s\"max_seconds\":%s%.6f%s}",
+			first ? "" : ",", nl, in2, EscapeJSON(stage.first.c_str()).Chr(), sp, sp, sp, s.Count, sp, sp, s.Total, sp, sp, s.P50, sp, sp, s.P95, sp, sp, s.Max, sp
+		);
+		json += str;
+		first = false;
+	}
+	tsPrintf(str, "%s%s}", nl, in1);
+	json += str;
+
+	if (withSamples)
+	{
+		// Samples are in the order the stages completed.
+		tsPrintf(str, ",%s%s\"samples\":%s[", nl, in1, sp);
+		json += str;
+		first = true;
+		for (const Sample& sample : Samples)
+		{
+			tsPrintf
+			(
+				str, "%s%s%s{%s\"file\":%s\"%s\",%s\"stage\":%s\"%s\",%s\"seconds\":%s%.6f%s}",
+				first ? "" : ",", nl, in2, sp, sp, EscapeJSON(sample.File.c_str()).Chr(), sp, sp, EscapeJSON(sample.Stage.c_str()).Chr(), sp, sp, sample.Seconds, sp
+			);
+			json += str;
+			first = false;
+		}
+		tsPrintf(str, "%s%s]", nl, in1);
+		json += str;
+	}
+
+	tsPrintf(str, "%s}%s", nl, nl);
+	json += str;
+	return json;
+}
+
+
+tString Command::Metrics::GetJSON(bool withSamples, bool singleLine)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (!Enabled)
+		return tString("{}");
+
+	return BuildJSON(withSamples, singleLine);
+}
+
+
+bool Command::Metrics::End(const tString& jsonFile, bool printReport)
+{
+	if (!Enabled)
+		return true;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	Enabled = false;
+	if (printReport)
+	{
+		double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+		double filesPerSec = (wallTime > 0.0) ? double(NumImages) / wallTime : 0.0;
+		double megaPixels = double(NumPixels) / 1000000.0;
+		double megaPixelsPerSec = (wallTime > 0.0) ? megaPixels / wallTime : 0.0;
+		double peakMemMB = double(GetPeakMemory()) / (1024.0*1024.0);
+
+		std::map<std::string, StageStats> stats;
+		ComputeStats(stats);
+
+		tPrintfNorm("\nTiming\n------\n");
+		tPrintfNorm("Wall Time:  %.3f s\n", wallTime);
+		tPrintfNorm("Images:     %d (%.2f files/s)\n", NumImages, filesPerSec);
+		tPrintfNorm("Pixels:     %.2f MP (%.2f MP/s)\n", megaPixels, megaPixelsPerSec);
+		tPrintfNorm("Peak RSS:   %.1f MB\n", peakMemMB);
+		tPrintfNorm("%-20s %8s %10s %10s %10s %10s\n", "Stage", "Count", "Total(s)", "P50(ms)", "P95(ms)", "Max(ms)");
+		for (auto& stage : stats)
+		{
+			const StageStats& s = stage.second;
+			tPrintfNorm("%-20s %8d %10.3f %10.2f %10.2f %10.2f\n", stage.first.c_str(), s.Count, s.Total, s.P50*1000.0, s.P95*1000.0, s.Max*1000.0);
+		}
+	}
+
+	if (jsonFile.IsEmpty())
+		return true;
+
+	tSystem::tFileHandle file = tSystem::tOpenFile(jsonFile.Chr(), "wb");
+	if (!file)
+	{
+		tPrintfNorm("Warning: Could not write metrics file %s\n", jsonFile.Chr());
+		return false;
+	}
+
+	tString json = BuildJSON(true, false);
+	tfPrintf(file, "%s", json.Chr());
+	tSystem::tCloseFile(file);
+	return true;
+}
+
+
+Command::Metrics::ScopedTimer::ScopedTimer(const tString& file, const tString& stage) :
+	Enabled(Metrics::IsEnabled())
+{
+	if (!Enabled)
+		return;
+
+	File = file;
+	Stage = stage;
+	Start = std::chrono::steady_clock::now();
+}
+
+
+Command::Metrics::ScopedTimer::~ScopedTimer()
+{
+	if (!Enabled)
+		return;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	Record(File, Stage, seconds);
+}
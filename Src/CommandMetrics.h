@@ -0,0 +1,59 @@
+// CommandMetrics.h
+//
+// Optional timing and throughput metrics for command line processing. Each stage of each image (load, every
+// operation, every save, post-operations) is timed. At the end of the run aggregate statistics are printed and may
+// also be written to a JSON file.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <chrono>
+#include <Foundation/tString.h>
+
+
+namespace Command
+{
+namespace Metrics
+{
+	// Metrics are off by default. When off, all the functions below return immediately.
+	void Begin();
+	bool IsEnabled();
+
+	// Records the time taken for a stage of an image. Stage names are things like "load", "op:resize", or
+	// "save:png". For post-operations the file is empty. Thread-safe.
+	void Record(const tString& file, const tString& stage, double seconds);
+
+	// Records that an image was completed with the supplied number of pixels (all frames). Thread-safe.
+	void RecordImage(int64 numPixels);
+
+	// Returns the peak resident memory of the process in bytes, or 0 if unknown.
+	int64 GetPeakMemory();
+
+	// Returns the aggregate stats so far as a JSON object, optionally with every individual timing.
+	tString GetJSON(bool withSamples, bool singleLine);
+
+	// Stops collecting. Prints the aggregate stats if printReport is true and, if jsonFile is not empty, writes
+	// per-image timings and the aggregate stats to it. Returns false if the JSON file could not be written.
+	bool End(const tString& jsonFile, bool printReport = true);
+
+	// Times the scope it is in. Does nothing if metrics are not enabled.
+	struct ScopedTimer
+	{
+		ScopedTimer(const tString& file, const tString& stage);
+		~ScopedTimer();
+
+		bool Enabled;
+		tString File;
+		tString Stage;
+		std::chrono::steady_clock::time_point Start;
+	};
+}
+}
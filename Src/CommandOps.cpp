@@ -16,6 +16,8 @@
 // AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
+#include <vector>
+#include <memory>
 #include <System/tTime.h>
 #include <Image/tImageGIF.h>
 #include <Image/tImageWEBP.h>
@@ -23,8 +25,11 @@
 #include <Image/tImageTIFF.h>
 #include "CommandOps.h"
 #include "Command.h"
+#include "CommandBands.h"
+#include "ImageStrip.h"
 #include "MultiFrame.h"
 #include "OpenSaveDialogs.h"
+#include "Parallel.h"
 #include "TacentView.h"
 
 
@@ -1606,8 +1611,10 @@ bool Command::OperationExtract::Apply(Viewer::Image& image)
 
 	tString destDir = tSystem::tGetDir(image.Filename) + subDir;
 	bool dirExists = tSystem::tDirExists(destDir);
+
+	// When running multiple jobs another job may create the directory between the exists check and the create.
 	if (!dirExists)
-		dirExists = tSystem::tCreateDir(destDir);
+		dirExists = tSystem::tCreateDir(destDir) || tSystem::tDirExists(destDir);
 	if (!dirExists)
 		return false;
 
@@ -1615,17 +1622,22 @@ bool Command::OperationExtract::Apply(Viewer::Image& image)
 	if (baseName.IsEmpty())
 		baseName = tSystem::tGetFileBaseName(image.Filename);
 
-	// Iterate through the output types saving as we go.
+	// Iterate through the output types saving as we go. For each type the frames to save are determined first, in
+	// order, and then encoded at the same time. Printing is done here so the output does not depend on the threads.
 	for (tSystem::tFileTypes::tFileTypeItem* typeItem = Command::OutTypes.First(); typeItem; typeItem = typeItem->Next())
 	{
 		tSystem::tFileType outType = typeItem->FileType;
 		Command::SetImageSaveParameters(image, outType);
+
+		std::vector<int> frameNums;
+		std::vector<tString> outFiles;
 		for (int frameNum = 0; frameNum < image.GetNumFrames(); frameNum++)
 		{
 			if (!FrameSet.Contains(frameNum))
 				continue;
 
-			// This sets the current frame so that when the image is saved, this frame is used.
+			// The current frame is left at the last extracted frame, as it always has been, since later single-frame
+			// saves use it.
 			image.FrameNum = frameNum;
 
 			tString outFile = Viewer::GetFrameFilename(frameNum, destDir, baseName, outType);
@@ -1636,18 +1648,434 @@ bool Command::OperationExtract::Apply(Viewer::Image& image)
 				continue;
 			}
 
-			bool useConfigSaveParams = false;
-			bool onlyCurrentPic = true;
-
 			tPrintfFull("Extract | Save[file:%s%s]\n", subDir.Chr(), outFileShort.Chr());
-			image.Save(outFile, outType, useConfigSaveParams, onlyCurrentPic);
+			frameNums.push_back(frameNum);
+			outFiles.push_back(outFile);
 		}
+
+		// Save is const and is told which frame to use so it is safe to call from multiple threads. At most one frame
+		// per thread is being encoded at any time.
+		bool useConfigSaveParams = false;
+		bool onlyCurrentPic = true;
+		Viewer::Parallel::For
+		(
+			int(frameNums.size()),
+			[&](int f) { image.Save(outFiles[f], outType, useConfigSaveParams, onlyCurrentPic, frameNums[f]); }
+		);
 	}
 
 	return true;
 }
 
 
+// The ApplyToPicture functions follow. They must do exactly what Apply does, but to a single picture. This includes
+// the early-outs so that a fused run matches the unfused one.
+
+
+void Command::OperationLevels::ApplyToPicture(tImage::tPicture& picture) const
+{
+	if ((BlackPoint == 0.0f) && (MidPoint == 0.5f) && (WhitePoint == 1.0) && (OutBlackPoint == 0.0f) && (OutWhitePoint == 1.0f))
+		return;
+
+	picture.AdjustmentBegin();
+	picture.AdjustLevels(BlackPoint, MidPoint, WhitePoint, OutBlackPoint, OutWhitePoint, PowerMidGamma, Viewer::Image::ComponentBits(Channels));
+	picture.AdjustmentEnd();
+}
+
+
+void Command::OperationContrast::ApplyToPicture(tImage::tPicture& picture) const
+{
+	if (Contrast == 0.5f)
+		return;
+
+	picture.AdjustmentBegin();
+	picture.AdjustContrast(Contrast, Viewer::Image::ComponentBits(Channels));
+	picture.AdjustmentEnd();
+}
+
+
+void Command::OperationBrightness::ApplyToPicture(tImage::tPicture& picture) const
+{
+	if (Brightness == 0.5f)
+		return;
+
+	picture.AdjustmentBegin();
+	picture.AdjustBrightness(Brightness, Viewer::Image::ComponentBits(Channels));
+	picture.AdjustmentEnd();
+}
+
+
+void Command::OperationChannel::ApplyToPicture(tImage::tPicture& picture) const
+{
+	switch (Mode)
+	{
+		case ChanMode::Set:
+			picture.SetAll(Colour, Channels);
+			break;
+
+		case ChanMode::Blend:
+			picture.AlphaBlendColour(Colour, Channels, (Channels & tCompBit_A) ? Colour.A : -1);
+			break;
+
+		case ChanMode::Spread:
+		{
+			tComp channel = tComp(tMath::tFindFirstSetBit(Channels));
+			if (tIsColourComponent(channel))
+				picture.Spread(channel);
+			break;
+		}
+
+		case ChanMode::Intensity:
+			picture.Intensity(Channels);
+			break;
+	}
+}
+
+
+void Command::OperationSwizzle::ApplyToPicture(tImage::tPicture& picture) const
+{
+	if (tIsMatrixComponent(SwizzleR) || tIsMatrixComponent(SwizzleG) || tIsMatrixComponent(SwizzleB) || tIsMatrixComponent(SwizzleA))
+		return;
+
+	picture.Swizzle(SwizzleR, SwizzleG, SwizzleB, SwizzleA);
+}
+
+
+// The canonical strings follow. Floats are written as their bit patterns so that different textual representations
+// of the same value compare equal and values that print the same but differ do not.
+
+
+namespace Command
+{
+	uint32 GetBits(float value)															{ uint32 bits; tStd::tMemcpy(&bits, &value, sizeof(bits)); return bits; }
+	uint64 GetBits(double value)														{ uint64 bits; tStd::tMemcpy(&bits, &value, sizeof(bits)); return bits; }
+}
+
+
+tString Command::OperationPixel::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "pixel[%d,%d,%08X,%X]", X, Y, PixelColour.BP, Channels);
+	return canon;
+}
+
+
+tString Command::OperationResize::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "resize[%d,%d,%d,%d]", Width, Height, int(ResampleFilter), int(EdgeMode));
+	return canon;
+}
+
+
+tString Command::OperationCanvas::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "canvas[%d,%d,%d,%08X,%d,%d]", Width, Height, int(Anchor), FillColour.BP, AnchorX, AnchorY);
+	return canon;
+}
+
+
+tString Command::OperationAspect::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "aspect[%d,%d,%d,%d,%08X,%d,%d]", Num, Den, int(Mode), int(Anchor), FillColour.BP, AnchorX, AnchorY);
+	return canon;
+}
+
+
+tString Command::OperationDeborder::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "deborder[%d,%08X,%X]", UseTestColour ? 1 : 0, TestColour.BP, Channels);
+	return canon;
+}
+
+
+tString Command::OperationCrop::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "crop[%d,%d,%d,%d,%d,%08X]", int(Mode), OriginX, OriginY, WidthOrMaxX, HeightOrMaxY, FillColour.BP);
+	return canon;
+}
+
+
+tString Command::OperationFlip::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "flip[%d]", int(Mode));
+	return canon;
+}
+
+
+tString Command::OperationRotate::GetCanonical() const
+{
+	tString canon;
+	tsPrintf
+	(
+		canon, "rotate[%08X,%d,%d,%d,%d,%08X]",
+		GetBits(Angle), int(Exact), int(Mode), int(FilterUp), int(FilterDown), FillColour.BP
+	);
+	return canon;
+}
+
+
+tString Command::OperationLevels::GetCanonical() const
+{
+	tString canon;
+	tsPrintf
+	(
+		canon, "levels[%08X,%08X,%08X,%08X,%08X,%d,%d,%d]",
+		GetBits(BlackPoint), GetBits(MidPoint), GetBits(WhitePoint), GetBits(OutBlackPoint), GetBits(OutWhitePoint),
+		FrameNumber, int(Channels), PowerMidGamma ? 1 : 0
+	);
+	return canon;
+}
+
+
+tString Command::OperationContrast::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "contrast[%08X,%d,%d]", GetBits(Contrast), FrameNumber, int(Channels));
+	return canon;
+}
+
+
+tString Command::OperationBrightness::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "brightness[%08X,%d,%d]", GetBits(Brightness), FrameNumber, int(Channels));
+	return canon;
+}
+
+
+tString Command::OperationQuantize::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "quantize[%d,%d,%d,%d,%016|64X]", int(Method), NumColours, CheckExact ? 1 : 0, SampFilt, GetBits(Dither));
+	return canon;
+}
+
+
+tString Command::OperationChannel::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "channel[%d,%X,%08X]", int(Mode), Channels, Colour.BP);
+	return canon;
+}
+
+
+tString Command::OperationSwizzle::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "swizzle[%d,%d,%d,%d]", int(SwizzleR), int(SwizzleG), int(SwizzleB), int(SwizzleA));
+	return canon;
+}
+
+
+tString Command::OperationExtract::GetCanonical() const
+{
+	tString canon;
+	tsPrintf(canon, "extract[%s,%s,%s]", FrameSet.Get().Chr(), SubFolder.Chr(), BaseName.Chr());
+	return canon;
+}
+
+
+Command::OperationFused::OperationFused(tList<Operation>& run)
+{
+	for (int c = 0; c < 4; c++)
+		for (int v = 0; v < 256; v++)
+			Lut[c][v] = uint8(v);
+
+	// Compose each operation onto the current mapping. If the current mapping is out[c] = Lut[c][in[Source[c]]] and
+	// the next operation is out'[c] = lut[c][out[source[c]]], the combined mapping reads from Source[source[c]]
+	// through Lut[source[c]] and then lut[c].
+	while (Operation* operation = run.Remove())
+	{
+		uint8 lut[4][256];
+		int source[4];
+		bool probed = Probe(*operation, lut, source);
+		tAssert(probed);
+		if (!IsIdentity(lut, source))
+			AnyNonIdentity = true;
+
+		uint8 newLut[4][256];
+		int newSource[4];
+		for (int c = 0; c < 4; c++)
+		{
+			newSource[c] = Source[source[c]];
+			for (int v = 0; v < 256; v++)
+				newLut[c][v] = lut[c][ Lut[source[c]][v] ];
+		}
+		tStd::tMemcpy(Lut, newLut, sizeof(Lut));
+		tStd::tMemcpy(Source, newSource, sizeof(Source));
+		Run.Append(operation);
+	}
+
+	Valid = true;
+}
+
+
+bool Command::OperationFused::Probe(const Operation& operation, uint8 lut[4][256], int source[4])
+{
+	// Each probe is a 256x1 picture. Channel k of pixel i holds Perm(i) where Perm is a different bijection on
+	// [0,255] for each channel and each probe. The first probe is used to build a candidate table for every
+	// (destination, source) channel pair. Since Perm is a bijection every table entry is set exactly once. The other
+	// probes verify the candidates. Some of them only use part of the range so that operations that depend on image
+	// statistics (like the auto-range used by brightness) fail verification and are not fused.
+	struct ProbeDef { int Mul[4]; int Add[4]; int Base; int Range; };
+	const ProbeDef probes[] =
+	{
+		{ {   1, 167,  89, 233 }, {   0,  13, 101,  57 },   0, 256 },
+		{ {  75,   1, 141,  27 }, {  31, 200,   7, 150 },   0, 256 },
+		{ { 211,  45,   1, 119 }, {   3,  77, 190,  11 },  32, 128 },
+		{ {  13, 251,  61,   1 }, {  99,   5,  42, 230 }, 200,  56 }
+	};
+	const int numProbes = sizeof(probes)/sizeof(*probes);
+	auto probeValue = [&probes](int p, int k, int i) -> uint8
+	{
+		const ProbeDef& def = probes[p];
+		int perm = (i*def.Mul[k] + def.Add[k]) & 0xFF;
+		return uint8(def.Base + (perm % def.Range));
+	};
+
+	uint8 results[numProbes][256][4];
+	for (int p = 0; p < numProbes; p++)
+	{
+		tImage::tPicture picture(256, 1);
+		uint8* pixels = (uint8*)picture.GetPixelPointer();
+		for (int i = 0; i < 256; i++)
+			for (int k = 0; k < 4; k++)
+				pixels[i*4 + k] = probeValue(p, k, i);
+
+		operation.ApplyToPicture(picture);
+		pixels = (uint8*)picture.GetPixelPointer();
+		if ((picture.GetWidth() != 256) || (picture.GetHeight() != 1))
+			return false;
+		tStd::tMemcpy(results[p], pixels, sizeof(results[p]));
+	}
+
+	// For each destination channel try the same source channel first. A constant output matches any source.
+	for (int c = 0; c < 4; c++)
+	{
+		bool found = false;
+		for (int n = 0; (n < 4) && !found; n++)
+		{
+			int k = (c + n) % 4;
+			for (int i = 0; i < 256; i++)
+				lut[c][ probeValue(0, k, i) ] = results[0][i][c];
+
+			bool verified = true;
+			for (int p = 1; (p < numProbes) && verified; p++)
+				for (int i = 0; (i < 256) && verified; i++)
+					verified = (lut[c][ probeValue(p, k, i) ] == results[p][i][c]);
+
+			if (verified)
+			{
+				source[c] = k;
+				found = true;
+			}
+		}
+
+		if (!found)
+			return false;
+	}
+
+	return true;
+}
+
+
+bool Command::OperationFused::IsIdentity(const uint8 lut[4][256], const int source[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		if (source[c] != c)
+			return false;
+		for (int v = 0; v < 256; v++)
+			if (lut[c][v] != v)
+				return false;
+	}
+	return true;
+}
+
+
+bool Command::OperationFused::Apply(Viewer::Image& image)
+{
+	tAssert(Valid);
+	// The dirty flag ends up as it would for the unfused operations. Operations with identity parameters leave the
+	// image clean, but any other operation marks it dirty even if a later one in the run undoes the change.
+	if (!image.RemapChannels(Lut, Source))
+	{
+		if (AnyNonIdentity)
+			image.SetDirty();
+		tPrintfFull("Fused | Not applied. The %d operations cancel out or do not modify the image.\n", Run.Count());
+		return true;
+	}
+	tPrintfFull("Fused | RemapChannels[operations:%d source:%d%d%d%d]\n", Run.Count(), Source[0], Source[1], Source[2], Source[3]);
+	return true;
+}
+
+
+tString Command::OperationFused::GetCanonical() const
+{
+	// The same as the unfused operations so cache keys do not depend on whether fusion happened.
+	tString canon;
+	for (const Operation* operation = Run.First(); operation; operation = operation->Next())
+		canon += operation->GetCanonical();
+	return canon;
+}
+
+
+void Command::FusePointwiseOperations(tList<Operation>& operations)
+{
+	tList<Operation> unfused;
+	while (Operation* operation = operations.Remove())
+		unfused.Append(operation);
+
+	// Invalid operations are skipped when applying so they do not break a run. A run ends at the first operation
+	// that is not point-wise or fails probing.
+	tList<Operation> run;
+	int numPointwise = 0;
+	auto endRun = [&]()
+	{
+		if (numPointwise >= 2)
+		{
+			tPrintfFull("Fusing %d point-wise operations into a single pass.\n", numPointwise);
+			operations.Append(new OperationFused(run));
+		}
+		else
+		{
+			while (Operation* operation = run.Remove())
+				operations.Append(operation);
+		}
+		numPointwise = 0;
+	};
+
+	while (Operation* operation = unfused.Remove())
+	{
+		if (!operation->Valid)
+		{
+			delete operation;
+			continue;
+		}
+
+		uint8 lut[4][256];
+		int source[4];
+		if (operation->IsPointwise() && OperationFused::Probe(*operation, lut, source))
+		{
+			run.Append(operation);
+			numPointwise++;
+		}
+		else
+		{
+			endRun();
+			operations.Append(operation);
+		}
+	}
+	endRun();
+}
+
+
 // Post operations follow.
 
 
@@ -2047,68 +2475,33 @@ bool Command::PostOperationContact::Apply(tList<Viewer::Image>& images)
 		return false;
 	}
 
-	// Create the output picture. We only need to do this once rather than for every out type.
+	// The output files are determined first. Types that can be written a band of rows at a time are streamed so the
+	// whole contact sheet is never in memory. The rest are saved from a full picture as before.
 	int contactWidth = frameWidth*cols;
 	int contactHeight = frameHeight*rows;
-	tImage::tPicture outPic(contactWidth, contactHeight);
-	outPic.SetAll(FillColour);
-
-	int ix = 0;
-	int iy = 0;
-	int frame = 0;
-	for (Viewer::Image* img = images.First(); img; img = img->Next(), frame++)
+	std::vector<tSystem::tFileType> targetTypes;
+	std::vector<tString> targetFiles;
+	std::vector<Viewer::Strip::Format> targetStripFormats;
+	std::vector<bool> targetRLE;
+	bool needPicture = false;
+	bool tooLargeForType = false;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
 	{
-		if (!img->IsLoaded())
-			img->Load();
-
-		tPrintfFull("Processing frame %d : %s at (%d, %d).\n", frame, img->Filename.Chr(), ix, iy);
-		if ((img->GetWidth() != frameWidth) || (img->GetHeight() != frameHeight))
-		{
-			img->Unload();
-			tPrintfNorm("Contact | All input images must be same size.\n");
-			return false;
-		}
-
-		tImage::tPicture* currPic = img->GetCurrentPic();
+		tSystem::tFileType outType = typeItem->FileType;
 
-		// Copy resampled frame into place.
-		for (int y = 0; y < frameHeight; y++)
+		// TGA stores the dimensions in 16 bits. Larger sheets would get a truncated header.
+		if ((outType == tSystem::tFileType::TGA) && ((contactWidth > 0xFFFF) || (contactHeight > 0xFFFF)))
 		{
-			for (int x = 0; x < frameWidth; x++)
+			tPrintfNorm("Contact | %dx%d is too large to save as TGA.\n", contactWidth, contactHeight);
+			tooLargeForType = true;
+			if (OptionEarlyExit)
 			{
-				outPic.SetPixel
-				(
-					x + (ix*frameWidth),
-					y + ((rows-1-iy)*frameHeight),
-					currPic->GetPixel(x, y)
-				);
+				firstImage->Unload();
+				return false;
 			}
+			continue;
 		}
 
-		img->Unload();
-		ix++;
-		if (ix >= cols)
-		{
-			ix = 0;
-			iy++;
-			if (iy >= rows)
-				break;
-		}
-	}
-
-	if (!outPic.IsValid())
-	{
-		tPrintfNorm("Contact | Error generating output picture.\n");
-		return false;
-	}
-
-	// Now we iterate all the outtypes.
-	bool somethingFailed = false;
-	bool allowStealFrames = (OutTypes.Count() == 1);
-	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
-	{
-		tSystem::tFileType outType = typeItem->FileType;
-
 		// Determine the output filename.
 		tString extension = tSystem::tGetExtension(outType);
 		tString outFile;
@@ -2134,81 +2527,208 @@ bool Command::PostOperationContact::Apply(tList<Viewer::Image>& images)
 		{
 			tPrintfNorm("Contact | File %s%s exists. Not overwriting.\n", subDir.Chr(), tSystem::tGetFileName(outFile).Chr());
 			if (OptionEarlyExit)
+			{
+				firstImage->Unload();
 				return false;
+			}
 			continue;
 		}
 
-		// Now we need to save the contact/flipbook image file from the outpic.
-		bool success = false;
-		tPrintfFull("Contact | Save[file:%s]\n", tSystem::tGetFileName(outFile).Chr());
-		switch (outType)
+		bool rle = false;
+		Viewer::Strip::Format stripFormat = GetStripFormat(outType, rle);
+		targetTypes.push_back(outType);
+		targetFiles.push_back(outFile);
+		targetStripFormats.push_back(stripFormat);
+		targetRLE.push_back(rle);
+		if (stripFormat == Viewer::Strip::Format::Invalid)
+			needPicture = true;
+	}
+	int numTargets = int(targetTypes.size());
+
+	std::vector<Viewer::Strip::Writer> writers(numTargets);
+	for (int t = 0; t < numTargets; t++)
+	{
+		if (targetStripFormats[t] == Viewer::Strip::Format::Invalid)
+			continue;
+		tPrintfFull("Contact | Save[file:%s streamed]\n", tSystem::tGetFileName(targetFiles[t]).Chr());
+		writers[t].Open(targetFiles[t], targetStripFormats[t], targetRLE[t], contactWidth, contactHeight);
+	}
+
+	// Removes partially written streamed files.
+	auto abandonStreams = [&writers]()
+	{
+		for (Viewer::Strip::Writer& writer : writers)
 		{
-			case tSystem::tFileType::TGA:
-			{
-				tImage::tImageTGA tga(outPic, allowStealFrames);
-				tImage::tImageTGA::tFormat savedFmt = tga.Save(outFile, SaveParamsTGA);
-				success = (savedFmt != tImage::tImageTGA::tFormat::Invalid);
-				break;
-			}
+			if (!writer.IsOpen())
+				continue;
+			writer.Close();
+			tSystem::tDeleteFile(writer.GetFilename());
+		}
+	};
 
-			case tSystem::tFileType::PNG:
-			{
-				tImage::tImagePNG png(outPic, allowStealFrames);
-				tImage::tImagePNG::tFormat savedFmt = png.Save(outFile, SaveParamsPNG);
-				success = (savedFmt != tImage::tImagePNG::tFormat::Invalid);
-				break;
-			}
+	std::unique_ptr<tImage::tPicture> contactPic;
+	if (needPicture)
+	{
+		contactPic.reset(new tImage::tPicture(contactWidth, contactHeight));
+		contactPic->SetAll(FillColour);
+	}
 
-			case tSystem::tFileType::JPG:
-			{
-				tImage::tImageJPG jpg(outPic, allowStealFrames);
-				success = jpg.Save(outFile, SaveParamsJPG);
-				break;
-			}
+	// Each band is one row of frames. The frames of a band are loaded at the same time and each source is unloaded as
+	// soon as it is copied in. Bands go from the top down. Pictures are stored bottom-up.
+	std::vector<Viewer::Image*> sources;
+	for (Viewer::Image* img = images.First(); img; img = img->Next())
+		sources.push_back(img);
+	int numPlaced = tMath::tMin(numImages, cols*rows);
 
-			case tSystem::tFileType::GIF:
-			{
-				tImage::tImageGIF gif(outPic, allowStealFrames);
-				success = gif.Save(outFile, SaveParamsGIF);
-				break;
-			}
+	tImage::tPicture band(contactWidth, frameHeight);
+	std::vector<char> frameOK(cols);
+	for (int iy = 0; iy < rows; iy++)
+	{
+		band.SetAll(FillColour);
+		int firstFrame = iy*cols;
+		int numInBand = tMath::tClamp(numPlaced - firstFrame, 0, cols);
+		for (int ix = 0; ix < numInBand; ix++)
+			tPrintfFull("Processing frame %d : %s at (%d, %d).\n", firstFrame+ix, sources[firstFrame+ix]->Filename.Chr(), ix, iy);
 
-			case tSystem::tFileType::WEBP:
-			{
-				tImage::tImageWEBP webp(outPic, allowStealFrames);
-				success = webp.Save(outFile, SaveParamsWEBP);
-				break;
-			}
+		tPixel4b* bandPixels = band.GetPixelPointer();
+		Viewer::Parallel::For(numInBand, [&](int ix)
+		{
+			Viewer::Image* img = sources[firstFrame+ix];
+			if (!img->IsLoaded())
+				img->Load();
 
-			case tSystem::tFileType::QOI:
+			tImage::tPicture* currPic = img->GetCurrentPic();
+			frameOK[ix] = currPic && (img->GetWidth() == frameWidth) && (img->GetHeight() == frameHeight);
+			if (frameOK[ix])
 			{
-				tImage::tImageQOI qoi(outPic, allowStealFrames);
-				tImage::tImageQOI::tFormat savedFmt = qoi.Save(outFile, SaveParamsQOI);
-				success = (savedFmt != tImage::tImageQOI::tFormat::Invalid);
-				break;
+				const tPixel4b* srcPixels = currPic->GetPixelPointer();
+				for (int y = 0; y < frameHeight; y++)
+					tStd::tMemcpy(bandPixels + y*contactWidth + ix*frameWidth, srcPixels + y*frameWidth, frameWidth*sizeof(tPixel4b));
 			}
+			img->Unload();
+		});
 
-			case tSystem::tFileType::APNG:
+		for (int ix = 0; ix < numInBand; ix++)
+		{
+			if (!frameOK[ix])
 			{
-				tImage::tImageAPNG apng(outPic, allowStealFrames);
-				tImage::tImageAPNG::tFormat savedFormat = apng.Save(outFile, SaveParamsAPNG);
-				success = (savedFormat != tImage::tImageAPNG::tFormat::Invalid);
-				break;
+				tPrintfNorm("Contact | All input images must be same size.\n");
+				abandonStreams();
+				return false;
 			}
+		}
 
-			case tSystem::tFileType::BMP:
-			{
-				tImage::tImageBMP bmp(outPic, allowStealFrames);
-				tImage::tImageBMP::tFormat savedFormat = bmp.Save(outFile, SaveParamsBMP);
-				success = (savedFormat != tImage::tImageBMP::tFormat::Invalid);
-				break;
-			}
+		for (Viewer::Strip::Writer& writer : writers)
+			if (writer.IsOpen())
+				for (int y = frameHeight-1; y >= 0; y--)
+					writer.WriteRowsTopDown(bandPixels + y*contactWidth, 1);
 
-			case tSystem::tFileType::TIFF:
+		if (contactPic)
+		{
+			tPixel4b* dstPixels = contactPic->GetPixelPointer() + (rows-1-iy)*frameHeight*contactWidth;
+			tStd::tMemcpy(dstPixels, bandPixels, frameHeight*contactWidth*sizeof(tPixel4b));
+		}
+	}
+
+	if (contactPic && !contactPic->IsValid())
+	{
+		tPrintfNorm("Contact | Error generating output picture.\n");
+		abandonStreams();
+		return false;
+	}
+
+	// Now we iterate all the outtypes.
+	bool somethingFailed = false;
+	int numPictureTargets = 0;
+	for (int t = 0; t < numTargets; t++)
+		if (targetStripFormats[t] == Viewer::Strip::Format::Invalid)
+			numPictureTargets++;
+	bool allowStealFrames = (numPictureTargets == 1);
+	for (int t = 0; t < numTargets; t++)
+	{
+		tSystem::tFileType outType = targetTypes[t];
+		const tString& outFile = targetFiles[t];
+
+		bool success = false;
+		if (targetStripFormats[t] != Viewer::Strip::Format::Invalid)
+		{
+			success = writers[t].Close();
+			if (!success)
+				tSystem::tDeleteFile(outFile);
+		}
+		else
+		{
+			tImage::tPicture& outPic = *contactPic;
+			tPrintfFull("Contact | Save[file:%s]\n", tSystem::tGetFileName(outFile).Chr());
+			switch (outType)
 			{
-				tImage::tImageTIFF tiff(outPic, allowStealFrames);
-				success = tiff.Save(outFile, SaveParamsTIFF);
-				break;
+				case tSystem::tFileType::TGA:
+				{
+					tImage::tImageTGA tga(outPic, allowStealFrames);
+					tImage::tImageTGA::tFormat savedFmt = tga.Save(outFile, SaveParamsTGA);
+					success = (savedFmt != tImage::tImageTGA::tFormat::Invalid);
+					break;
+				}
+
+				case tSystem::tFileType::PNG:
+				{
+					tImage::tImagePNG png(outPic, allowStealFrames);
+					tImage::tImagePNG::tFormat savedFmt = png.Save(outFile, SaveParamsPNG);
+					success = (savedFmt != tImage::tImagePNG::tFormat::Invalid);
+					break;
+				}
+
+				case tSystem::tFileType::JPG:
+				{
+					tImage::tImageJPG jpg(outPic, allowStealFrames);
+					success = jpg.Save(outFile, SaveParamsJPG);
+					break;
+				}
+
+				case tSystem::tFileType::GIF:
+				{
+					tImage::tImageGIF gif(outPic, allowStealFrames);
+					success = gif.Save(outFile, SaveParamsGIF);
+					break;
+				}
+
+				case tSystem::tFileType::WEBP:
+				{
+					tImage::tImageWEBP webp(outPic, allowStealFrames);
+					success = webp.Save(outFile, SaveParamsWEBP);
+					break;
+				}
+
+				case tSystem::tFileType::QOI:
+				{
+					tImage::tImageQOI qoi(outPic, allowStealFrames);
+					tImage::tImageQOI::tFormat savedFmt = qoi.Save(outFile, SaveParamsQOI);
+					success = (savedFmt != tImage::tImageQOI::tFormat::Invalid);
+					break;
+				}
+
+				case tSystem::tFileType::APNG:
+				{
+					tImage::tImageAPNG apng(outPic, allowStealFrames);
+					tImage::tImageAPNG::tFormat savedFormat = apng.Save(outFile, SaveParamsAPNG);
+					success = (savedFormat != tImage::tImageAPNG::tFormat::Invalid);
+					break;
+				}
+
+				case tSystem::tFileType::BMP:
+				{
+					tImage::tImageBMP bmp(outPic, allowStealFrames);
+					tImage::tImageBMP::tFormat savedFormat = bmp.Save(outFile, SaveParamsBMP);
+					success = (savedFormat != tImage::tImageBMP::tFormat::Invalid);
+					break;
+				}
+
+				case tSystem::tFileType::TIFF:
+				{
+					tImage::tImageTIFF tiff(outPic, allowStealFrames);
+					success = tiff.Save(outFile, SaveParamsTIFF);
+					break;
+				}
 			}
 		}
 
@@ -2225,5 +2745,5 @@ bool Command::PostOperationContact::Apply(tList<Viewer::Image>& images)
 		}
 	}
 
-	return !somethingFailed;
+	return !somethingFailed && !tooLargeForType;
 }
@@ -29,6 +29,20 @@ namespace Command
 struct Operation : public tLink<Operation>
 {
 	virtual bool Apply(Viewer::Image&)					= 0;
+	virtual const char* GetName() const					= 0;
+
+	// Returns a normalized description of the parsed operation. Operations with the same canonical string produce
+	// the same result regardless of how the arguments were written. Used to build cache keys.
+	virtual tString GetCanonical() const				= 0;
+
+	// Returns true if the operation writes files other than the output image. Extract does this.
+	virtual bool HasSideEffects() const					{ return false; }
+
+	// Operations that may be point-wise (each output channel a function of a single input channel of the same pixel)
+	// return true and implement ApplyToPicture. This allows runs of them to be probed and fused into a single pass.
+	// Whether an operation really is point-wise is verified when probing.
+	virtual bool IsPointwise() const					{ return false; }
+	virtual void ApplyToPicture(tImage::tPicture&) const	{ }
 	virtual ~Operation()								{ }
 	bool Valid											= false;
 };
@@ -43,6 +57,8 @@ struct OperationPixel : public Operation
 	comp_t Channels										= tCompBit_RGBA;							// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "pixel"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -55,6 +71,8 @@ struct OperationResize : public Operation
 	tImage::tResampleEdgeMode EdgeMode					= tImage::tResampleEdgeMode::Clamp;			// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "resize"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -69,6 +87,8 @@ struct OperationCanvas : public Operation
 	int AnchorY											= -1;										// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "canvas"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -85,6 +105,8 @@ struct OperationAspect : public Operation
 	int AnchorY											= -1;										// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "aspect"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -96,6 +118,8 @@ struct OperationDeborder : public Operation
 	comp_t Channels										= tCompBit_RGBA;								// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "deborder"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -111,6 +135,8 @@ struct OperationCrop : public Operation
 	tColour4b FillColour								= tColour4b::transparent;					// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "crop"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -121,6 +147,8 @@ struct OperationFlip : public Operation
 	FlipMode Mode										= FlipMode::Horizontal;						// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "flip"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -144,6 +172,8 @@ struct OperationRotate : public Operation
 	tColour4b FillColour								= tColour4b::black;							// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "rotate"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -160,6 +190,10 @@ struct OperationLevels : public Operation
 	bool PowerMidGamma									= true;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "levels"; }
+	tString GetCanonical() const override;
+	bool IsPointwise() const override					{ return FrameNumber == -1; }
+	void ApplyToPicture(tImage::tPicture&) const override;
 };
 
 
@@ -171,6 +205,10 @@ struct OperationContrast : public Operation
 	Viewer::Image::AdjChan Channels						= Viewer::Image::AdjChan::RGB;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "contrast"; }
+	tString GetCanonical() const override;
+	bool IsPointwise() const override					{ return FrameNumber == -1; }
+	void ApplyToPicture(tImage::tPicture&) const override;
 };
 
 
@@ -182,6 +220,10 @@ struct OperationBrightness : public Operation
 	Viewer::Image::AdjChan Channels						= Viewer::Image::AdjChan::RGB;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "brightness"; }
+	tString GetCanonical() const override;
+	bool IsPointwise() const override					{ return FrameNumber == -1; }
+	void ApplyToPicture(tImage::tPicture&) const override;
 };
 
 
@@ -195,6 +237,8 @@ struct OperationQuantize : public Operation
 	double Dither										= 0.0;							// Optional, 0.0 is auto.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "quantize"; }
+	tString GetCanonical() const override;
 };
 
 
@@ -222,6 +266,10 @@ struct OperationChannel : public Operation
 	tColour4b Colour									= tColour4b::black;				// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "channel"; }
+	tString GetCanonical() const override;
+	bool IsPointwise() const override					{ return true; }
+	void ApplyToPicture(tImage::tPicture&) const override;
 };
 
 
@@ -235,6 +283,10 @@ struct OperationSwizzle : public Operation
 	tComp SwizzleA										= tComp::A;						// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "swizzle"; }
+	tString GetCanonical() const override;
+	bool IsPointwise() const override					{ return true; }
+	void ApplyToPicture(tImage::tPicture&) const override;
 
 private:
 	tComp CharToComp(char);
@@ -250,9 +302,38 @@ struct OperationExtract : public Operation
 	tString BaseName;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "extract"; }
+	tString GetCanonical() const override;
+	bool HasSideEffects() const override				{ return true; }
 };
 
 
+// A run of consecutive point-wise operations compiled into a per-channel lookup table plus a channel swizzle. The
+// result is identical to applying the original operations one after the other but each pixel is only visited once.
+struct OperationFused : public Operation
+{
+	// Takes ownership of the operations in the run. They are kept for their canonical strings.
+	OperationFused(tList<Operation>& run);
+	tList<Operation> Run;
+	uint8 Lut[4][256];
+	int Source[4]										= { 0, 1, 2, 3 };
+	bool AnyNonIdentity									= false;	// Some operation in the run changes pixels on its own.
+
+	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "fused"; }
+	tString GetCanonical() const override;
+
+	// Determines the lookup table and source channels equivalent to the supplied operation by applying it to probe
+	// pictures. Returns false if the operation turns out not to be point-wise.
+	static bool Probe(const Operation&, uint8 lut[4][256], int source[4]);
+	static bool IsIdentity(const uint8 lut[4][256], const int source[4]);
+};
+
+
+// Replaces runs of two or more consecutive point-wise operations with an OperationFused.
+void FusePointwiseOperations(tList<Operation>& operations);
+
+
 // Post Operations. These apply to multiple images after all normal (per-image) operations have been performed.
 struct PostOperation : public tLink<PostOperation>
 {
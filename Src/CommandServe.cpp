@@ -0,0 +1,540 @@
+// CommandServe.cpp
+//
+// Transport for the long-lived CLI server mode (--serve). Requests and replies are single lines of JSON. They are
+// read from stdin and written to stdout, or, on Linux, exchanged over a Unix domain socket. Each request is a job
+// holding the same arguments that would otherwise be passed on the command line.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef PLATFORM_WINDOWS
+#include <io.h>
+#endif
+#ifdef PLATFORM_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <System/tPrint.h>
+#include "CommandServe.h"
+#include "Command.h"
+#include "TacentView.h"
+
+
+namespace Command
+{
+namespace Serve
+{
+	bool ReadLine(std::string& line);
+	bool ParseRequest(const std::string& line, Request&, tString& error);
+
+	// Minimal JSON reading. Only what is needed for requests is supported. Unknown members are skipped.
+	void SkipSpace(const char*& c);
+	bool ParseString(const char*& c, std::string& str);
+	bool SkipValue(const char*& c);
+	void AppendUTF8(std::string& str, uint32 codepoint);
+
+	// Returns the JSON to echo for the raw text of an id value. Only numbers and literals are used as they are.
+	tString GetIdJSON(const std::string& raw);
+
+	bool UseStdio						= true;
+	bool Serving						= false;
+	std::FILE* ReplyStream				= nullptr;		// The original stdout when serving on stdio.
+	#ifdef PLATFORM_LINUX
+	tString SocketPath;
+	int ListenSocket					= -1;
+	int ClientSocket					= -1;
+	std::string ClientBuffer;
+	#endif
+}
+}
+
+
+bool Command::Serve::Open(const tString& endpoint)
+{
+	UseStdio = endpoint.IsEmpty() || (endpoint == "-") || (endpoint == "*");
+	if (UseStdio)
+	{
+		// Replies go to a duplicate of the original stdout and stdout itself now goes to stderr.
+		fflush(stdout);
+		#ifdef PLATFORM_WINDOWS
+		int replyFd = _dup(_fileno(stdout));
+		if ((replyFd < 0) || (_dup2(_fileno(stderr), _fileno(stdout)) != 0))
+			return false;
+		ReplyStream = _fdopen(replyFd, "wb");
+		#else
+		int replyFd = dup(fileno(stdout));
+		if ((replyFd < 0) || (dup2(fileno(stderr), fileno(stdout)) < 0))
+			return false;
+		ReplyStream = fdopen(replyFd, "w");
+		#endif
+		Serving = (ReplyStream != nullptr);
+		return Serving;
+	}
+
+	#ifdef PLATFORM_LINUX
+	sockaddr_un address;
+	tStd::tMemset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (endpoint.Length() >= int(sizeof(address.sun_path)))
+	{
+		tPrintfNorm("Warning: Socket path too long: %s\n", endpoint.Chr());
+		return false;
+	}
+	tStd::tStrcpy(address.sun_path, endpoint.Chr());
+
+	// A stale socket file from a previous run would make bind fail.
+	unlink(endpoint.Chr());
+	ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((ListenSocket < 0) || (bind(ListenSocket, (sockaddr*)&address, sizeof(address)) != 0) || (listen(ListenSocket, 4) != 0))
+	{
+		tPrintfNorm("Warning: Could not listen on socket %s\n", endpoint.Chr());
+		Close();
+		return false;
+	}
+	SocketPath = endpoint;
+	Serving = true;
+	tPrintfFull("Serving on socket %s\n", endpoint.Chr());
+	return true;
+
+	#else
+	tPrintfNorm("Warning: Socket serving is not supported on this platform. Use --serve - for stdin.\n");
+	return false;
+	#endif
+}
+
+
+void Command::Serve::Close()
+{
+	// Put stdout back the way it was.
+	if (ReplyStream)
+	{
+		fflush(stdout);
+		fflush(ReplyStream);
+		#ifdef PLATFORM_WINDOWS
+		_dup2(_fileno(ReplyStream), _fileno(stdout));
+		#else
+		dup2(fileno(ReplyStream), fileno(stdout));
+		#endif
+		fclose(ReplyStream);
+		ReplyStream = nullptr;
+	}
+	Serving = false;
+
+	#ifdef PLATFORM_LINUX
+	if (ClientSocket >= 0)
+		close(ClientSocket);
+	ClientSocket = -1;
+	ClientBuffer.clear();
+
+	if (ListenSocket >= 0)
+	{
+		close(ListenSocket);
+		unlink(SocketPath.Chr());
+	}
+	ListenSocket = -1;
+	SocketPath.Clear();
+	#endif
+}
+
+
+bool Command::Serve::IsServingStdio()
+{
+	return Serving && UseStdio;
+}
+
+
+bool Command::Serve::ReadLine(std::string& line)
+{
+	line.clear();
+	if (UseStdio)
+	{
+		char buffer[1024];
+		while (fgets(buffer, sizeof(buffer), stdin))
+		{
+			line += buffer;
+			if (!line.empty() && (line.back() == '\n'))
+				return true;
+		}
+		return !line.empty();
+	}
+
+	#ifdef PLATFORM_LINUX
+	while (true)
+	{
+		if (ClientSocket < 0)
+		{
+			ClientSocket = accept(ListenSocket, nullptr, nullptr);
+			if (ClientSocket < 0)
+				return false;
+			ClientBuffer.clear();
+		}
+
+		size_t newline = ClientBuffer.find('\n');
+		if (newline != std::string::npos)
+		{
+			line = ClientBuffer.substr(0, newline+1);
+			ClientBuffer.erase(0, newline+1);
+			return true;
+		}
+
+		char buffer[4096];
+		ssize_t numRead = read(ClientSocket, buffer, sizeof(buffer));
+		if (numRead > 0)
+		{
+			ClientBuffer.append(buffer, numRead);
+			continue;
+		}
+
+		// The client disconnected. A final unterminated line is still a request.
+		close(ClientSocket);
+		ClientSocket = -1;
+		if (!ClientBuffer.empty())
+		{
+			line = ClientBuffer;
+			ClientBuffer.clear();
+			return true;
+		}
+	}
+	#endif
+	return false;
+}
+
+
+bool Command::Serve::ReadRequest(Request& request)
+{
+	std::string line;
+	while (ReadLine(line))
+	{
+		while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r')))
+			line.pop_back();
+		if (line.find_first_not_of(" \t") == std::string::npos)
+			continue;
+
+		request.Id = "null";
+		request.Args.Clear();
+		request.Quit = false;
+		tString error;
+		if (ParseRequest(line, request, error))
+			return true;
+
+		tString reply;
+		tsPrintf(reply, "{\"id\":%s,\"status\":%d,\"error\":\"%s\"}", request.Id.Chr(), int(Viewer::ErrorCode_CLI_FailUnknown), EscapeJSON(error).Chr());
+		WriteReply(reply);
+	}
+	return false;
+}
+
+
+bool Command::Serve::WriteReply(const tString& json)
+{
+	if (UseStdio)
+	{
+		if (!ReplyStream)
+			return false;
+		fputs(json.Chr(), ReplyStream);
+		fputc('\n', ReplyStream);
+		fflush(ReplyStream);
+		return true;
+	}
+
+	#ifdef PLATFORM_LINUX
+	if (ClientSocket < 0)
+		return false;
+
+	std::string data(json.Chr());
+	data += '\n';
+	size_t written = 0;
+	while (written < data.size())
+	{
+		ssize_t numWritten = write(ClientSocket, data.data() + written, data.size() - written);
+		if (numWritten <= 0)
+			return false;
+		written += numWritten;
+	}
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+
+bool Command::Serve::ParseRequest(const std::string& line, Request& request, tString& error)
+{
+	const char* c = line.c_str();
+	SkipSpace(c);
+	if (*c != '{')
+	{
+		error = "Request must be a JSON object.";
+		return false;
+	}
+	c++;
+
+	SkipSpace(c);
+	if (*c == '}')
+	{
+		error = "Request has no args.";
+		return false;
+	}
+
+	bool haveArgs = false;
+	while (true)
+	{
+		SkipSpace(c);
+		std::string key;
+		if (!ParseString(c, key))
+		{
+			error = "Expected member name.";
+			return false;
+		}
+
+		SkipSpace(c);
+		if (*c != ':')
+		{
+			error = "Expected ':'.";
+			return false;
+		}
+		c++;
+		SkipSpace(c);
+
+		const char* valueStart = c;
+		if (key == "args")
+		{
+			if (*c != '[')
+			{
+				error = "The args member must be an array of strings.";
+				return false;
+			}
+			c++;
+			SkipSpace(c);
+			while (*c != ']')
+			{
+				std::string arg;
+				if (!ParseString(c, arg))
+				{
+					error = "The args member must be an array of strings.";
+					return false;
+				}
+				request.Args.Append(new tStringItem(arg.c_str()));
+				SkipSpace(c);
+				if (*c == ',')
+				{
+					c++;
+					SkipSpace(c);
+				}
+				else if (*c != ']')
+				{
+					error = "Expected ',' or ']' in args.";
+					return false;
+				}
+			}
+			c++;
+			haveArgs = true;
+		}
+		else
+		{
+			if (!SkipValue(c))
+			{
+				error = "Malformed value.";
+				return false;
+			}
+			if (key == "id")
+				request.Id = GetIdJSON(std::string(valueStart, c - valueStart));
+			else if (key == "quit")
+				request.Quit = (std::string(valueStart, c - valueStart) == "true");
+		}
+
+		SkipSpace(c);
+		if (*c == ',')
+		{
+			c++;
+			continue;
+		}
+		if (*c == '}')
+			break;
+
+		error = "Expected ',' or '}'.";
+		return false;
+	}
+
+	if (!haveArgs && !request.Quit)
+	{
+		error = "Request has no args.";
+		return false;
+	}
+
+	return true;
+}
+
+
+void Command::Serve::SkipSpace(const char*& c)
+{
+	while ((*c == ' ') || (*c == '\t') || (*c == '\r') || (*c == '\n'))
+		c++;
+}
+
+
+bool Command::Serve::ParseString(const char*& c, std::string& str)
+{
+	if (*c != '"')
+		return false;
+	c++;
+
+	while (*c && (*c != '"'))
+	{
+		if (*c != '\\')
+		{
+			str += *c++;
+			continue;
+		}
+
+		c++;
+		switch (*c)
+		{
+			case '"':	str += '"';		break;
+			case '\\':	str += '\\';	break;
+			case '/':	str += '/';		break;
+			case 'b':	str += '\b';	break;
+			case 'f':	str += '\f';	break;
+			case 'n':	str += '\n';	break;
+			case 'r':	str += '\r';	break;
+			case 't':	str += '\t';	break;
+			case 'u':
+			{
+				auto readHex = [](const char* h, uint32& value) -> bool
+				{
+					value = 0;
+					for (int i = 0; i < 4; i++)
+					{
+						char d = h[i];
+						value <<= 4;
+						if		((d >= '0') && (d <= '9'))	value |= d - '0';
+						else if	((d >= 'a') && (d <= 'f'))	value |= d - 'a' + 10;
+						else if	((d >= 'A') && (d <= 'F'))	value |= d - 'A' + 10;
+						else								return false;
+					}
+					return true;
+				};
+
+				uint32 codepoint = 0;
+				if (!readHex(c+1, codepoint))
+					return false;
+				c += 4;
+
+				// Surrogate pairs encode codepoints above the BMP.
+				uint32 low = 0;
+				if ((codepoint >= 0xD800) && (codepoint <= 0xDBFF) && (c[1] == '\\') && (c[2] == 'u') && readHex(c+3, low) && (low >= 0xDC00) && (low <= 0xDFFF))
+				{
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					c += 6;
+				}
+				AppendUTF8(str, codepoint);
+				break;
+			}
+			default:
+				return false;
+		}
+		c++;
+	}
+
+	if (*c != '"')
+		return false;
+	c++;
+	return true;
+}
+
+
+tString Command::Serve::GetIdJSON(const std::string& raw)
+{
+	if ((raw == "true") || (raw == "false") || (raw == "null"))
+		return tString(raw.c_str());
+
+	if (!raw.empty() && (raw.find_first_not_of("0123456789+-.eE") == std::string::npos))
+		return tString(raw.c_str());
+
+	// Strings are unescaped first so they aren't escaped twice. Objects and arrays become strings of their text.
+	std::string str;
+	const char* c = raw.c_str();
+	if (!ParseString(c, str) || (*c != '\0'))
+		str = raw;
+
+	tString id;
+	tsPrintf(id, "\"%s\"", EscapeJSON(tString(str.c_str())).Chr());
+	return id;
+}
+
+
+bool Command::Serve::SkipValue(const char*& c)
+{
+	if (*c == '"')
+	{
+		std::string ignored;
+		return ParseString(c, ignored);
+	}
+
+	if ((*c == '{') || (*c == '['))
+	{
+		int depth = 0;
+		while (*c)
+		{
+			if (*c == '"')
+			{
+				std::string ignored;
+				if (!ParseString(c, ignored))
+					return false;
+				continue;
+			}
+			if ((*c == '{') || (*c == '['))
+				depth++;
+			else if ((*c == '}') || (*c == ']'))
+				depth--;
+			c++;
+			if (depth == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Numbers and the literals true, false, and null.
+	const char* start = c;
+	while (*c && (*c != ',') && (*c != '}') && (*c != ']') && (*c != ' ') && (*c != '\t'))
+		c++;
+	return c != start;
+}
+
+
+void Command::Serve::AppendUTF8(std::string& str, uint32 codepoint)
+{
+	if (codepoint < 0x80)
+	{
+		str += char(codepoint);
+	}
+	else if (codepoint < 0x800)
+	{
+		str += char(0xC0 | (codepoint >> 6));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+	else if (codepoint < 0x10000)
+	{
+		str += char(0xE0 | (codepoint >> 12));
+		str += char(0x80 | ((codepoint >> 6) & 0x3F));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+	else
+	{
+		str += char(0xF0 | (codepoint >> 18));
+		str += char(0x80 | ((codepoint >> 12) & 0x3F));
+		str += char(0x80 | ((codepoint >> 6) & 0x3F));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+}
@@ -0,0 +1,53 @@
+// CommandServe.h
+//
+// Transport for the long-lived CLI server mode (--serve). Requests and replies are single lines of JSON. They are
+// read from stdin and written to stdout, or, on Linux, exchanged over a Unix domain socket. Each request is a job
+// holding the same arguments that would otherwise be passed on the command line.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+#include <Foundation/tList.h>
+
+
+namespace Command
+{
+namespace Serve
+{
+	// A request line looks like {"id":7,"args":["-o","png","--op","resize[640,*]","in.tga"]}. The id is echoed in the
+	// reply. Numbers, true, false, and null are echoed as they are. Anything else is echoed as an escaped string.
+	// {"quit":true} stops the server.
+	struct Request
+	{
+		tString Id;								// JSON text of the id. "null" if not supplied.
+		tList<tStringItem> Args;
+		bool Quit = false;
+	};
+
+	// The endpoint is either "-" (or "*") for stdin/stdout, or the path of a Unix domain socket to listen on. Sockets
+	// are only supported on Linux. Returns success. When serving on stdin/stdout the replies get a stream of their own
+	// and stdout is pointed at stderr, so nothing printed directly by any thread can end up in the replies.
+	bool Open(const tString& endpoint);
+	void Close();
+
+	// True while requests are being read from stdin. Jobs must not read stdin themselves then.
+	bool IsServingStdio();
+
+	// Blocks until the next request is available. Malformed lines are answered with an error reply and skipped.
+	// Returns false when there will be no more requests. With a socket, clients are served one at a time and the
+	// server keeps accepting new clients until a quit request is received.
+	bool ReadRequest(Request&);
+
+	// Writes a single reply line to the client that sent the most recent request. The json should not contain newlines.
+	bool WriteReply(const tString& json);
+}
+}
@@ -461,6 +461,9 @@ void Config::ProfileData::Reset(Viewer::Profile profile, uint32 categories)
 	if (categories & Category_System)
 	{
 		MaxImageMemMB				= 2048;
+		MaxTextureMemMB				= 1024;
+		MaxUndoMemMB				= 1024;
+		PrefetchImages				= 2;
 		MaxCacheFiles				= 8192;
 		MaxUndoSteps				= 16;
 		StrictLoading				= false;
@@ -631,6 +634,9 @@ void Config::ProfileData::Load(tExpression expr)
 			ReadItem(ResizeAspectUserDen);
 			ReadItem(ResizeAspectMode);
 			ReadItem(MaxImageMemMB);
+			ReadItem(MaxTextureMemMB);
+			ReadItem(MaxUndoMemMB);
+			ReadItem(PrefetchImages);
 			ReadItem(MaxCacheFiles);
 			ReadItem(MaxUndoSteps);
 			ReadItem(StrictLoading);
@@ -677,6 +683,9 @@ void Config::ProfileData::Load(tExpression expr)
 	tiClamp		(ResizeAspectUserDen, 1, 99);
 	tiClamp		(ResizeAspectMode, 0, 1);
 	tiClampMin	(MaxImageMemMB, 256);
+	tiClampMin	(MaxTextureMemMB, 128);
+	tiClampMin	(MaxUndoMemMB, 64);
+	tiClamp		(PrefetchImages, 0, 8);
 	tiClampMin	(MaxCacheFiles, 200);	
 	tiClamp		(MaxUndoSteps, 1, 32);
 	tiClamp		(MipmapFilter, 0, int(tImage::tResampleFilter::NumFilters));						// None allowed.
@@ -831,6 +840,9 @@ bool Config::ProfileData::Save(tExprWriter& writer) const
 	WriteItem(ResizeAspectUserDen);
 	WriteItem(ResizeAspectMode);
 	WriteItem(MaxImageMemMB);
+	WriteItem(MaxTextureMemMB);
+	WriteItem(MaxUndoMemMB);
+	WriteItem(PrefetchImages);
 	WriteItem(MaxCacheFiles);
 	WriteItem(MaxUndoSteps);
 	WriteItem(StrictLoading);
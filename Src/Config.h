@@ -302,6 +302,9 @@ struct ProfileData
 	int ResizeAspectMode;									// 0 = Crop Mode. 1 = Letterbox Mode.
 
 	int MaxImageMemMB;										// Max image mem before unloading images.
+	int MaxTextureMemMB;									// Max VRAM for image textures before releasing them.
+	int MaxUndoMemMB;										// Max mem for undo history before dropping it for other images.
+	int PrefetchImages;										// Neighbours to decode ahead of the current image. Half as many behind.
 	int MaxCacheFiles;										// Max number of cache files before removing oldest.
 	int MaxUndoSteps;
 	bool StrictLoading;										// No attempt to display ill-formed images.
@@ -19,6 +19,7 @@
 #include "TacentView.h"
 #include "GuiUtil.h"
 #include "Image.h"
+#include "MultiFrame.h"
 namespace Viewer { extern void DoFillColourInterface(const char* = nullptr, bool = false); }
 using namespace tStd;
 using namespace tMath;
@@ -340,16 +341,14 @@ void Viewer::SaveContactSheetTo
 	int iy = 0;
 	int frame = 0;
 
-	tPrintf("Loading all frames...\n");
-	for (Image* img = Images.First(); img; img = img->Next())
-	{
-		if (!img->IsLoaded())
-			img->Load();
-	}
-
+	// Images are loaded as they are needed. The ones that were not already loaded are unloaded again as soon as they
+	// are placed so the number of resident source images does not grow with the number of frames.
 	Image* currImg = Images.First();
 	while (currImg)
 	{
+		bool wasLoaded = currImg->IsLoaded();
+		if (!wasLoaded)
+			currImg->Load();
 		if (!currImg->IsLoaded())
 		{
 			currImg = currImg->Next();
@@ -381,6 +380,8 @@ void Viewer::SaveContactSheetTo
 					resampled.IsValid() ? resampled.GetPixel(x, y) : currPic->GetPixel(x, y)
 				);
 
+		if (!wasLoaded && (currImg != CurrImage))
+			currImg->Unload();
 		currImg = currImg->Next();
 
 		ix++;
@@ -410,6 +411,7 @@ void Viewer::SaveContactSheetTo
 	// and set the current image to the generated one.
 	if (ImagesDir.IsEqualCI( tGetDir(outFile) ))
 	{
+		WaitForExtract();
 		Images.Clear();
 		PopulateImages();
 		SetCurrentImage(outFile);
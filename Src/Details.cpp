@@ -162,6 +162,22 @@ void Viewer::ShowImageDetailsOverlay(bool* popen, float x, float y, float w, flo
 					case Image::ImgInfo::OpacityEnum::Varies:	ImGui::Text("Opaque: Varies");	Gutil::ToolTip("Varies means there is more than one frame/mipmap/page/side\nand they don't all match. This is likely not what you want\nbut is reasonable for, say, pages in a tiff.");	break;
 				}
 				ImGui::Text("Frames: %d", CurrImage->GetNumFrames());
+				tPicture* currPic = CurrImage->GetCurrentPic();
+				if (currPic && currPic->IsValid())
+				{
+					// While frames are playing the picture changes every frame so nothing is counted until paused.
+					tString coloursStr("Colours: Paused Only");
+					if (!CurrImage->FramePlaying)
+					{
+						int numColours = CurrImage->GetCurrentColourCount();
+						if (numColours >= 0)
+							tsPrintf(coloursStr, "Colours: %'d", numColours);
+						else
+							coloursStr = "Colours: Counting";
+					}
+					ImGui::Text(coloursStr.Chr());
+					Gutil::ToolTip("The number of unique RGB colours in the current frame. Alpha is ignored.\nThis is the count the quantize Check Exact option uses.");
+				}
 				tString sizeStr; tsPrintf(sizeStr, "File Size: %'d", info.FileSizeBytes);
 				ImGui::Text(sizeStr.Chr());
 				ImGui::Text("Cursor: (%d, %d)", cursorX, cursorY);
@@ -12,6 +12,7 @@
 // AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
+#include <climits>
 #include <mutex>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>				// Include glfw3.h after our OpenGL definitions.
@@ -23,7 +24,11 @@
 #include <System/tChunk.h>
 #include <Math/tRandom.h>
 #include "Image.h"
+#include "ColourCensus.h"
+#include "ImageProbe.h"
+#include "Parallel.h"
 #include "Config.h"
+#include <algorithm>
 #include <vector>
 using namespace tStd;
 using namespace tSystem;
@@ -46,7 +51,16 @@ const int Image::ThumbMinDispWidth = 64;
 Image::Image() { RegenerateShuffleValue(); ResetLoadParams(); }
 Image::Image(const tString& filename) : Image() { Filename = filename; Filetype = tGetFileType(Filename); }
 Image::Image(const tSystem::tFileInfo& fileInfo) : Image() { Filename = fileInfo.FileName; Filetype = tGetFileType(Filename); FileModTime = fileInfo.ModificationTime; FileSizeB = fileInfo.FileSize; }
-Image::~Image() {}
+Image::~Image()
+{
+	// The loader can't be interrupted so we wait for it. It only ever touches LoadResult.
+	if (LoadThreadRunning)
+		LoadThread.join();
+	delete LoadResult;
+	if (ColourCountThreadRunning)
+		ColourCountThread.join();
+	Residency::Remove(this);
+}
 
 void Image::ResetLoadParams()
 {
@@ -118,6 +132,27 @@ bool Image::Load(bool loadParamsFromConfig)
 	Info.ChannelType		= tChannelType::Unspecified;
 	bool success = false;
 
+	// A region load replaces the normal decode. If the file layout doesn't support it we fall through to a full load.
+	LoadRegionApplied = false;
+	bool regionResized = false;
+	if (LoadParams_RegionEnabled)
+	{
+		tPicture* picture = new tPicture();
+		int srcWidth = 0, srcHeight = 0;
+		if (Region::Load(*picture, Info.SrcPixelFormat, srcWidth, srcHeight, Filename, LoadParams_Region))
+		{
+			Pictures.Append(picture);
+			LoadRegionApplied = true;
+			regionResized = (srcWidth != LoadParams_Region.Width) || (srcHeight != LoadParams_Region.Height);
+			loadingFiletype = tSystem::tFileType::Invalid;
+			success = true;
+		}
+		else
+		{
+			delete picture;
+		}
+	}
+
 	switch (loadingFiletype)
 	{
 		case tSystem::tFileType::APNG:
@@ -551,6 +586,10 @@ bool Image::Load(bool loadParamsFromConfig)
 	if (!success)
 		return false;
 
+	bool loadReduced = false;
+	if ((LoadParams_ReduceWidth > 0) || (LoadParams_ReduceHeight > 0))
+		loadReduced = ReduceLoadedPictures();
+
 	LoadedTime = tSystem::tGetTime();
 
 	// Fill in rest of info struct.
@@ -570,20 +609,134 @@ bool Image::Load(bool loadParamsFromConfig)
 
 	Info.FileSizeBytes		= tSystem::tGetFileSize(Filename);
 	Info.MemSizeBytes		= GetMemSizeBytes();
+	PixelsVersion++;
 	ClearDirty();
+
+	// The pictures no longer match the file so anything saving it must not treat it as unchanged.
+	if (regionResized || loadReduced)
+		Dirty = true;
 	return true;
 }
 
 
-bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveParams, bool onlyCurrentPic) const
+bool Image::ReduceLoadedPictures()
+{
+	tPicture* primary = Pictures.First();
+	if (!primary || (MFT == MultiFrameType::Cubemap) || (MFT == MultiFrameType::TextureArray) || (MFT == MultiFrameType::Volume3D))
+		return false;
+
+	// The target is computed exactly as the resize operation will compute it.
+	int srcW = primary->GetWidth();
+	int srcH = primary->GetHeight();
+	float aspect = float(srcW) / float(srcH);
+	int dstW = LoadParams_ReduceWidth;
+	int dstH = LoadParams_ReduceHeight;
+	if (dstW <= 0)
+		dstW = int( float(dstH) * aspect );
+	else if (dstH <= 0)
+		dstH = int( float(dstW) / aspect );
+	tiClamp(dstW, 4, MaxDim);
+	tiClamp(dstH, 4, MaxDim);
+
+	// The largest power of two the primary may be reduced by. If a dimension is computed from the aspect ratio the
+	// reduced primary must have exactly the same aspect, so both dimensions must divide evenly.
+	bool exactAspect = (LoadParams_ReduceWidth <= 0) || (LoadParams_ReduceHeight <= 0);
+	int factor = 1;
+	while (((srcW/(factor*2)) >= dstW) && ((srcH/(factor*2)) >= dstH))
+	{
+		if (exactAspect && (((srcW % (factor*2)) != 0) || ((srcH % (factor*2)) != 0)))
+			break;
+		factor *= 2;
+	}
+	if (factor == 1)
+		return false;
+
+	// For a mipmap chain the level with the reduced size already exists. The levels above it are replaced by copies
+	// of it so the number of pictures does not change.
+	if (MFT == MultiFrameType::Mipmaps)
+	{
+		tPicture* level = primary;
+		while (level && ((level->GetWidth() != srcW/factor) || (level->GetHeight() != srcH/factor)))
+			level = level->Next();
+
+		if (level)
+		{
+			for (tPicture* pic = Pictures.First(); pic != level; pic = pic->Next())
+				pic->Set(*level);
+			return true;
+		}
+	}
+
+	// Other pictures, like animation frames, are reduced by as much as they can be while staying at least the target.
+	ReducePicture(*primary, factor);
+	for (tPicture* pic = primary->Next(); pic; pic = pic->Next())
+	{
+		int picFactor = 1;
+		while (((pic->GetWidth()/(picFactor*2)) >= dstW) && ((pic->GetHeight()/(picFactor*2)) >= dstH))
+			picFactor *= 2;
+		ReducePicture(*pic, picFactor);
+	}
+	return true;
+}
+
+
+void Image::ReducePicture(tPicture& picture, int factor)
+{
+	if (factor <= 1)
+		return;
+
+	// Each destination pixel is the average of a factor x factor block. Any partial blocks at the right and bottom
+	// edges are dropped.
+	int srcW = picture.GetWidth();
+	int dstW = srcW / factor;
+	int dstH = picture.GetHeight() / factor;
+	if ((dstW <= 0) || (dstH <= 0))
+		return;
+
+	const tPixel4b* src = picture.GetPixels();
+	tPixel4b* dst = new tPixel4b[int64(dstW)*int64(dstH)];
+	int numSamples = factor*factor;
+	for (int y = 0; y < dstH; y++)
+	{
+		for (int x = 0; x < dstW; x++)
+		{
+			uint32 sum[4] = { 0, 0, 0, 0 };
+			for (int sy = 0; sy < factor; sy++)
+			{
+				const tPixel4b* row = src + int64(y*factor + sy)*int64(srcW) + int64(x)*factor;
+				for (int sx = 0; sx < factor; sx++)
+				{
+					sum[0] += row[sx].R;
+					sum[1] += row[sx].G;
+					sum[2] += row[sx].B;
+					sum[3] += row[sx].A;
+				}
+			}
+			tPixel4b& pixel = dst[int64(y)*int64(dstW) + x];
+			pixel.R = uint8((sum[0] + numSamples/2) / numSamples);
+			pixel.G = uint8((sum[1] + numSamples/2) / numSamples);
+			pixel.B = uint8((sum[2] + numSamples/2) / numSamples);
+			pixel.A = uint8((sum[3] + numSamples/2) / numSamples);
+		}
+	}
+
+	// Set with copy false takes ownership of the new buffer. The frame duration is kept.
+	float duration = picture.Duration;
+	picture.Set(dstW, dstH, dst, false);
+	picture.Duration = duration;
+}
+
+
+bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveParams, bool onlyCurrentPic, int frameNum) const
 {
 	Config::ProfileData& profile = Config::GetProfileData();
+	int saveFrameNum = (frameNum >= 0) ? frameNum : FrameNum;
 	bool success = false;
 	switch (fileType)
 	{
 		case tFileType::TGA:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetFramePic(saveFrameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 			tImageTGA tga(*picture, false);
@@ -607,7 +760,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::PNG:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetFramePic(saveFrameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -631,7 +784,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::JPG:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetFramePic(saveFrameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -649,7 +802,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 			tList<tFrame> frames;
 			if (onlyCurrentPic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetFramePic(saveFrameNum);
 				frames.Append
 				(
 					new tFrame
@@ -701,7 +854,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 			tList<tFrame> frames;
 			if (onlyCurrentPic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetFramePic(saveFrameNum);
 				frames.Append
 				(
 					new tFrame
@@ -745,7 +898,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::QOI:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetFramePic(saveFrameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -778,7 +931,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 			tList<tFrame> frames;
 			if (onlyCurrentPic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetFramePic(saveFrameNum);
 				frames.Append
 				(
 					new tFrame
@@ -819,7 +972,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::BMP:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetFramePic(saveFrameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -844,7 +997,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 			tList<tFrame> frames;
 			if (onlyCurrentPic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetFramePic(saveFrameNum);
 				frames.Append
 				(
 					new tFrame
@@ -890,6 +1043,40 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 }
 
 
+int64 Image::GetPixelMemBytes() const
+{
+	int64 numBytes = 0;
+	for (tPicture* pic = Pictures.First(); pic; pic = pic->Next())
+		numBytes += int64(pic->GetNumPixels()) * sizeof(tPixel4b);
+
+	numBytes += AltPicture.IsValid() ? int64(AltPicture.GetNumPixels())*sizeof(tPixel4b) : 0;
+	return numBytes;
+}
+
+
+int64 Image::GetTextureMemBytes() const
+{
+	int64 numBytes = 0;
+	for (tPicture* pic = Pictures.First(); pic; pic = pic->Next())
+		if (pic->TextureID != 0)
+			numBytes += GetPictureTextureBytes(*pic);
+
+	if ((TexIDAlt != 0) && AltPicture.IsValid())
+		numBytes += GetPictureTextureBytes(AltPicture);
+
+	return numBytes;
+}
+
+
+int64 Image::GetPictureTextureBytes(const tPicture& picture) const
+{
+	// Textures are RGBA8 and a full mipmap chain adds a third.
+	Config::ProfileData& profile = Config::GetProfileData();
+	int64 numBytes = int64(picture.GetNumPixels()) * sizeof(tPixel4b);
+	return (tResampleFilter(profile.MipmapFilter) != tResampleFilter::None) ? (numBytes*4)/3 : numBytes;
+}
+
+
 int Image::GetMemSizeBytes() const
 {
 	int numBytes = 0;
@@ -1103,8 +1290,10 @@ bool Image::Unload(bool force)
 	AltPictureTyp = AltPictureType::None;
 	Pictures.Clear();
 	Info.MemSizeBytes = 0;
+	PixelsVersion++;
 
 	LoadedTime = -1.0f;
+	Residency::Refresh(this);
 	return true;
 }
 
@@ -1176,12 +1365,21 @@ tColour4b Image::GetPixel(int x, int y) const
 }
 
 
+void Image::ForEachPicture(const std::function<void(tPicture*)>& fn)
+{
+	std::vector<tPicture*> pictures;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+		pictures.push_back(picture);
+
+	Parallel::For(int(pictures.size()), [&pictures, &fn](int p) { fn(pictures[p]); });
+}
+
+
 void Image::Rotate90(bool antiClockWise)
 {
 	tString desc; tsPrintf(desc, "Rotate 90 %s", antiClockWise ? "ACW" : "CW");
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Rotate90(antiClockWise);
+	ForEachPicture([&](tPicture* picture) { picture->Rotate90(antiClockWise); });
 
 	Dirty = true;
 }
@@ -1194,20 +1392,74 @@ bool Image::Rotate(float angle, const tColour4b& fill, tResampleFilter upFilter,
 
 	tString desc; tsPrintf(desc, "Rotate %.1f", tRadToDeg(angle));
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->RotateCenter(angle, fill, upFilter, downFilter);
+	ForEachPicture([&](tPicture* picture) { picture->RotateCenter(angle, fill, upFilter, downFilter); });
 
 	Dirty = true;
 	return true;
 }
 
 
+bool Image::FitsInColours(const tPicture& picture, int numColours, bool checkExact)
+{
+	// The census stops as soon as there are too many colours so this is fast for the usual case of a full-colour image.
+	// The quantizers work on RGB so alpha is not counted.
+	return checkExact && (Census::CountColours(picture, numColours, true) <= numColours);
+}
+
+
+int Image::CountUniqueColours(int limit) const
+{
+	std::vector<Census::Span> spans;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+		if (picture->IsValid())
+			spans.push_back({ picture->GetPixelPointer(), int64(picture->GetWidth()) * int64(picture->GetHeight()) });
+	return Census::CountColours(spans, limit, true);
+}
+
+
+int Image::GetCurrentColourCount()
+{
+	if (ColourCountThreadRunning)
+	{
+		if (ColourCountThreadFlag.test_and_set())
+			return -1;
+		ColourCountThread.join();
+		ColourCountThreadRunning = false;
+		ColourCountPicture.Clear();
+	}
+
+	if ((ColourCountFrame == FrameNum) && (ColourCountVersion == PixelsVersion) && (ColourCountResult >= 0))
+		return ColourCountResult;
+
+	// The worker counts a copy so edits made while it runs can't race with it. The result is only used if nothing
+	// changed in the meantime, otherwise the next call starts again.
+	tPicture* picture = GetCurrentPic();
+	if (!picture || !picture->IsValid())
+		return -1;
+
+	ColourCountPicture.Set(*picture);
+	ColourCountFrame = FrameNum;
+	ColourCountVersion = PixelsVersion;
+	ColourCountResult = -1;
+	ColourCountThreadRunning = true;
+	ColourCountThreadFlag.test_and_set();
+	ColourCountThread = std::thread
+	(
+		[this]
+		{
+			ColourCountResult = Census::CountColours(ColourCountPicture, -1, true);
+			ColourCountThreadFlag.clear();
+		}
+	);
+	return -1;
+}
+
+
 void Image::QuantizeFixed(int numColours, bool checkExact)
 {
 	tString desc; tsPrintf(desc, "Quantize %d", numColours);
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->QuantizeFixed(numColours, checkExact);
+	ForEachPicture([&](tPicture* picture) { if (!FitsInColours(*picture, numColours, checkExact)) picture->QuantizeFixed(numColours, false); });
 
 	Dirty = true;
 }
@@ -1217,8 +1469,11 @@ void Image::QuantizeSpatial(int numColours, bool checkExact, double ditherLevel,
 {
 	tString desc; tsPrintf(desc, "Quantize %d", numColours);
 	PushUndo(desc);
+	// Not done in parallel. The spatial quantizer seeds from a shared random number generator so concurrent frames
+	// would race on it and the result would depend on scheduling.
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->QuantizeSpatial(numColours, checkExact, ditherLevel, filterSize);
+		if (!FitsInColours(*picture, numColours, checkExact))
+			picture->QuantizeSpatial(numColours, false, ditherLevel, filterSize);
 
 	Dirty = true;
 }
@@ -1228,8 +1483,10 @@ void Image::QuantizeNeu(int numColours, bool checkExact, int sampleFactor)
 {
 	tString desc; tsPrintf(desc, "Quantize %d", numColours);
 	PushUndo(desc);
+	// Not done in parallel. The NeuQuant learning state may be shared between calls.
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->QuantizeNeu(numColours, checkExact, sampleFactor);
+		if (!FitsInColours(*picture, numColours, checkExact))
+			picture->QuantizeNeu(numColours, false, sampleFactor);
 
 	Dirty = true;
 }
@@ -1239,8 +1496,10 @@ void Image::QuantizeWu(int numColours, bool checkExact)
 {
 	tString desc; tsPrintf(desc, "Quantize %d", numColours);
 	PushUndo(desc);
+	// Not done in parallel. The Wu moment tables may be shared between calls. This method is fast anyway.
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->QuantizeWu(numColours, checkExact);
+		if (!FitsInColours(*picture, numColours, checkExact))
+			picture->QuantizeWu(numColours, false);
 
 	Dirty = true;
 }
@@ -1263,8 +1522,7 @@ void Image::AdjustBrightness(float brightness, AdjChan channels, bool allFrames)
 {
 	if (allFrames)
 	{
-		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustBrightness(brightness, ComponentBits(channels));
+		ForEachPicture([&](tPicture* picture) { picture->AdjustBrightness(brightness, ComponentBits(channels)); });
 	}
 	else
 	{
@@ -1272,6 +1530,7 @@ void Image::AdjustBrightness(float brightness, AdjChan channels, bool allFrames)
 		if (picture)
 			picture->AdjustBrightness(brightness, ComponentBits(channels));
 	}
+	PixelsVersion++;
 	Dirty = true;
 }
 
@@ -1280,8 +1539,7 @@ void Image::AdjustContrast(float contrast, AdjChan channels, bool allFrames)
 {
 	if (allFrames)
 	{
-		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustContrast(contrast, ComponentBits(channels));
+		ForEachPicture([&](tPicture* picture) { picture->AdjustContrast(contrast, ComponentBits(channels)); });
 	}
 	else
 	{
@@ -1289,6 +1547,7 @@ void Image::AdjustContrast(float contrast, AdjChan channels, bool allFrames)
 		if (picture)
 			picture->AdjustContrast(contrast, ComponentBits(channels));
 	}
+	PixelsVersion++;
 	Dirty = true;
 }
 
@@ -1297,8 +1556,7 @@ void Image::AdjustLevels(float blackPoint, float midPoint, float whitePoint, flo
 {
 	if (allFrames)
 	{
-		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut, powerMidGamma, ComponentBits(channels));
+		ForEachPicture([&](tPicture* picture) { picture->AdjustLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut, powerMidGamma, ComponentBits(channels)); });
 	}
 	else
 	{
@@ -1306,6 +1564,7 @@ void Image::AdjustLevels(float blackPoint, float midPoint, float whitePoint, flo
 		if (picture)
 			picture->AdjustLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut, powerMidGamma, ComponentBits(channels));
 	}
+	PixelsVersion++;
 	Dirty = true;
 }
 
@@ -1318,6 +1577,7 @@ void Image::AdjustRestoreOriginal(bool popUndo)
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
 		picture->AdjustRestoreOriginal();
 
+	PixelsVersion++;
 	Dirty = false;
 }
 
@@ -1346,8 +1606,7 @@ void Image::Flip(bool horizontal)
 {
 	tString desc; tsPrintf(desc, "Flip %s", horizontal ? "Horiz" : "Vert");
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Flip(horizontal);
+	ForEachPicture([&](tPicture* picture) { picture->Flip(horizontal); });
 
 	Dirty = true;
 }
@@ -1440,8 +1699,7 @@ bool Image::Deborder(const tColour4b& borderColour, comp_t channels)
 		return false;
 
 	PushUndo("Crop Borders");
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Deborder(borderColour, channels);
+	ForEachPicture([&](tPicture* picture) { picture->Deborder(borderColour, channels); });
 
 	Dirty = true;
 	return true;
@@ -1464,8 +1722,8 @@ bool Image::Resample(int newWidth, int newHeight, tImage::tResampleFilter filter
 
 	tString desc; tsPrintf(desc, "Resample %d %d", newWidth, newHeight);
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Resample(newWidth, newHeight, filter, edgeMode);
+
+	ForEachPicture([&](tPicture* picture) { picture->Resample(newWidth, newHeight, filter, edgeMode); });
 
 	Dirty = true;
 	return true;
@@ -1486,6 +1744,7 @@ void Image::SetPixelColour(int x, int y, const tColour4b& colour, bool pushUndo,
 			picture->SetPixel(x, y, colour);
 	}
 
+	PixelsVersion++;
 	if (!surpressDirty)
 		Dirty = true;
 }
@@ -1496,8 +1755,7 @@ void Image::SetAllPixels(const tColour4b& colour, comp_t channels)
 	tString desc; tsPrintf(desc, "Set Pixels (%d,%d,%d,%d)", colour.R, colour.G, colour.B, colour.A);
 	PushUndo(desc);
 
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->SetAll(colour, channels);
+	ForEachPicture([&](tPicture* picture) { picture->SetAll(colour, channels); });
 
 	Dirty = true;
 }
@@ -1511,8 +1769,7 @@ void Image::Spread(tComp channel)
 	tString desc; tsPrintf(desc, "Spread %s", tGetComponentName(channel));
 	PushUndo(desc);
 
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Spread(channel);
+	ForEachPicture([&](tPicture* picture) { picture->Spread(channel); });
 
 	Dirty = true;
 }
@@ -1532,8 +1789,7 @@ void Image::Swizzle(tComp R, tComp G, tComp B, tComp A)
 	tString desc; tsPrintf(desc, "Swizzle %s", channelsStr.Chr());
 	PushUndo(desc);
 
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Swizzle(R, G, B, A);
+	ForEachPicture([&](tPicture* picture) { picture->Swizzle(R, G, B, A); });
 
 	Dirty = true;
 }
@@ -1551,8 +1807,7 @@ void Image::Intensity(comp_t channels)
 	tString desc; tsPrintf(desc, "Intensity %s", channelsStr.Chr());
 	PushUndo(desc);
 
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Intensity(channels);
+	ForEachPicture([&](tPicture* picture) { picture->Intensity(channels); });
 
 	Dirty = true;
 }
@@ -1563,10 +1818,54 @@ void Image::AlphaBlendColour(const tColour4b& colour, comp_t channels, int final
 	tString desc; tsPrintf(desc, "Blend (%d,%d,%d,%d)", colour.R, colour.G, colour.B, colour.A);
 	PushUndo(desc);
 
+	ForEachPicture([&](tPicture* picture) { picture->AlphaBlendColour(colour, channels, finalAlpha); });
+
+	Dirty = true;
+}
+
+
+bool Image::RemapChannels(const uint8 lut[4][256], const int source[4])
+{
+	bool identity = true;
+	for (int c = 0; (c < 4) && identity; c++)
+	{
+		identity = (source[c] == c);
+		for (int v = 0; (v < 256) && identity; v++)
+			identity = (lut[c][v] == v);
+	}
+	if (identity)
+		return false;
+
+	PushUndo("Remap Channels");
+
+	// Each picture is split into runs of pixels so that a single large picture is also spread over the threads.
+	const int runLength = 1 << 16;
+	struct Run { uint8* Pixels; int NumPixels; };
+	std::vector<Run> runs;
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->AlphaBlendColour(colour, channels, finalAlpha);
+	{
+		uint8* pixels = (uint8*)picture->GetPixelPointer();
+		int64 numPixels = int64(picture->GetWidth()) * int64(picture->GetHeight());
+		for (int64 start = 0; start < numPixels; start += runLength)
+			runs.push_back({ pixels + start*4, int(tMin(int64(runLength), numPixels - start)) });
+	}
+
+	Parallel::For(int(runs.size()), [&runs, lut, source](int r)
+	{
+		uint8* pixels = runs[r].Pixels;
+		int numPixels = runs[r].NumPixels;
+		for (int p = 0; p < numPixels; p++, pixels += 4)
+		{
+			uint8 src[4] = { pixels[0], pixels[1], pixels[2], pixels[3] };
+			pixels[0] = lut[0][ src[source[0]] ];
+			pixels[1] = lut[1][ src[source[1]] ];
+			pixels[2] = lut[2][ src[source[2]] ];
+			pixels[3] = lut[3][ src[source[3]] ];
+		}
+	});
 
 	Dirty = true;
+	return true;
 }
 
 
@@ -1614,35 +1913,104 @@ uint64 Image::Bind()
 		return TexIDAlt;
 	}
 
+	if (!IsLoaded())
+		return 0;
+
+	tiClamp(FrameNum, 0, GetNumPictures()-1);
 	tPicture* currPic = GetCurrentPic();
-	if (currPic && (currPic->TextureID != 0))
+	if (!currPic || !currPic->IsValid())
+		return 0;
+
+	// Look-ahead frames are uploaded first since creating a texture leaves it bound.
+	bool uploaded = false;
+	if (FramePlaying)
+	{
+		tPicture* picture = currPic;
+		for (int ahead = 0; ahead < TextureLookAhead; ahead++)
+		{
+			picture = FramePlayRev ? picture->Prev() : picture->Next();
+			if (!picture && FramePlayLooping)
+				picture = FramePlayRev ? Pictures.Last() : Pictures.First();
+			if (!picture || (picture == currPic))
+				break;
+
+			if (picture->IsValid() && (picture->TextureID == 0))
+			{
+				BindPicture(*picture);
+				uploaded = true;
+			}
+		}
+	}
+
+	if (currPic->TextureID == 0)
+	{
+		BindPicture(*currPic);
+		uploaded = true;
+	}
+	else
 	{
 		glBindTexture(GL_TEXTURE_2D, currPic->TextureID);
-		return currPic->TextureID;
 	}
 
-	if (!IsLoaded())
-		return 0;
+	if (uploaded)
+		Residency::Refresh(this);
+	return currPic->TextureID;
+}
+
+
+void Image::BindPicture(tPicture& picture)
+{
+	tAssert(picture.TextureID == 0);
+	Config::ProfileData& profile = Config::GetProfileData();
+	glGenTextures(1, &picture.TextureID);
+	if (picture.TextureID == 0)
+		return;
+
+	tList<tLayer> layers;
+	picture.GenerateLayers(layers, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
+	BindLayers(layers, picture.TextureID);
+}
 
-	tiClamp(FrameNum, 0, GetNumPictures()-1);
 
-	// We do this in reverse order so that the last image we bind is the highest resolution image.
-	// This is more efficient when it comes to drawing the image since the lowest mip is likely not
-	// the one we're going to be viewing right after binding.
-	for (tPicture* picture = Pictures.Last(); picture; picture = picture->Prev())
+int Image::ReleaseFrameTextures(int64 maxBytes)
+{
+	int numPictures = GetNumPictures();
+	int64 numBytes = GetTextureMemBytes();
+	if ((numPictures <= 1) || (numBytes <= maxBytes))
+		return 0;
+
+	// Pictures are ordered by how far ahead of the current one they are in play order. When looping, the frames just
+	// shown are the furthest ahead. The current picture and the look-ahead frames are kept.
+	int dir = FramePlayRev ? -1 : 1;
+	std::vector<std::pair<int, tPicture*>> candidates;
+	int index = 0;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next(), index++)
 	{
-		if (!picture->IsValid())
+		if (picture->TextureID == 0)
 			continue;
 
-		tAssert(picture->TextureID == 0);
-		glGenTextures(1, &picture->TextureID);
+		int ahead = (((index - FrameNum) * dir) % numPictures + numPictures) % numPictures;
+		if (ahead > TextureLookAhead)
+			candidates.push_back(std::make_pair(ahead, picture));
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
 
-		tList<tLayer> layers;
-		picture->GenerateLayers(layers, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
-		BindLayers(layers, picture->TextureID);
+	int numReleased = 0;
+	for (auto& candidate : candidates)
+	{
+		if (numBytes <= maxBytes)
+			break;
+
+		tPicture* picture = candidate.second;
+		numBytes -= GetPictureTextureBytes(*picture);
+		glDeleteTextures(1, &picture->TextureID);
+		picture->TextureID = 0;
+		numReleased++;
 	}
-	currPic = GetCurrentPic();
-	return currPic ? currPic->TextureID : 0;
+
+	if (numReleased > 0)
+		Residency::Refresh(this);
+	return numReleased;
 }
 
 
@@ -1662,13 +2030,17 @@ void Image::Unbind()
 		glDeleteTextures(1, &TexIDAlt);
 		TexIDAlt = 0;
 	}
+
+	Residency::Refresh(this);
 }
 
 
 void Image::InvalidateTexture()
 {
-	// Force texture reload on next Bind() by deleting current textures
+	// Force texture reload on next Bind() by deleting current textures. This is also how changing array layers or mip
+	// levels replaces the pictures.
 	Unbind();
+	PixelsVersion++;
 }
 
 
@@ -2205,6 +2577,31 @@ void Image::RequestThumbnail()
 }
 
 
+bool Image::ProbeDimensions()
+{
+	if (Cached_PrimaryArea > 0)
+		return true;
+
+	if (ThumbnailThreadRunning || ProbeFailed)
+		return false;
+
+	// Callers may probe every frame so a failure is remembered rather than reading the header again.
+	Probe::HeaderInfo header;
+	if (!Probe::ProbeHeader(header, Filename))
+	{
+		ProbeFailed = true;
+		return false;
+	}
+
+	Cached_PrimaryWidth		= header.Width;
+	Cached_PrimaryHeight	= header.Height;
+	// Headers are not trusted so the area is worked out in 64 bits and clamped.
+	int64 area = int64(header.Width) * int64(header.Height);
+	Cached_PrimaryArea		= int(tMath::tClamp(area, int64(0), int64(INT_MAX)));
+	return true;
+}
+
+
 void Image::UnrequestThumbnail()
 {
 	if (ThumbnailRequested && !ThumbnailThreadRunning && !ThumbnailPicture.IsValid())
@@ -2221,6 +2618,125 @@ void Image::RequestInvalidateThumbnail()
 }
 
 
+bool Image::RequestBackgroundLoad(bool loadParamsFromConfig)
+{
+	if (IsLoaded())
+		return false;
+
+	LoadCancelled = false;
+	if (LoadThreadRunning)
+		return true;
+
+	// The loader is set up here so the worker never reads anything belonging to this image.
+	Image* loader = new Image(Filename);
+	loader->FileModTime						= FileModTime;
+	loader->FileSizeB						= FileSizeB;
+	loader->LoadParams_ASTC					= LoadParams_ASTC;
+	loader->LoadParams_DDS					= LoadParams_DDS;
+	loader->LoadParams_PVR					= LoadParams_PVR;
+	loader->LoadParams_EXR					= LoadParams_EXR;
+	loader->LoadParams_HDR					= LoadParams_HDR;
+	loader->LoadParams_TGA					= LoadParams_TGA;
+	loader->LoadParams_JPG					= LoadParams_JPG;
+	loader->LoadParams_KTX					= LoadParams_KTX;
+	loader->LoadParams_PKM					= LoadParams_PKM;
+	loader->LoadParams_PNG					= LoadParams_PNG;
+	loader->LoadParams_DetectAPNGInsidePNG	= LoadParams_DetectAPNGInsidePNG;
+	loader->LoadParams_ReduceWidth			= LoadParams_ReduceWidth;
+	loader->LoadParams_ReduceHeight			= LoadParams_ReduceHeight;
+	loader->LoadParams_RegionEnabled		= LoadParams_RegionEnabled;
+	loader->LoadParams_Region				= LoadParams_Region;
+
+	LoadResult = loader;
+	LoadThreadRunning = true;
+	LoadStartTime = tSystem::tGetTime();
+	LoadThreadFlag.test_and_set();
+	LoadThread = std::thread
+	(
+		[this, loader, loadParamsFromConfig]
+		{
+			loader->Load(loadParamsFromConfig);
+			LoadThreadFlag.clear();
+		}
+	);
+	return true;
+}
+
+
+void Image::DiscardBackgroundLoad()
+{
+	if (!LoadThreadRunning)
+		return;
+
+	LoadThread.join();
+	LoadThreadRunning = false;
+	LoadCancelled = false;
+	delete LoadResult;
+	LoadResult = nullptr;
+}
+
+
+bool Image::UpdateBackgroundLoad()
+{
+	if (!LoadThreadRunning || LoadThreadFlag.test_and_set())
+		return false;
+
+	LoadThread.join();
+	LoadThreadRunning = false;
+	Image* loader = LoadResult;
+	LoadResult = nullptr;
+
+	// A synchronous load may have happened while the worker was busy. In that case the worker's result is stale.
+	bool publish = !LoadCancelled && !IsLoaded();
+	if (publish && loader->IsLoaded())
+		TakeLoaded(*loader);
+
+	delete loader;
+	return publish;
+}
+
+
+void Image::TakeLoaded(Image& loader)
+{
+	Unbind();
+	Pictures.Clear();
+	while (tPicture* picture = loader.Pictures.Remove())
+		Pictures.Append(picture);
+
+	if (loader.AltPicture.IsValid())
+		AltPicture.Set(loader.AltPicture);
+	else
+		AltPicture.Clear();
+	AltPictureTyp		= loader.AltPictureTyp;
+
+	PixelsVersion++;
+	Info				= loader.Info;
+	MFT					= loader.MFT;
+	LoadRegionApplied	= loader.LoadRegionApplied;
+	Dirty				= loader.Dirty;
+	LoadedTime			= loader.LoadedTime;
+	ArrayLayerNum		= loader.ArrayLayerNum;
+	MaxArrayLayers		= loader.MaxArrayLayers;
+	MipLevelNum			= loader.MipLevelNum;
+	MaxMipLevels		= loader.MaxMipLevels;
+
+	// Texture arrays keep the file open for lazy layer loads.
+	if (loader.CachedKTXImage)
+	{
+		delete CachedKTXImage;
+		CachedKTXImage = loader.CachedKTXImage;
+		CachedKTXFilename = loader.CachedKTXFilename;
+		loader.CachedKTXImage = nullptr;
+	}
+
+	// Only some loaders fill these in.
+	if (loader.Cached_MetaData.IsValid())
+		Cached_MetaData = loader.Cached_MetaData;
+	if (Filetype == tFileType::WEBP)
+		BackgroundColourOverride = loader.BackgroundColourOverride;
+}
+
+
 void Image::Play()
 {
 	FrameCurrCountdown = FrameDurationPreviewEnabled ? FrameDurationPreview : GetCurrentPic()->Duration;
@@ -14,6 +14,7 @@
 
 #pragma once
 #include <thread>
+#include <functional>
 #include <atomic>
 #include <glad/glad.h>
 #include <Foundation/tList.h>
@@ -44,6 +45,8 @@
 #include <Image/tImageKTX.h>
 #include "Config.h"
 #include "Undo.h"
+#include "ImageRegion.h"
+#include "ImageResidency.h"
 namespace tImage { class tLayer; }
 namespace Viewer
 {
@@ -82,6 +85,23 @@ public:
 	tImage::tImagePNG::LoadParams  LoadParams_PNG;
 	bool LoadParams_DetectAPNGInsidePNG = false;
 
+	// Set when it is known that the pictures will be resized down right after loading, for example when the first CLI
+	// operation is a resize. The values are the resize arguments where 0 means computed from the other dimension to
+	// keep the aspect ratio. After decoding, a smaller mipmap is used if there is one, otherwise pictures are box
+	// filtered down by a power of two, as long as they stay at least the resize target. Reductions that would change
+	// the aspect ratio used for a computed dimension are not made. The resize itself must still be applied. This is an
+	// approximate speed-up of the resize only. The decode is still full size, so decode time and peak memory are not
+	// reduced, and the final pixels may differ slightly from resizing the full-size image.
+	int LoadParams_ReduceWidth = 0;
+	int LoadParams_ReduceHeight = 0;
+
+	// Set when only a region of the image is needed, for example when the first CLI operation is a crop. If the file
+	// layout allows it only that region is read and the pictures are exactly what the crop would produce. Use
+	// IsLoadRegionApplied after loading to find out if the crop still needs to be done.
+	bool LoadParams_RegionEnabled = false;
+	Region::Rect LoadParams_Region;
+	bool IsLoadRegionApplied() const																					{ return LoadRegionApplied; }
+
 	void RegenerateShuffleValue();
 	void Play();
 	void Stop();
@@ -124,8 +144,9 @@ public:
 	// any paramteres used for saving that are stored in the viewer config file will override the setting in the save
 	// param structures above. Parameters not in the config will use whatever is in the structs. If useConfigSaveParams
 	// is false, the parameter structs above are used exclusively. Is onlyCurrentPic is true, only the single frame
-	// defined by FrameNum will be saved. Returns success.
-	bool Save(const tString& outFile, tSystem::tFileType fileType, bool useConfigSaveParams = true, bool onlyCurrentPic = false) const;
+	// defined by FrameNum will be saved. If frameNum is >= 0 it is used in place of FrameNum. Since Save is const,
+	// different frames may be saved from different threads this way. Returns success.
+	bool Save(const tString& outFile, tSystem::tFileType fileType, bool useConfigSaveParams = true, bool onlyCurrentPic = false, int frameNum = -1) const;
 
 	int GetNumFrames() const																							{ return Pictures.Count(); }
 	int GetNumPictures() const																							{ return Pictures.Count(); }
@@ -148,11 +169,29 @@ public:
 	bool Unload(bool force = false);
 	float GetLoadedTime() const																							{ return LoadedTime; }
 
+	// Approx memory held by the image. Pixel memory is the decoded pictures and alt picture. Texture memory is what has
+	// been uploaded to VRAM including mipmaps, not counting the thumbnail. Undo memory is the pictures kept for undo
+	// and redo. ClearUndo drops the history but leaves the pictures and dirty flag as they are.
+	int64 GetPixelMemBytes() const;
+	int64 GetTextureMemBytes() const;
+	int64 GetUndoMemBytes() const																						{ return UndoStack.GetMemSizeBytes(); }
+	void ClearUndo()																									{ UndoStack.Clear(); }
+
+	// Owned by the viewer's residency list. See ImageResidency.h.
+	Residency::Node ResidencyNode;
+
 	// Bind to a texture ID and load into VRAM. If already in VRAM, it makes the texture current. Since some ImGui
 	// functions require a texture ID as parameter, this function return the ID. If the alt image is enabled, the bound
-	// texture and ID will be the alt image's. Returns 0 (invalid id) if there was a problem.
+	// texture and ID will be the alt image's. Returns 0 (invalid id) if there was a problem. Only the current picture
+	// gets a texture. While playing, the next TextureLookAhead frames in play order are uploaded too so frame changes
+	// don't wait on an upload.
 	uint64 Bind();
 	void Unbind();
+	static const int TextureLookAhead															= 2;
+
+	// Releases textures of pictures other than the current one and its look-ahead frames until the image's textures
+	// use at most maxBytes. Frames that will be shown last in play order go first. Returns the number released.
+	int ReleaseFrameTextures(int64 maxBytes);
 	void InvalidateTexture();  // Force texture reload on next Bind()
 	void BackupOriginalArrayLayerData();   // Backup original image data before array layer modification
 	void RestoreOriginalArrayLayerData();  // Restore original image data
@@ -168,13 +207,14 @@ public:
 	// The primary one is the first one.
 	tImage::tPicture* GetPrimaryPic() const																				{ return Pictures.First(); }
 	tImage::tPicture* GetFirstPic() const																				{ return Pictures.First(); }
-	tImage::tPicture* GetCurrentPic() const																				
-	{ 
+	tImage::tPicture* GetCurrentPic() const																				{ return GetFramePic(FrameNum); }
+	tImage::tPicture* GetFramePic(int frameNum) const
+	{
 		// For lazy-loaded TextureArrays, we only have the current layer loaded, so use FrameNum=0
 		// For regular multi-frame images, use FrameNum to navigate through frames
-		tImage::tPicture* pic = Pictures.First(); 
-		for (int i = 0; i < FrameNum; i++) 
-			pic = pic ? pic->Next() : nullptr; 
+		tImage::tPicture* pic = Pictures.First();
+		for (int i = 0; i < frameNum; i++)
+			pic = pic ? pic->Next() : nullptr;
 		return pic;
 	}
 	const tList<tImage::tPicture>& GetPictures() const																	{ return Pictures; }
@@ -186,7 +226,10 @@ public:
 
 	// Quantize image colours based on a fixed palette. numColours must be 256 or less. checkExact means no change to
 	// the image will be made if it already contains fewer colours than numColours already. This may or may not be
-	// desireable as the computed or fixed palette would not be used.
+	// desireable as the computed or fixed palette would not be used. Each frame gets its own palette so the frames are
+	// quantized at the same time. The other methods below quantize the frames one after the other. The palette
+	// algorithms themselves, including the histogram, Wu moments, NeuQuant learning, spatial filtering, and dithered
+	// remap, are in the tacent library and each runs on a single thread. The checkExact census is multithreaded.
 	void QuantizeFixed(int numColours, bool checkExact = true);
 
 	// Similar to above but uses spatial quantization to generate the palette. If ditherLevel is 0.0 it will compute a
@@ -201,6 +244,16 @@ public:
 	// Similar to above but uses Wu algorighm to generate the palette.
 	void QuantizeWu(int numColours, bool checkExact = true);
 
+	// Returns the number of unique RGB colours over all frames. Alpha is ignored, the same as the checkExact test of the
+	// quantize functions. If limit is >= 0 the count stops at limit+1, which is much faster when only a bound is
+	// needed. A full count of a large image is slow so the result should be kept.
+	int CountUniqueColours(int limit = -1) const;
+
+	// The number of unique RGB colours in the current frame, counted on a worker thread so large images don't stall
+	// the UI. Call it every frame. It returns -1 until the count for the current pixels is ready. Edits and undo/redo
+	// invalidate the count.
+	int GetCurrentColourCount();
+
 	bool AdjustmentBegin();
 	enum class AdjChan { RGB, R, G, B, A };	// Adjustment is to individual RGBA channels or RGB/Intensity (default).
 	static comp_t ComponentBits(AdjChan);	// Converts to tChannels.
@@ -256,11 +309,17 @@ public:
 	// Note that the alpha of the supplied colour is ignored (since we use finalAlpha).
 	// Note that unspecified RGB channels are keft unmodified.
 	void AlphaBlendColour(const tColour4b& blendColour, comp_t = tCompBit_RGB, int finalAlpha = 255);
+
+	// Remaps every pixel of every frame in a single pass. Each destination channel c (RGBA order) is set to
+	// lut[c][srcValue] where srcValue is the pixel's value in channel source[c]. Any sequence of per-channel curves,
+	// swizzles, and channel fills can be expressed this way. If the remap would not change any pixel nothing is done,
+	// no undo is pushed, the image stays clean, and false is returned.
+	bool RemapChannels(const uint8 lut[4][256], const int source[4]);
 	void SetFrameDuration(float duration, bool allFrames = false);
 
 	// Undo and redo functions.
-	void Undo()																											{ UndoStack.Undo(Pictures, Dirty); }
-	void Redo()																											{ UndoStack.Redo(Pictures, Dirty); }
+	void Undo()																											{ UndoStack.Undo(Pictures, Dirty); PixelsVersion++; }
+	void Redo()																											{ UndoStack.Redo(Pictures, Dirty); PixelsVersion++; }
 	bool IsUndoAvailable() const																						{ return UndoStack.UndoAvailable(); }
 	bool IsRedoAvailable() const																						{ return UndoStack.RedoAvailable(); }
 	tString GetUndoDesc() const																							{ tString desc; tsPrintf(desc, "[%s]", UndoStack.GetUndoDesc().Chr()); return desc; }
@@ -268,6 +327,7 @@ public:
 
 	// Since from outside this class you can save to any filename, we need the ability to clear the dirty flag.
 	void ClearDirty()																									{ Dirty = false; }
+	void SetDirty()																										{ Dirty = true; }
 	bool IsDirty() const																								{ return Dirty; }
 
 	struct ImgInfo
@@ -305,6 +365,29 @@ public:
 	uint64 BindThumbnail();
 	inline static int GetThumbnailNumThreadsRunning()																	{ return ThumbnailNumThreadsRunning; }
 
+	// Loading can also be done on a separate thread so the UI stays responsive while a large image decodes. The decode
+	// goes into a separate image and nothing in this one changes until UpdateBackgroundLoad, called from the main
+	// thread, finds the worker done and moves the finished pictures over. RequestBackgroundLoad returns false if the
+	// image is already loaded. If a load is already pending it is reused and any earlier cancel is undone. Decoders
+	// can't be interrupted, so CancelBackgroundLoad lets the worker finish and throws the result away. Call
+	// UpdateBackgroundLoad every frame while a load is pending. It returns true once, when the load is over, and
+	// IsLoaded tells you if it succeeded. A cancelled load never publishes.
+	bool RequestBackgroundLoad(bool loadParamsFromConfig = true);
+	void CancelBackgroundLoad()																							{ LoadCancelled = true; }
+	bool UpdateBackgroundLoad();
+	bool IsBackgroundLoadPending() const																				{ return LoadThreadRunning; }
+	bool IsBackgroundLoadCancelled() const																				{ return LoadCancelled; }
+
+	// Waits for a pending load and throws the result away. Unlike a cancel, the pending load can't be reused later.
+	// Call this when the file has been written since the load started as the decode may be of the old contents.
+	void DiscardBackgroundLoad();
+	float GetBackgroundLoadStartTime() const																			{ return LoadStartTime; }
+
+	// Fills in the Cached_ dimensions from the file header if they are not yet known, without loading or generating a
+	// thumbnail. Does nothing while a thumbnail worker is active as the worker owns those members. Returns true if the
+	// dimensions are available after the call. A header that can't be read is only tried once.
+	bool ProbeDimensions();
+
 	ImgInfo Info;										// Info is only valid AFTER loading.
 	tString Filename;									// Valid before load.
 	tSystem::tFileType Filetype;						// Valid before load. Based on extension.
@@ -338,7 +421,7 @@ public:
 
 private:
 	bool UndoEnabled = true;
-	void PushUndo(const tString& desc)																					{ if (UndoEnabled) UndoStack.Push(Pictures, desc, Dirty); }
+	void PushUndo(const tString& desc)																					{ if (UndoEnabled) UndoStack.Push(Pictures, desc, Dirty); PixelsVersion++; }
 	void PopUndo()																										{ if (UndoEnabled) UndoStack.Pop(); }
 
 	// There are multiple pictures for a few reasons. Images with multiple frames (gifs, exrs, tiffs, webps etc) store
@@ -370,6 +453,28 @@ private:
 	static void GenerateThumbnailBridge(Image*);
 	void GenerateThumbnail();
 
+	// The background loader owns LoadResult while LoadThreadRunning is true and the flag is set.
+	bool LoadThreadRunning = false;
+	std::atomic<bool> LoadCancelled = false;
+	float LoadStartTime = 0.0f;
+	std::thread LoadThread;
+	std::atomic_flag LoadThreadFlag = ATOMIC_FLAG_INIT;
+	Image* LoadResult = nullptr;
+
+	// Moves everything a load produces from the loader into this image. Main thread only.
+	void TakeLoaded(Image& loader);
+
+	// Bumped whenever the pixels of any picture may have changed. Every edit pushes an undo first so that is where
+	// most edits are caught. The colour count worker owns ColourCountPicture while it is running and the flag is set.
+	uint32 PixelsVersion = 0;
+	bool ColourCountThreadRunning = false;
+	std::thread ColourCountThread;
+	std::atomic_flag ColourCountThreadFlag = ATOMIC_FLAG_INIT;
+	tImage::tPicture ColourCountPicture;
+	int ColourCountResult = -1;
+	int ColourCountFrame = -1;							// The frame and version being counted or last counted.
+	uint32 ColourCountVersion = 0;
+
 	// Zero is invalid and means texture has never been bound and loaded into VRAM.
 	uint TexIDAlt			= 0;
 	uint TexIDThumbnail		= 0;
@@ -383,11 +488,29 @@ private:
 	void MultiSurfaceCreateAltCubemapPicture(const teList<tImage::tLayer> layers[tImage::tFaceIndex::tFaceIndex_NumFaces]);
 	void MultiSurfaceCreateAltMipmapPicture(const teList<tImage::tLayer>&);
 
+	// Applies LoadParams_ReduceWidth and LoadParams_ReduceHeight to the freshly loaded pictures. Returns true if any
+	// picture was changed.
+	bool ReduceLoadedPictures();
+	static void ReducePicture(tImage::tPicture&, int factor);
+
+	// Used by the quantize functions for checkExact. True if checkExact is set and the picture already has no more
+	// than numColours colours, in which case it is left alone.
+	static bool FitsInColours(const tImage::tPicture&, int numColours, bool checkExact);
+
+	// Calls fn on every picture. The pictures are independent so they are done at the same time.
+	void ForEachPicture(const std::function<void(tImage::tPicture*)>& fn);
+
 	void GetGLFormatInfo(GLint& srcFormat, GLenum& srcType, GLint& dstFormat, bool& compressed, tImage::tPixelFormat);
 	void BindLayers(const tList<tImage::tLayer>&, uint texID);
 
+	// Creates the texture for a single picture and leaves it bound.
+	void BindPicture(tImage::tPicture&);
+	int64 GetPictureTextureBytes(const tImage::tPicture&) const;
+
 	float LoadedTime = -1.0f;
 	bool Dirty = false;
+	bool LoadRegionApplied = false;
+	bool ProbeFailed = false;
 	MultiFrameType MFT = MultiFrameType::None;
 
 	// Instance-level KTX cache (safer than static)
@@ -0,0 +1,750 @@
+// ImageProbe.cpp
+//
+// Reads image dimensions, frame counts, and where possible the source pixel format from file headers without decoding
+// any pixel data. This is much faster than a full load. It is used to plan work, for example to estimate how much memory
+// a decoded image will need, for the --probe CLI option, and by the viewer to sort by dimensions before thumbnails exist.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <Foundation/tFundamentals.h>
+#include <System/tFile.h>
+#include "ImageProbe.h"
+using namespace tSystem;
+using namespace tImage;
+
+
+namespace Viewer
+{
+namespace Probe
+{
+	// A small buffered reader. Most probes only look at the first few hundred bytes but some (GIF, WEBP, JPG) need to
+	// hop through the file. Reads past the end return zeros and set the Failed flag.
+	class Reader
+	{
+	public:
+		Reader(const tString& filename)																				{ File = tOpenFile(filename.Chr(), "rb"); FileSize = File ? tGetFileSize(filename) : 0; }
+		~Reader()																									{ if (File) tCloseFile(File); }
+		bool IsOpen() const																							{ return File != nullptr; }
+
+		// Makes sure bytes [pos, pos+count) are in the buffer and returns a pointer to them. count must be <= BufferSize.
+		const uint8* Peek(int pos, int count);
+		uint8 U8(int pos)																							{ const uint8* p = Peek(pos, 1); return p ? p[0] : 0; }
+		uint32 LE16(int pos)																						{ const uint8* p = Peek(pos, 2); return p ? (p[0] | (p[1] << 8)) : 0; }
+		uint32 BE16(int pos)																						{ const uint8* p = Peek(pos, 2); return p ? ((p[0] << 8) | p[1]) : 0; }
+		uint32 LE24(int pos)																						{ const uint8* p = Peek(pos, 3); return p ? (p[0] | (p[1] << 8) | (p[2] << 16)) : 0; }
+		uint32 LE32(int pos)																						{ const uint8* p = Peek(pos, 4); return p ? (p[0] | (p[1] << 8) | (p[2] << 16) | (uint32(p[3]) << 24)) : 0; }
+		uint32 BE32(int pos)																						{ const uint8* p = Peek(pos, 4); return p ? ((uint32(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]) : 0; }
+		bool Match(int pos, const char* str)																		{ int n = tStd::tStrlen(str); const uint8* p = Peek(pos, n); return p && (tStd::tMemcmp(p, str, n) == 0); }
+
+		// Moves pos past a chunk of length bytes plus overhead bytes. Lengths come straight from the file so anything
+		// that runs past the end of the file or doesn't move pos forward sets Failed and returns false.
+		bool Skip(int& pos, uint32 length, int overhead);
+
+		bool Failed = false;
+		static const int BufferSize = 64*1024;
+
+	private:
+		tFileHandle File = nullptr;
+		int64 FileSize = 0;
+		uint8 Buffer[BufferSize];
+		int BufferPos = 0;
+		int BufferCount = 0;
+	};
+
+	bool ProbePNG(HeaderInfo&, Reader&);
+	bool ProbeJPG(HeaderInfo&, Reader&);
+	bool ProbeTGA(HeaderInfo&, Reader&);
+	bool ProbeBMP(HeaderInfo&, Reader&);
+	bool ProbeQOI(HeaderInfo&, Reader&);
+	bool ProbeGIF(HeaderInfo&, Reader&);
+	bool ProbeWEBP(HeaderInfo&, Reader&);
+	bool ProbeEXR(HeaderInfo&, Reader&);
+	bool ProbeHDR(HeaderInfo&, Reader&);
+	bool ProbeDDS(HeaderInfo&, Reader&);
+	bool ProbeKTX(HeaderInfo&, Reader&);
+	bool ProbeKTX2(HeaderInfo&, Reader&);
+	bool ProbePVR(HeaderInfo&, Reader&);
+	bool ProbeASTC(HeaderInfo&, Reader&);
+	bool ProbePKM(HeaderInfo&, Reader&);
+	bool ProbeICO(HeaderInfo&, Reader&);
+	bool ProbeTIFF(HeaderInfo&, Reader&);
+
+	tPixelFormat GetDXGIPixelFormat(uint32 dxgiFormat);
+
+	// Face, layer, and depth counts come straight from the header. A count of 0 means 1. Counts beyond these limits
+	// are treated as a bad header rather than multiplied out, in which case false is returned.
+	bool GetNumFrames(int& numFrames, uint32 numFaces, uint32 numLayers, uint32 depth = 1);
+	bool GetNumMipmaps(int& numMipmaps, uint32 count);
+	const uint32 MaxFaces								= 6;
+	const int64 MaxFrames								= 1 << 16;
+	const uint32 MaxMipmaps								= 32;
+}
+}
+
+
+const uint8* Viewer::Probe::Reader::Peek(int pos, int count)
+{
+	if (!File || (pos < 0) || (count > BufferSize))
+	{
+		Failed = true;
+		return nullptr;
+	}
+
+	if ((pos >= BufferPos) && (pos+count <= BufferPos+BufferCount))
+		return Buffer + (pos - BufferPos);
+
+	tFileSeek(File, pos, tSeekOrigin::Beginning);
+	BufferPos = pos;
+	BufferCount = tReadFile(File, Buffer, BufferSize);
+	if (BufferCount < count)
+	{
+		BufferCount = tMath::tMax(BufferCount, 0);
+		Failed = true;
+		return nullptr;
+	}
+
+	return Buffer;
+}
+
+
+bool Viewer::Probe::Reader::Skip(int& pos, uint32 length, int overhead)
+{
+	int64 next = int64(pos) + int64(overhead) + int64(length);
+	if ((length > uint32(INT_MAX)) || (next > FileSize) || (next > INT_MAX) || (next <= pos))
+	{
+		Failed = true;
+		return false;
+	}
+
+	pos = int(next);
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeHeader(HeaderInfo& info, const tString& filename)
+{
+	info = HeaderInfo();
+	info.FileType = tGetFileType(filename);
+	Reader reader(filename);
+	if (!reader.IsOpen())
+		return false;
+
+	bool ok = false;
+	switch (info.FileType)
+	{
+		case tFileType::PNG:
+		case tFileType::APNG:	ok = ProbePNG(info, reader);	break;
+		case tFileType::JPG:	ok = ProbeJPG(info, reader);	break;
+		case tFileType::TGA:	ok = ProbeTGA(info, reader);	break;
+		case tFileType::BMP:	ok = ProbeBMP(info, reader);	break;
+		case tFileType::QOI:	ok = ProbeQOI(info, reader);	break;
+		case tFileType::GIF:	ok = ProbeGIF(info, reader);	break;
+		case tFileType::WEBP:	ok = ProbeWEBP(info, reader);	break;
+		case tFileType::EXR:	ok = ProbeEXR(info, reader);	break;
+		case tFileType::HDR:	ok = ProbeHDR(info, reader);	break;
+		case tFileType::DDS:	ok = ProbeDDS(info, reader);	break;
+		case tFileType::KTX:	ok = ProbeKTX(info, reader);	break;
+		case tFileType::KTX2:	ok = ProbeKTX2(info, reader);	break;
+		case tFileType::PVR:	ok = ProbePVR(info, reader);	break;
+		case tFileType::ASTC:	ok = ProbeASTC(info, reader);	break;
+		case tFileType::PKM:	ok = ProbePKM(info, reader);	break;
+		case tFileType::ICO:	ok = ProbeICO(info, reader);	break;
+		case tFileType::TIFF:	ok = ProbeTIFF(info, reader);	break;
+		default:												break;
+	}
+
+	return ok && info.IsValid();
+}
+
+
+bool Viewer::Probe::ProbePNG(HeaderInfo& info, Reader& reader)
+{
+	// IHDR is always the first chunk. For APNG the acTL chunk, if present, is somewhere before the first IDAT.
+	if (!reader.Match(0, "\x89PNG\r\n\x1A\n") || !reader.Match(12, "IHDR"))
+		return false;
+
+	info.Width = reader.BE32(16);
+	info.Height = reader.BE32(20);
+	info.NumFrames = 1;
+
+	// Colour type 2 is RGB, 6 is RGBA, and 3 is palettized. Greyscale types are left as unknown.
+	uint8 bitDepth = reader.U8(24);
+	uint8 colourType = reader.U8(25);
+	if (bitDepth == 8)
+	{
+		switch (colourType)
+		{
+			case 2:	info.PixelFormat = tPixelFormat::R8G8B8;		break;
+			case 6:	info.PixelFormat = tPixelFormat::R8G8B8A8;		break;
+		}
+	}
+	if ((colourType == 3) && (bitDepth >= 1) && (bitDepth <= 8))
+		info.PixelFormat = tPixelFormat(int(tPixelFormat::PAL1BIT) + bitDepth - 1);
+
+	int pos = 8;
+	while (!reader.Failed)
+	{
+		uint32 length = reader.BE32(pos);
+		if (reader.Match(pos+4, "IDAT") || reader.Match(pos+4, "IEND"))
+			break;
+		if (reader.Match(pos+4, "acTL"))
+		{
+			info.NumFrames = tMath::tMax(int(reader.BE32(pos+8)), 1);
+			break;
+		}
+		if (!reader.Skip(pos, length, 12))
+			break;
+	}
+
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeJPG(HeaderInfo& info, Reader& reader)
+{
+	// Walk the marker segments until a start-of-frame. APPn segments (EXIF etc) may come first.
+	if ((reader.U8(0) != 0xFF) || (reader.U8(1) != 0xD8))
+		return false;
+
+	int pos = 2;
+	while (!reader.Failed)
+	{
+		if (reader.U8(pos) != 0xFF)
+			return false;
+		uint8 marker = reader.U8(pos+1);
+		if (marker == 0xFF)
+		{
+			pos++;
+			continue;
+		}
+
+		bool startOfFrame = (marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC);
+		if (startOfFrame)
+		{
+			info.Height = reader.BE16(pos+5);
+			info.Width = reader.BE16(pos+7);
+			info.NumFrames = 1;
+			if (reader.U8(pos+9) == 3)
+				info.PixelFormat = tPixelFormat::R8G8B8;
+			return !reader.Failed;
+		}
+
+		if ((marker == 0xD9) || (marker == 0xDA))
+			return false;
+		pos += 2 + reader.BE16(pos+2);
+	}
+
+	return false;
+}
+
+
+bool Viewer::Probe::ProbeTGA(HeaderInfo& info, Reader& reader)
+{
+	// TGA has no magic number at the start. We check the image type is one we know.
+	uint8 imageType = reader.U8(2);
+	bool knownType = (imageType == 1) || (imageType == 2) || (imageType == 3) || (imageType == 9) || (imageType == 10) || (imageType == 11);
+	if (!knownType)
+		return false;
+
+	info.Width = reader.LE16(12);
+	info.Height = reader.LE16(14);
+	info.NumFrames = 1;
+	switch (reader.U8(16))
+	{
+		case 24:	info.PixelFormat = tPixelFormat::B8G8R8;		break;
+		case 32:	info.PixelFormat = tPixelFormat::B8G8R8A8;		break;
+	}
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeBMP(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "BM"))
+		return false;
+
+	uint32 dibSize = reader.LE32(14);
+	if (dibSize == 12)
+	{
+		info.Width = reader.LE16(18);
+		info.Height = reader.LE16(20);
+	}
+	else
+	{
+		// Height is negative for top-down bitmaps.
+		info.Width = tMath::tAbs(int(reader.LE32(18)));
+		info.Height = tMath::tAbs(int(reader.LE32(22)));
+		switch (reader.LE16(28))
+		{
+			case 24:	info.PixelFormat = tPixelFormat::B8G8R8;		break;
+			case 32:	info.PixelFormat = tPixelFormat::B8G8R8A8;		break;
+		}
+	}
+	info.NumFrames = 1;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeQOI(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "qoif"))
+		return false;
+
+	info.Width = reader.BE32(4);
+	info.Height = reader.BE32(8);
+	info.NumFrames = 1;
+	info.PixelFormat = (reader.U8(12) == 4) ? tPixelFormat::R8G8B8A8 : tPixelFormat::R8G8B8;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeGIF(HeaderInfo& info, Reader& reader)
+{
+	// The frame count is found by walking the block structure. The LZW data is skipped sub-block by sub-block without
+	// being decoded.
+	if (!reader.Match(0, "GIF8"))
+		return false;
+
+	info.Width = reader.LE16(6);
+	info.Height = reader.LE16(8);
+	uint8 flags = reader.U8(10);
+	info.PixelFormat = tPixelFormat(int(tPixelFormat::PAL1BIT) + (flags & 0x07));
+	int pos = 13;
+	if (flags & 0x80)
+		pos += 3 * (1 << ((flags & 0x07) + 1));
+
+	auto skipSubBlocks = [&reader](int p) -> int
+	{
+		while (!reader.Failed)
+		{
+			uint8 size = reader.U8(p++);
+			if (size == 0)
+				break;
+			p += size;
+		}
+		return p;
+	};
+
+	int numFrames = 0;
+	while (!reader.Failed)
+	{
+		uint8 block = reader.U8(pos);
+		if (block == 0x2C)
+		{
+			numFrames++;
+			uint8 localFlags = reader.U8(pos+9);
+			pos += 10;
+			if (localFlags & 0x80)
+				pos += 3 * (1 << ((localFlags & 0x07) + 1));
+			pos = skipSubBlocks(pos+1);
+		}
+		else if (block == 0x21)
+		{
+			pos = skipSubBlocks(pos+2);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// A truncated file still has its dimensions. We report at least one frame.
+	info.NumFrames = tMath::tMax(numFrames, 1);
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeWEBP(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "RIFF") || !reader.Match(8, "WEBP"))
+		return false;
+
+	int riffEnd = 8 + int(reader.LE32(4));
+	int pos = 12;
+	int numFrames = 0;
+	while ((pos+8 <= riffEnd) && !reader.Failed)
+	{
+		uint32 size = reader.LE32(pos+4);
+		int data = pos+8;
+		if (reader.Match(pos, "VP8X"))
+		{
+			info.Width = reader.LE24(data+4) + 1;
+			info.Height = reader.LE24(data+7) + 1;
+		}
+		else if (reader.Match(pos, "VP8 ") && !info.IsValid())
+		{
+			info.Width = reader.LE16(data+6) & 0x3FFF;
+			info.Height = reader.LE16(data+8) & 0x3FFF;
+			numFrames = 1;
+		}
+		else if (reader.Match(pos, "VP8L") && !info.IsValid())
+		{
+			uint32 bits = reader.LE32(data+1);
+			info.Width = (bits & 0x3FFF) + 1;
+			info.Height = ((bits >> 14) & 0x3FFF) + 1;
+			numFrames = 1;
+		}
+		else if (reader.Match(pos, "ANMF"))
+		{
+			numFrames++;
+		}
+
+		// Chunks are padded to an even size.
+		if (!reader.Skip(pos, size, 8 + int(size & 1)))
+			break;
+	}
+
+	info.NumFrames = tMath::tMax(numFrames, 1);
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeEXR(HeaderInfo& info, Reader& reader)
+{
+	// The header is a list of attributes: name\0 type\0 size value. We want dataWindow (box2i). Only the first part of
+	// a multi-part file is looked at.
+	if (reader.LE32(0) != 0x01312F76)
+		return false;
+
+	int pos = 8;
+	while (!reader.Failed)
+	{
+		const uint8* p = reader.Peek(pos, 256);
+		if (!p)
+		{
+			// Near the end of the file. Try again with what is left.
+			reader.Failed = false;
+			p = reader.Peek(pos, 64);
+			if (!p)
+				return false;
+		}
+		if (p[0] == 0)
+			break;
+
+		std::string name((const char*)p, strnlen((const char*)p, 64));
+		int typePos = pos + int(name.length()) + 1;
+		const uint8* t = reader.Peek(typePos, 32);
+		if (!t)
+			return false;
+		std::string type((const char*)t, strnlen((const char*)t, 32));
+		int sizePos = typePos + int(type.length()) + 1;
+		uint32 size = reader.LE32(sizePos);
+		int valuePos = sizePos + 4;
+		if ((name == "dataWindow") && (type == "box2i"))
+		{
+			int xMin = int(reader.LE32(valuePos));
+			int yMin = int(reader.LE32(valuePos+4));
+			int xMax = int(reader.LE32(valuePos+8));
+			int yMax = int(reader.LE32(valuePos+12));
+			info.Width = xMax - xMin + 1;
+			info.Height = yMax - yMin + 1;
+			info.NumFrames = 1;
+			info.HighDynamicRange = true;
+			return !reader.Failed;
+		}
+		if (!reader.Skip(pos, size, valuePos - pos))
+			return false;
+	}
+
+	return false;
+}
+
+
+bool Viewer::Probe::ProbeHDR(HeaderInfo& info, Reader& reader)
+{
+	// Radiance header lines end with a blank line followed by the resolution string, usually "-Y h +X w".
+	const int maxHeader = 4096;
+	const uint8* p = reader.Peek(0, maxHeader);
+	int available = maxHeader;
+	if (!p)
+	{
+		reader.Failed = false;
+		for (available = 512; available >= 16; available /= 2)
+		{
+			p = reader.Peek(0, available);
+			if (p)
+				break;
+			reader.Failed = false;
+		}
+		if (!p)
+			return false;
+	}
+
+	if (tStd::tMemcmp(p, "#?", 2) != 0)
+		return false;
+
+	std::string header((const char*)p, available);
+	size_t blank = header.find("\n\n");
+	if (blank == std::string::npos)
+		return false;
+
+	std::string res = header.substr(blank+2, 64);
+	char yAxis[3] = { 0 };
+	char xAxis[3] = { 0 };
+	int h = 0, w = 0;
+	if (sscanf(res.c_str(), "%2s %d %2s %d", yAxis, &h, xAxis, &w) != 4)
+		return false;
+
+	// The axes may be swapped, in which case the first number is the width.
+	bool swapped = (yAxis[1] == 'X');
+	info.Width = swapped ? h : w;
+	info.Height = swapped ? w : h;
+	info.NumFrames = 1;
+	info.HighDynamicRange = true;
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeDDS(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "DDS "))
+		return false;
+
+	info.Height = reader.LE32(12);
+	info.Width = reader.LE32(16);
+	info.NumMipmaps = tMath::tMax(int(reader.LE32(32)), 1);
+
+	// Cubemaps have 6 faces. DX10 headers may also specify texture arrays.
+	int numFrames = 1;
+	const uint32 caps2Cubemap = 0x00000200;
+	if (reader.LE32(116) & caps2Cubemap)
+		numFrames = 6;
+
+	if		(reader.Match(88, "DXT1"))	info.PixelFormat = tPixelFormat::BC1DXT1;
+	else if	(reader.Match(88, "DXT2"))	info.PixelFormat = tPixelFormat::BC2DXT2DXT3;
+	else if	(reader.Match(88, "DXT3"))	info.PixelFormat = tPixelFormat::BC2DXT2DXT3;
+	else if	(reader.Match(88, "DXT4"))	info.PixelFormat = tPixelFormat::BC3DXT4DXT5;
+	else if	(reader.Match(88, "DXT5"))	info.PixelFormat = tPixelFormat::BC3DXT4DXT5;
+
+	if (reader.Match(88, "DX10"))
+	{
+		const uint32 miscCubemap = 0x00000004;
+		uint32 numFaces = (reader.LE32(136) & miscCubemap) ? 6 : 1;
+		if (!GetNumFrames(numFrames, numFaces, reader.LE32(140)))
+			return false;
+		info.PixelFormat = GetDXGIPixelFormat(reader.LE32(128));
+		info.HighDynamicRange = (info.PixelFormat == tPixelFormat::BC6U) || (info.PixelFormat == tPixelFormat::BC6S);
+	}
+	info.NumFrames = numFrames;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::GetNumFrames(int& numFrames, uint32 numFaces, uint32 numLayers, uint32 depth)
+{
+	if (numFaces > MaxFaces)
+		return false;
+
+	int64 frames = int64(tMath::tMax(numFaces, 1u)) * int64(tMath::tMax(numLayers, 1u)) * int64(tMath::tMax(depth, 1u));
+	if (frames > MaxFrames)
+		return false;
+
+	numFrames = int(frames);
+	return true;
+}
+
+
+bool Viewer::Probe::GetNumMipmaps(int& numMipmaps, uint32 count)
+{
+	if (count > MaxMipmaps)
+		return false;
+
+	numMipmaps = tMath::tMax(int(count), 1);
+	return true;
+}
+
+
+bool Viewer::Probe::ProbeKTX(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "\xABKTX 11\xBB\r\n\x1A\n"))
+		return false;
+
+	// The endianness field tells us if the rest of the header is byte-swapped.
+	bool swap = (reader.LE32(12) != 0x04030201);
+	auto field = [&reader, swap](int pos) -> uint32 { return swap ? reader.BE32(pos) : reader.LE32(pos); };
+
+	info.Width = int(field(36));
+	info.Height = tMath::tMax(int(field(40)), 1);
+	if (!GetNumFrames(info.NumFrames, field(52), field(48)) || !GetNumMipmaps(info.NumMipmaps, field(56)))
+		return false;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeKTX2(HeaderInfo& info, Reader& reader)
+{
+	if (!reader.Match(0, "\xABKTX 20\xBB\r\n\x1A\n"))
+		return false;
+
+	info.Width = reader.LE32(20);
+	info.Height = tMath::tMax(int(reader.LE32(24)), 1);
+	if (!GetNumFrames(info.NumFrames, reader.LE32(36), reader.LE32(32)))
+		return false;
+	if (!GetNumMipmaps(info.NumMipmaps, reader.LE32(40)))
+		return false;
+	return !reader.Failed;
+}
+
+
+tPixelFormat Viewer::Probe::GetDXGIPixelFormat(uint32 dxgiFormat)
+{
+	// Only the common formats. Anything else is reported as unknown.
+	switch (dxgiFormat)
+	{
+		case 28: case 29:	return tPixelFormat::R8G8B8A8;
+		case 87: case 91:	return tPixelFormat::B8G8R8A8;
+		case 71: case 72:	return tPixelFormat::BC1DXT1;
+		case 74: case 75:	return tPixelFormat::BC2DXT2DXT3;
+		case 77: case 78:	return tPixelFormat::BC3DXT4DXT5;
+		case 95:			return tPixelFormat::BC6U;
+		case 96:			return tPixelFormat::BC6S;
+		case 98: case 99:	return tPixelFormat::BC7;
+	}
+	return tPixelFormat::Invalid;
+}
+
+
+bool Viewer::Probe::ProbePVR(HeaderInfo& info, Reader& reader)
+{
+	// Version 3 headers start with 'PVR' 3. Legacy version 2 headers start with their size (44 or 52 bytes).
+	uint32 version = reader.LE32(0);
+	if (version == 0x03525650)
+	{
+		info.Height = reader.LE32(24);
+		info.Width = reader.LE32(28);
+		if (!GetNumFrames(info.NumFrames, reader.LE32(40), reader.LE32(36), reader.LE32(32)))
+			return false;
+		if (!GetNumMipmaps(info.NumMipmaps, reader.LE32(44)))
+			return false;
+		return !reader.Failed;
+	}
+
+	if ((version == 44) || (version == 52))
+	{
+		info.Height = reader.LE32(4);
+		info.Width = reader.LE32(8);
+
+		// The legacy header stores the number of mipmaps below the top level.
+		uint32 numSurfaces = (version == 52) ? reader.LE32(48) : 1;
+		uint32 numMipmaps = reader.LE32(12);
+		if ((numMipmaps >= MaxMipmaps) || !GetNumMipmaps(info.NumMipmaps, numMipmaps + 1))
+			return false;
+		if (!GetNumFrames(info.NumFrames, 1, numSurfaces))
+			return false;
+		return !reader.Failed;
+	}
+
+	return false;
+}
+
+
+bool Viewer::Probe::ProbeASTC(HeaderInfo& info, Reader& reader)
+{
+	if (reader.LE32(0) != 0x5CA1AB13)
+		return false;
+
+	// The ASTC pixel formats are contiguous and ordered by block size.
+	const int blockDims[][2] = { {4,4}, {5,4}, {5,5}, {6,5}, {6,6}, {8,5}, {8,6}, {8,8}, {10,5}, {10,6}, {10,8}, {10,10}, {12,10}, {12,12} };
+	int blockW = reader.U8(4);
+	int blockH = reader.U8(5);
+	for (int b = 0; b < int(sizeof(blockDims)/sizeof(*blockDims)); b++)
+		if ((blockDims[b][0] == blockW) && (blockDims[b][1] == blockH))
+			info.PixelFormat = tPixelFormat(int(tPixelFormat::FirstASTC) + b);
+
+	info.Width = reader.LE24(7);
+	info.Height = reader.LE24(10);
+	info.NumFrames = tMath::tMax(int(reader.LE24(13)), 1);
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbePKM(HeaderInfo& info, Reader& reader)
+{
+	// The header stores both the padded (multiple of 4) and original dimensions. We want the original.
+	if (!reader.Match(0, "PKM "))
+		return false;
+
+	info.Width = reader.BE16(12);
+	info.Height = reader.BE16(14);
+	info.NumFrames = 1;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeICO(HeaderInfo& info, Reader& reader)
+{
+	// Each directory entry is a separate picture. A stored dimension of 0 means 256.
+	if ((reader.LE16(0) != 0) || (reader.LE16(2) != 1))
+		return false;
+
+	int numEntries = reader.LE16(4);
+	if (numEntries <= 0)
+		return false;
+
+	for (int e = 0; e < numEntries; e++)
+	{
+		int w = reader.U8(6 + e*16);
+		int h = reader.U8(7 + e*16);
+		w = w ? w : 256;
+		h = h ? h : 256;
+		if (w*h > info.Width*info.Height)
+		{
+			info.Width = w;
+			info.Height = h;
+		}
+	}
+	info.NumFrames = numEntries;
+	return !reader.Failed;
+}
+
+
+bool Viewer::Probe::ProbeTIFF(HeaderInfo& info, Reader& reader)
+{
+	// Every image file directory (IFD) is a page. The dimensions come from the first one.
+	uint32 order = reader.LE32(0);
+	bool bigEndian = (order == 0x2A004D4D);
+	if (!bigEndian && (order != 0x002A4949))
+		return false;
+
+	auto u16 = [&reader, bigEndian](int pos) -> uint32 { return bigEndian ? reader.BE16(pos) : reader.LE16(pos); };
+	auto u32 = [&reader, bigEndian](int pos) -> uint32 { return bigEndian ? reader.BE32(pos) : reader.LE32(pos); };
+
+	const int maxPages = 65536;
+	int numPages = 0;
+	uint32 ifd = u32(4);
+	while ((ifd != 0) && (numPages < maxPages) && !reader.Failed)
+	{
+		int numEntries = u16(ifd);
+		if (numPages == 0)
+		{
+			for (int e = 0; e < numEntries; e++)
+			{
+				int entry = ifd + 2 + e*12;
+				uint32 tag = u16(entry);
+				uint32 type = u16(entry+2);
+				uint32 value = (type == 3) ? u16(entry+8) : u32(entry+8);
+				if (tag == 256)
+					info.Width = value;
+				else if (tag == 257)
+					info.Height = value;
+			}
+		}
+		numPages++;
+		ifd = u32(ifd + 2 + numEntries*12);
+	}
+
+	info.NumFrames = tMath::tMax(numPages, 1);
+	return info.IsValid();
+}
@@ -0,0 +1,43 @@
+// ImageProbe.h
+//
+// Reads image dimensions, frame counts, and where possible the source pixel format from file headers without decoding
+// any pixel data. This is much faster than a full load. It is used to plan work, for example to estimate how much memory
+// a decoded image will need, for the --probe CLI option, and by the viewer to sort by dimensions before thumbnails exist.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+#include <System/tFile.h>
+#include <Image/tPixelFormat.h>
+
+
+namespace Viewer
+{
+namespace Probe
+{
+	struct HeaderInfo
+	{
+		bool IsValid() const							{ return (Width > 0) && (Height > 0); }
+		tSystem::tFileType FileType						= tSystem::tFileType::Invalid;
+		tImage::tPixelFormat PixelFormat				= tImage::tPixelFormat::Invalid;	// Invalid if not known from the header.
+		int Width										= 0;		// Of the primary (first, largest) picture.
+		int Height										= 0;
+		int NumFrames									= 0;		// Animation frames, faces, or layers. 0 if unknown.
+		int NumMipmaps									= 1;		// Mipmap levels of each frame.
+		bool HighDynamicRange							= false;	// Decoding goes through a float buffer.
+	};
+
+	// Fills in the info from the file header. The file type is determined from the filename extension. All loadable
+	// file types are supported. Returns false if the header could not be read. Thread-safe.
+	bool ProbeHeader(HeaderInfo&, const tString& filename);
+}
+}
@@ -0,0 +1,214 @@
+// ImageRegion.cpp
+//
+// Reads a rectangular region of an image file without decoding the rest of it. Only simple uncompressed layouts where
+// any row can be found with a seek are supported. Used when the first CLI operation is a crop so that small regions
+// may be cut out of very large sources without holding the whole image in memory.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <vector>
+#include <stdio.h>
+#include <System/tFile.h>
+#include "ImageRegion.h"
+using namespace tSystem;
+using namespace tImage;
+
+
+namespace Viewer
+{
+namespace Region
+{
+	// Where and how the rows are stored. Rows are a fixed number of bytes apart and each pixel is 3 bytes of BGR.
+	// Formats with alpha are not handled since some loaders change alpha based on the contents of the whole image.
+	struct Layout
+	{
+		int Width										= 0;
+		int Height										= 0;
+		int64 PixelOffset								= 0;		// Start of the first row in the file.
+		int64 RowStride									= 0;
+		bool TopDown									= false;	// First row in the file is the top row.
+		tPixelFormat SrcFormat							= tPixelFormat::Invalid;
+	};
+
+	bool GetLayout(Layout&, const tString& filename);
+	bool GetLayoutTGA(Layout&, const uint8* header, int headerSize);
+	bool GetLayoutBMP(Layout&, const uint8* header, int headerSize);
+	bool Seek(tFileHandle, int64 offset);
+
+	const int HeaderSize = 64;
+	const int64 MaxPixels = 0x7FFFFFFF;												// tPicture indexes pixels with an int.
+}
+}
+
+
+bool Viewer::Region::GetLayoutTGA(Layout& layout, const uint8* h, int headerSize)
+{
+	// Uncompressed true-colour (type 2), 24 bits per pixel, no colour map, and left-to-right rows.
+	if (headerSize < 18)
+		return false;
+
+	uint8 idLength		= h[0];
+	uint8 colourMapType	= h[1];
+	uint8 imageType		= h[2];
+	int width			= h[12] | (h[13] << 8);
+	int height			= h[14] | (h[15] << 8);
+	uint8 bitDepth		= h[16];
+	uint8 descriptor	= h[17];
+	if ((colourMapType != 0) || (imageType != 2) || (bitDepth != 24) || (descriptor & 0x10))
+		return false;
+
+	layout.Width		= width;
+	layout.Height		= height;
+	layout.PixelOffset	= 18 + idLength;
+	layout.RowStride	= int64(width) * 3;
+	layout.TopDown		= (descriptor & 0x20) ? true : false;
+	layout.SrcFormat	= tPixelFormat::B8G8R8;
+	return true;
+}
+
+
+bool Viewer::Region::GetLayoutBMP(Layout& layout, const uint8* h, int headerSize)
+{
+	// Uncompressed (BI_RGB) 24 bits per pixel. Rows are padded to 4 bytes. A negative height means top-down.
+	if ((headerSize < 34) || (h[0] != 'B') || (h[1] != 'M'))
+		return false;
+
+	auto le32 = [h](int pos) -> uint32 { return h[pos] | (h[pos+1] << 8) | (h[pos+2] << 16) | (uint32(h[pos+3]) << 24); };
+	uint32 pixelOffset	= le32(10);
+	uint32 dibSize		= le32(14);
+	int width			= int(le32(18));
+	int height			= int(le32(22));
+	int bitDepth		= h[28] | (h[29] << 8);
+	uint32 compression	= le32(30);
+	if ((dibSize < 40) || (bitDepth != 24) || (compression != 0) || (width <= 0) || (height == 0))
+		return false;
+
+	layout.Width		= width;
+	layout.Height		= tMath::tAbs(height);
+	layout.PixelOffset	= pixelOffset;
+	layout.RowStride	= (int64(width) * 3 + 3) & ~int64(3);
+	layout.TopDown		= (height < 0);
+	layout.SrcFormat	= tPixelFormat::B8G8R8;
+	return true;
+}
+
+
+bool Viewer::Region::GetLayout(Layout& layout, const tString& filename)
+{
+	tFileType fileType = tGetFileType(filename);
+	if ((fileType != tFileType::TGA) && (fileType != tFileType::BMP))
+		return false;
+
+	tFileHandle file = tOpenFile(filename.Chr(), "rb");
+	if (!file)
+		return false;
+	uint8 header[HeaderSize];
+	int headerSize = tReadFile(file, header, HeaderSize);
+	tCloseFile(file);
+
+	bool ok = (fileType == tFileType::TGA) ? GetLayoutTGA(layout, header, headerSize) : GetLayoutBMP(layout, header, headerSize);
+	return ok && (layout.Width > 0) && (layout.Height > 0);
+}
+
+
+bool Viewer::Region::Seek(tFileHandle file, int64 offset)
+{
+	// Very large files need offsets beyond what tFileSeek takes, so the 64-bit seek of the platform is used directly.
+	if (offset < 0)
+		return false;
+
+	#ifdef PLATFORM_WINDOWS
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+	#else
+	return fseeko(file, off_t(offset), SEEK_SET) == 0;
+	#endif
+}
+
+
+bool Viewer::Region::CanLoad(const tString& filename)
+{
+	Layout layout;
+	return GetLayout(layout, filename);
+}
+
+
+bool Viewer::Region::CanLoad(const tString& filename, int& srcWidth, int& srcHeight)
+{
+	Layout layout;
+	if (!GetLayout(layout, filename))
+		return false;
+
+	srcWidth = layout.Width;
+	srcHeight = layout.Height;
+	return true;
+}
+
+
+bool Viewer::Region::Load(tPicture& picture, tPixelFormat& srcFormat, int& srcWidth, int& srcHeight, const tString& filename, const Rect& rect)
+{
+	int64 numPixels = int64(rect.Width) * int64(rect.Height);
+	if ((rect.Width <= 0) || (rect.Height <= 0) || (numPixels > MaxPixels))
+		return false;
+
+	Layout layout;
+	if (!GetLayout(layout, filename))
+		return false;
+
+	tFileHandle file = tOpenFile(filename.Chr(), "rb");
+	if (!file)
+		return false;
+
+	// Only the columns that overlap the source are read. Everything else is the fill colour.
+	int x0 = tMath::tClamp(rect.OriginX, 0, layout.Width);
+	int x1 = tMath::tClamp(rect.OriginX + rect.Width, 0, layout.Width);
+	int spanWidth = x1 - x0;
+	std::vector<uint8> span(tMath::tMax(spanWidth, 1) * 3);
+
+	tPixel4b fill(rect.FillColour.R, rect.FillColour.G, rect.FillColour.B, rect.FillColour.A);
+	tPixel4b* pixels = new tPixel4b[numPixels];
+	bool ok = true;
+	for (int y = 0; (y < rect.Height) && ok; y++)
+	{
+		tPixel4b* row = pixels + int64(y)*rect.Width;
+		for (int x = 0; x < rect.Width; x++)
+			row[x] = fill;
+
+		// Picture rows go from the bottom up.
+		int srcY = rect.OriginY + y;
+		if ((srcY < 0) || (srcY >= layout.Height) || (spanWidth <= 0))
+			continue;
+
+		int fileRow = layout.TopDown ? (layout.Height - 1 - srcY) : srcY;
+		int64 offset = layout.PixelOffset + int64(fileRow)*layout.RowStride + int64(x0)*3;
+		if (!Seek(file, offset) || (tReadFile(file, span.data(), spanWidth*3) != spanWidth*3))
+		{
+			ok = false;
+			break;
+		}
+
+		tPixel4b* dst = row + (x0 - rect.OriginX);
+		for (int x = 0; x < spanWidth; x++)
+			dst[x] = tPixel4b(span[x*3 + 2], span[x*3 + 1], span[x*3 + 0], 0xFF);
+	}
+	tCloseFile(file);
+
+	if (!ok)
+	{
+		delete[] pixels;
+		return false;
+	}
+
+	picture.Set(rect.Width, rect.Height, pixels, false);
+	srcFormat = layout.SrcFormat;
+	srcWidth = layout.Width;
+	srcHeight = layout.Height;
+	return true;
+}
@@ -0,0 +1,55 @@
+// ImageRegion.h
+//
+// Reads a rectangular region of an image file without decoding the rest of it. Only simple uncompressed layouts where
+// any row can be found with a seek are supported. Used when the first CLI operation is a crop so that small regions
+// may be cut out of very large sources without holding the whole image in memory.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+#include <Math/tColour.h>
+#include <Image/tPicture.h>
+#include <Image/tPixelFormat.h>
+
+
+namespace Viewer
+{
+namespace Region
+{
+	// The rectangle uses the same convention as tPicture::Crop. The origin is the bottom-left of the region in the
+	// source and parts of the region outside the source are filled.
+	struct Rect
+	{
+		int Width										= 0;
+		int Height										= 0;
+		int OriginX										= 0;
+		int OriginY										= 0;
+		tColour4b FillColour							= tColour4b::transparent;
+	};
+
+	// Returns true if the file layout supports region reads. This only reads the header. The second version also sets
+	// srcWidth and srcHeight to the full image size.
+	bool CanLoad(const tString& filename);
+	bool CanLoad(const tString& filename, int& srcWidth, int& srcHeight);
+
+	// On success the picture is set to the region, exactly as if the whole file were loaded and then cropped with
+	// tPicture::Crop, and srcWidth and srcHeight are set to the full image size. Note Image::Crop skips crops that
+	// don't change the size, so callers standing in for it should not use a region the same size as the source.
+	// Returns false without modifying the picture if the file layout is not supported or can't be read, or if the
+	// region is too big for a picture, in which case a normal load should be done. Thread-safe.
+	bool Load
+	(
+		tImage::tPicture&, tImage::tPixelFormat& srcFormat, int& srcWidth, int& srcHeight,
+		const tString& filename, const Rect&
+	);
+}
+}
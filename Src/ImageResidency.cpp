@@ -0,0 +1,216 @@
+// ImageResidency.cpp
+//
+// Tracks which images in the viewer hold memory and decides what to give back when there is too much. Resident images
+// are kept in an intrusive least-recently-used list with running totals for decoded pixels, textures, and undo history.
+// Each total has its own budget and eviction works through the list a few images at a time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <System/tPrint.h>
+#include <System/tFile.h>
+#include "ImageResidency.h"
+#include "Image.h"
+
+
+namespace Viewer
+{
+namespace Residency
+{
+	// Head is the least recently used. Only the main thread uses any of this.
+	Image* Head											= nullptr;
+	Image* Tail											= nullptr;
+	int NumResident										= 0;
+	int64 PixelBytes									= 0;
+	int64 TextureBytes									= 0;
+	int64 UndoBytes										= 0;
+
+	void Link(Image*);
+	void Unlink(Image*);
+}
+}
+
+
+void Viewer::Residency::Link(Image* image)
+{
+	Node& node = image->ResidencyNode;
+	tAssert(!node.Linked);
+	node.Prev = Tail;
+	node.Next = nullptr;
+	if (Tail)
+		Tail->ResidencyNode.Next = image;
+	else
+		Head = image;
+	Tail = image;
+	node.Linked = true;
+	NumResident++;
+}
+
+
+void Viewer::Residency::Unlink(Image* image)
+{
+	Node& node = image->ResidencyNode;
+	tAssert(node.Linked);
+	if (node.Prev)
+		node.Prev->ResidencyNode.Next = node.Next;
+	else
+		Head = node.Next;
+
+	if (node.Next)
+		node.Next->ResidencyNode.Prev = node.Prev;
+	else
+		Tail = node.Prev;
+
+	node.Prev = nullptr;
+	node.Next = nullptr;
+	node.Linked = false;
+	NumResident--;
+}
+
+
+void Viewer::Residency::Touch(Image* image)
+{
+	if (!image)
+		return;
+
+	Node& node = image->ResidencyNode;
+	if (node.Linked)
+		Unlink(image);
+
+	// Charges are only ever on the totals while linked.
+	node.PixelBytes		= image->GetPixelMemBytes();
+	node.TextureBytes	= image->GetTextureMemBytes();
+	node.UndoBytes		= image->GetUndoMemBytes();
+	if ((node.PixelBytes + node.TextureBytes + node.UndoBytes) <= 0)
+		return;
+
+	Link(image);
+	PixelBytes		+= node.PixelBytes;
+	TextureBytes	+= node.TextureBytes;
+	UndoBytes		+= node.UndoBytes;
+}
+
+
+void Viewer::Residency::Refresh(Image* image)
+{
+	Node& node = image->ResidencyNode;
+	if (!node.Linked)
+		return;
+
+	int64 pixelBytes	= image->GetPixelMemBytes();
+	int64 textureBytes	= image->GetTextureMemBytes();
+	int64 undoBytes		= image->GetUndoMemBytes();
+	PixelBytes			+= pixelBytes - node.PixelBytes;
+	TextureBytes		+= textureBytes - node.TextureBytes;
+	UndoBytes			+= undoBytes - node.UndoBytes;
+	node.PixelBytes		= pixelBytes;
+	node.TextureBytes	= textureBytes;
+	node.UndoBytes		= undoBytes;
+
+	if ((pixelBytes + textureBytes + undoBytes) <= 0)
+		Unlink(image);
+}
+
+
+void Viewer::Residency::Remove(Image* image)
+{
+	Node& node = image->ResidencyNode;
+	if (!node.Linked)
+		return;
+
+	PixelBytes			-= node.PixelBytes;
+	TextureBytes		-= node.TextureBytes;
+	UndoBytes			-= node.UndoBytes;
+	node.PixelBytes		= 0;
+	node.TextureBytes	= 0;
+	node.UndoBytes		= 0;
+	Unlink(image);
+}
+
+
+int64 Viewer::Residency::GetPixelBytes()
+{
+	return PixelBytes;
+}
+
+
+int64 Viewer::Residency::GetTextureBytes()
+{
+	return TextureBytes;
+}
+
+
+int64 Viewer::Residency::GetUndoBytes()
+{
+	return UndoBytes;
+}
+
+
+int Viewer::Residency::GetNumResident()
+{
+	return NumResident;
+}
+
+
+int Viewer::Residency::Evict(const Budgets& budgets, const Image* keep, int maxEvictions)
+{
+	int numEvicted = 0;
+	Image* image = Head;
+	while (image && (numEvicted < maxEvictions))
+	{
+		bool overPixels		= PixelBytes > budgets.PixelBytes;
+		bool overTextures	= TextureBytes > budgets.TextureBytes;
+		bool overUndo		= UndoBytes > budgets.UndoBytes;
+		if (!overPixels && !overTextures && !overUndo)
+			break;
+
+		// Acting on the image may unlink it.
+		Image* next = image->ResidencyNode.Next;
+		if (image == keep)
+		{
+			image = next;
+			continue;
+		}
+
+		// The hooks in Image refresh the node as we go so the charges are copied first.
+		tString name = tSystem::tGetFileName(image->Filename);
+		Node node = image->ResidencyNode;
+		bool acted = false;
+		if (overPixels && image->IsLoaded() && image->Unload())
+		{
+			tPrintf("Unloaded %s freeing %|64d Bytes\n", name.Chr(), node.PixelBytes);
+			acted = true;
+		}
+		else
+		{
+			if (overTextures && (node.TextureBytes > 0))
+			{
+				tPrintf("Released textures of %s freeing %|64d Bytes\n", name.Chr(), node.TextureBytes);
+				image->Unbind();
+				acted = true;
+			}
+			if (overUndo && (node.UndoBytes > 0))
+			{
+				tPrintf("Dropped undo history of %s freeing %|64d Bytes\n", name.Chr(), node.UndoBytes);
+				image->ClearUndo();
+				acted = true;
+			}
+		}
+
+		if (acted)
+		{
+			Refresh(image);
+			numEvicted++;
+		}
+		image = next;
+	}
+
+	return numEvicted;
+}
@@ -0,0 +1,69 @@
+// ImageResidency.h
+//
+// Tracks which images in the viewer hold memory and decides what to give back when there is too much. Resident images
+// are kept in an intrusive least-recently-used list with running totals for decoded pixels, textures, and undo history.
+// Each total has its own budget and eviction works through the list a few images at a time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tStandard.h>
+namespace Viewer
+{
+	class Image;
+
+
+namespace Residency
+{
+	// Every image carries a node so the list needs no allocations and linking, unlinking, and moving are O(1). The
+	// charges are what the image held when last refreshed and are what the totals are made of.
+	struct Node
+	{
+		Image* Prev										= nullptr;		// Towards the least recently used.
+		Image* Next										= nullptr;
+		bool Linked										= false;
+		int64 PixelBytes								= 0;
+		int64 TextureBytes								= 0;
+		int64 UndoBytes									= 0;
+	};
+
+	struct Budgets
+	{
+		int64 PixelBytes								= 0;
+		int64 TextureBytes								= 0;
+		int64 UndoBytes									= 0;
+	};
+
+	// Refreshes the image's charges and makes it the most recently used. Images holding nothing are not listed. The
+	// cost depends on the image's frames and undo steps, not on how many images there are.
+	void Touch(Image*);
+
+	// Refreshes the image's charges without changing its place, and unlinks it if it no longer holds anything. Does
+	// nothing for images that aren't listed, so images used outside the viewer (CLI, thumbnail and background loaders)
+	// never reach the shared state. Image calls this itself after unloading or releasing textures.
+	void Refresh(Image*);
+
+	// Unlinks the image and takes its charges off the totals. Called when an image is deleted.
+	void Remove(Image*);
+
+	int64 GetPixelBytes();
+	int64 GetTextureBytes();
+	int64 GetUndoBytes();
+	int GetNumResident();
+
+	// Works from the least recently used end while any total is over its budget, acting on at most maxEvictions images.
+	// Over the pixel budget an image is unloaded, which also frees its textures. Dirty images can't be unloaded so they
+	// only lose what the other budgets ask for. Over the texture budget an image's textures are released and it is
+	// uploaded again if drawn. Over the undo budget its undo history is dropped. The keep image is never touched.
+	// Returns how many images were acted on.
+	int Evict(const Budgets&, const Image* keep, int maxEvictions);
+}
+}
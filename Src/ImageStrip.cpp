@@ -0,0 +1,207 @@
+// ImageStrip.cpp
+//
+// Writes images a band of rows at a time so that a large output never has to be held in memory all at once. Only
+// simple uncompressed or run-length layouts are supported. Used by the CLI for contact sheets and strip processing.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <Foundation/tFundamentals.h>
+#include "ImageStrip.h"
+using namespace tSystem;
+
+
+namespace Viewer
+{
+namespace Strip
+{
+	void PutLE16(uint8* dst, int value)					{ dst[0] = uint8(value); dst[1] = uint8(value >> 8); }
+	void PutLE32(uint8* dst, uint32 value)				{ for (int b = 0; b < 4; b++) dst[b] = uint8(value >> (8*b)); }
+}
+}
+
+
+bool Viewer::Strip::Writer::Open(const tString& filename, Format format, bool rle, int width, int height)
+{
+	Close();
+	if ((format == Format::Invalid) || (width <= 0) || (height <= 0))
+		return false;
+
+	// TGA stores the dimensions in 16 bits.
+	bool tga = (format == Format::TGA24) || (format == Format::TGA32);
+	if (tga && ((width > 0xFFFF) || (height > 0xFFFF)))
+		return false;
+
+	File = tOpenFile(filename.Chr(), "wb");
+	if (!File)
+		return false;
+
+	Filename	= filename;
+	FileFormat	= format;
+	RLE			= rle && (format != Format::BMP24);
+	Width		= width;
+	Height		= height;
+	RowsWritten	= 0;
+	Failed		= false;
+
+	// Both headers describe top-down rows. For TGA that is bit 5 of the descriptor and for BMP a negative height.
+	switch (format)
+	{
+		case Format::TGA24:
+		case Format::TGA32:
+		{
+			bool alpha = (format == Format::TGA32);
+			uint8 header[18] = { 0 };
+			header[2] = RLE ? 10 : 2;
+			PutLE16(header+12, width);
+			PutLE16(header+14, height);
+			header[16] = alpha ? 32 : 24;
+			header[17] = 0x20 | (alpha ? 8 : 0);
+			Failed = (tWriteFile(File, header, 18) != 18);
+			break;
+		}
+
+		case Format::BMP24:
+		{
+			int64 rowStride = (int64(width)*3 + 3) & ~int64(3);
+			int64 imageSize = rowStride * height;
+			uint8 header[54] = { 0 };
+			header[0] = 'B'; header[1] = 'M';
+			PutLE32(header+2, uint32(tMath::tMin(imageSize + 54, int64(0xFFFFFFFF))));
+			PutLE32(header+10, 54);
+			PutLE32(header+14, 40);
+			PutLE32(header+18, uint32(width));
+			PutLE32(header+22, uint32(-height));
+			PutLE16(header+26, 1);
+			PutLE16(header+28, 24);
+			PutLE32(header+34, uint32(tMath::tMin(imageSize, int64(0xFFFFFFFF))));
+			Failed = (tWriteFile(File, header, 54) != 54);
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return !Failed;
+}
+
+
+void Viewer::Strip::Writer::EncodeRowRLE(const tPixel4b* row, int bytesPerPixel)
+{
+	// Packets never cross rows. A run packet is used for 2 or more repeats, otherwise pixels go in raw packets. Both
+	// kinds hold at most 128 pixels.
+	auto putPixel = [this, bytesPerPixel](const tPixel4b& p)
+	{
+		RowBuffer.push_back(p.B); RowBuffer.push_back(p.G); RowBuffer.push_back(p.R);
+		if (bytesPerPixel == 4)
+			RowBuffer.push_back(p.A);
+	};
+
+	int x = 0;
+	while (x < Width)
+	{
+		int run = 1;
+		while ((x + run < Width) && (run < 128) && (row[x + run].BP == row[x].BP))
+			run++;
+
+		if (run >= 2)
+		{
+			RowBuffer.push_back(uint8(0x80 | (run-1)));
+			putPixel(row[x]);
+			x += run;
+			continue;
+		}
+
+		int raw = 1;
+		while ((x + raw < Width) && (raw < 128) && !((x + raw + 1 < Width) && (row[x + raw].BP == row[x + raw + 1].BP)))
+			raw++;
+		RowBuffer.push_back(uint8(raw-1));
+		for (int r = 0; r < raw; r++)
+			putPixel(row[x + r]);
+		x += raw;
+	}
+}
+
+
+void Viewer::Strip::Writer::EncodeRow(const tPixel4b* row)
+{
+	RowBuffer.clear();
+	switch (FileFormat)
+	{
+		case Format::TGA24:
+		case Format::TGA32:
+		{
+			int bytesPerPixel = (FileFormat == Format::TGA32) ? 4 : 3;
+			if (RLE)
+			{
+				EncodeRowRLE(row, bytesPerPixel);
+				break;
+			}
+			for (int x = 0; x < Width; x++)
+			{
+				RowBuffer.push_back(row[x].B); RowBuffer.push_back(row[x].G); RowBuffer.push_back(row[x].R);
+				if (bytesPerPixel == 4)
+					RowBuffer.push_back(row[x].A);
+			}
+			break;
+		}
+
+		case Format::BMP24:
+		{
+			for (int x = 0; x < Width; x++)
+			{
+				RowBuffer.push_back(row[x].B); RowBuffer.push_back(row[x].G); RowBuffer.push_back(row[x].R);
+			}
+			while (RowBuffer.size() & 3)
+				RowBuffer.push_back(0);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+bool Viewer::Strip::Writer::WriteRowsTopDown(const tPixel4b* rows, int numRows)
+{
+	if (!File || Failed || (RowsWritten + numRows > Height))
+	{
+		Failed = true;
+		return false;
+	}
+
+	for (int r = 0; r < numRows; r++)
+	{
+		EncodeRow(rows + int64(r)*Width);
+		int numBytes = int(RowBuffer.size());
+		if (tWriteFile(File, RowBuffer.data(), numBytes) != numBytes)
+		{
+			Failed = true;
+			return false;
+		}
+	}
+	RowsWritten += numRows;
+	return true;
+}
+
+
+bool Viewer::Strip::Writer::Close()
+{
+	if (!File)
+		return !Failed && (RowsWritten == Height) && (Height > 0);
+
+	tCloseFile(File);
+	File = nullptr;
+	if (RowsWritten != Height)
+		Failed = true;
+	return !Failed;
+}
@@ -0,0 +1,71 @@
+// ImageStrip.h
+//
+// Writes images a band of rows at a time so that a large output never has to be held in memory all at once. Only
+// simple uncompressed or run-length layouts are supported. Used by the CLI for contact sheets and strip processing.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Foundation/tString.h>
+#include <System/tFile.h>
+#include <Math/tColour.h>
+
+
+namespace Viewer
+{
+namespace Strip
+{
+	enum class Format
+	{
+		Invalid,
+		TGA24,
+		TGA32,
+		BMP24
+	};
+
+	// Rows are written from the top of the image down. The header is written when the file is opened so the size must
+	// be known up front.
+	class Writer
+	{
+	public:
+		Writer()																										{ }
+		Writer(const Writer&)																							= delete;
+		~Writer()																										{ Close(); }
+
+		// For TGA, rle selects run-length encoding. It is ignored for BMP. Returns success.
+		bool Open(const tString& filename, Format, bool rle, int width, int height);
+
+		// Each row is width pixels. Rows go from the top down. Returns false if a write failed or there are more rows
+		// than the height. After a failure all further writes fail.
+		bool WriteRowsTopDown(const tPixel4b* rows, int numRows);
+
+		// Returns true only if every row was written without error. Safe to call more than once.
+		bool Close();
+		bool IsOpen() const																								{ return File != nullptr; }
+		const tString& GetFilename() const																				{ return Filename; }
+
+	private:
+		void EncodeRow(const tPixel4b* row);
+		void EncodeRowRLE(const tPixel4b* row, int bytesPerPixel);
+
+		tString Filename;
+		tSystem::tFileHandle File						= nullptr;
+		Format FileFormat								= Format::Invalid;
+		bool RLE										= false;
+		int Width										= 0;
+		int Height										= 0;
+		int RowsWritten									= 0;
+		bool Failed										= false;
+		std::vector<uint8> RowBuffer;
+	};
+}
+}
@@ -401,7 +401,6 @@ bool Viewer::ShowImportRawOverlay(bool* popen, bool justOpened)
 							{
 								Image* newImg = new Image(ImportRaw::ImportedDstFile);
 								Images.Append(newImg);
-								ImagesLoadTimeSorted.Append(newImg);
 								SortImages(profile.GetSortKey(), profile.SortAscending);
 								SetCurrentImage(dstFilename);
 							}
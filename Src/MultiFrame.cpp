@@ -12,6 +12,9 @@
 // AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
+#include <vector>
+#include <thread>
+#include <atomic>
 #include <Math/tVector2.h>
 #include <Math/tInterval.h>
 #include <Image/tImageGIF.h>
@@ -25,6 +28,7 @@
 #include "Image.h"
 #include "GuiUtil.h"
 #include "Config.h"
+#include "Parallel.h"
 using namespace tStd;
 using namespace tMath;
 using namespace tSystem;
@@ -37,7 +41,18 @@ namespace Viewer
 	void ComputeMaxWidthHeight(int& outWidth, int& outHeight);
 	bool AllDimensionsMatch(int width, int height);
 
+	// Starts saving the frames of the current image on a background thread. The frames are encoded in parallel. Use
+	// ExtractInProgress and the counters below to follow it. Only one extraction may run at a time.
 	void SaveExtractedFrames(const tString& destDir, const tString& baseName, tFileType, tIntervalSet frames);
+	bool ExtractInProgress();						// Joins the thread when the extraction finishes.
+
+	namespace Extract
+	{
+		std::thread Thread;
+		std::atomic<int> NumDone(0);
+		int NumTotal = 0;
+		std::atomic<bool> Finished(true);
+	}
 }
 
 
@@ -239,25 +254,52 @@ void Viewer::DoSaveMultiFrameModal(bool saveMultiFramePressed)
 void Viewer::SaveMultiFrameTo(const tString& outFile, int outWidth, int outHeight)
 {
 	Config::ProfileData& profile = Config::GetProfileData();
+
+	// The source images are done in batches, one image per thread. A batch is loaded, its frames are resampled at the
+	// same time, and the images that were not already loaded are unloaded again before the next batch. Only the
+	// output-sized frames are kept so memory does not grow with the size of the sources.
 	tList<tFrame> frames;
-	for (Image* img = Images.First(); img; img = img->Next())
+	int batchSize = Parallel::GetMaxThreads();
+	Image* img = Images.First();
+	while (img)
 	{
-		if (!img->IsLoaded())
-			img->Load();
-
-		if (!img->IsLoaded())
-			continue;
-
-		tImage::tPicture* currPic = img->GetCurrentPic();
-		if (!currPic)
-			continue;
+		std::vector<Image*> batchImages;
+		std::vector<bool> batchUnload;
+		std::vector<tImage::tPicture*> srcPics;
+		for (; img && (int(srcPics.size()) < batchSize); img = img->Next())
+		{
+			bool wasLoaded = img->IsLoaded();
+			if (!wasLoaded)
+				img->Load();
+
+			tImage::tPicture* currPic = img->IsLoaded() ? img->GetCurrentPic() : nullptr;
+			if (currPic)
+				srcPics.push_back(currPic);
+			batchImages.push_back(img);
+			batchUnload.push_back(!wasLoaded && (img != CurrImage));
+		}
 
-		tImage::tPicture resampled(*currPic);
-		if ((resampled.GetWidth() != outWidth) || (resampled.GetHeight() != outHeight))
-			resampled.Resample(outWidth, outHeight, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
+		std::vector<tImage::tPicture> resampled(srcPics.size());
+		Parallel::For
+		(
+			int(srcPics.size()),
+			[&srcPics, &resampled, &profile, outWidth, outHeight](int f)
+			{
+				resampled[f].Set(*srcPics[f]);
+				if ((resampled[f].GetWidth() != outWidth) || (resampled[f].GetHeight() != outHeight))
+					resampled[f].Resample(outWidth, outHeight, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
+			}
+		);
 
-		tFrame* frame = new tFrame(resampled.StealPixels(), outWidth, outHeight, currPic->Duration);
-		frames.Append(frame);
+		// Appended in order. After this the sources are no longer needed.
+		for (int f = 0; f < int(srcPics.size()); f++)
+		{
+			tFrame* frame = new tFrame(resampled[f].StealPixels(), outWidth, outHeight, srcPics[f]->Duration);
+			frames.Append(frame);
+		}
+		for (int i = 0; i < int(batchImages.size()); i++)
+			if (batchUnload[i])
+				batchImages[i]->Unload();
 	}
 
 	bool success = false;
@@ -314,6 +356,7 @@ void Viewer::SaveMultiFrameTo(const tString& outFile, int outWidth, int outHeigh
 	// and set the current image to the generated one.
 	if (ImagesDir.IsEqualCI( tGetDir(outFile) ))
 	{
+		WaitForExtract();
 		Images.Clear();
 		PopulateImages();
 		SetCurrentImage(outFile);
@@ -332,16 +375,62 @@ tString Viewer::GetFrameFilename(int frameNum, const tString& dir, const tString
 
 void Viewer::SaveExtractedFrames(const tString& destDir, const tString& baseName, tFileType fileType, tIntervalSet frameSet)
 {
-	tAssert(CurrImage);
+	tAssert(CurrImage && !Extract::Thread.joinable());
+
+	// The filenames are all decided here so they don't depend on which thread saves which frame.
+	std::vector<tImage::tPicture*> pictures;
+	std::vector<tString> frameFiles;
 	int frameNum = 0;
 	for (tImage::tPicture* framePic = CurrImage->GetFirstPic(); framePic; framePic = framePic->Next(), frameNum++)
 	{
 		if (!frameSet.Contains(frameNum))
 			continue;
 
-		tString frameFile = GetFrameFilename(frameNum, destDir, baseName, fileType);
-		Viewer::SavePictureAs(*framePic, frameFile, fileType, false);
+		pictures.push_back(framePic);
+		frameFiles.push_back(GetFrameFilename(frameNum, destDir, baseName, fileType));
 	}
+
+	Extract::NumDone = 0;
+	Extract::NumTotal = int(pictures.size());
+	Extract::Finished = false;
+
+	// Parallel::For keeps at most one frame per thread being encoded.
+	Extract::Thread = std::thread
+	(
+		[pictures, frameFiles, fileType]()
+		{
+			Parallel::For
+			(
+				int(pictures.size()),
+				[&pictures, &frameFiles, fileType](int f)
+				{
+					Viewer::SavePictureAs(*pictures[f], frameFiles[f], fileType, false);
+					Extract::NumDone++;
+				}
+			);
+			Extract::Finished = true;
+		}
+	);
+}
+
+
+bool Viewer::ExtractInProgress()
+{
+	if (!Extract::Thread.joinable())
+		return false;
+
+	if (!Extract::Finished)
+		return true;
+
+	Extract::Thread.join();
+	return false;
+}
+
+
+void Viewer::WaitForExtract()
+{
+	if (Extract::Thread.joinable())
+		Extract::Thread.join();
 }
 
 
@@ -351,9 +440,23 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 		ImGui::OpenPopup("Extract Frames");
 
 	// The unused isOpenExtractFrames bool is just so we get a close button in ImGui. Returns false if popup not open.
+	// There is no close button while frames are being saved since the frames belong to the current image.
 	bool isOpenExtractFrames = true;
-	if (!ImGui::BeginPopupModal("Extract Frames", &isOpenExtractFrames, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar))
+	bool extracting = Extract::Thread.joinable();
+	if (!ImGui::BeginPopupModal("Extract Frames", extracting ? nullptr : &isOpenExtractFrames, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar))
+		return;
+
+	if (extracting)
+	{
+		int numDone = Extract::NumDone;
+		tString progress; tsPrintf(progress, "%d/%d", numDone, Extract::NumTotal);
+		ImGui::Text("Extracting frames...");
+		ImGui::ProgressBar(float(numDone) / float(tMax(Extract::NumTotal, 1)), tVector2(Gutil::GetUIParamScaled(300.0f, 2.5f), 0.0f), progress.Chr());
+		if (!ExtractInProgress())
+			ImGui::CloseCurrentPopup();
+		ImGui::EndPopup();
 		return;
+	}
 
 	float inputWidth	= Gutil::GetUIParamScaled(160.0f, 2.5f);
 	float buttonWidth	= Gutil::GetUIParamScaled(76.0f, 2.5f);
@@ -497,13 +600,11 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 				else
 				{
 					SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
-					closeThisModal = true;
 				}
 			}
 			else
 			{
 				SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
-				closeThisModal = true;
 			}
 		}
 	}
@@ -514,10 +615,11 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 	{
 		bool pressedOK = false, pressedCancel = false;
 		Viewer::DoOverwriteMultipleFilesModal(overwriteFiles, pressedOK, pressedCancel);
+		// The extract modal stays open to show progress. It closes itself when the frames are saved.
 		if (pressedOK)
 			SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
 
-		if (pressedOK || pressedCancel)
+		if (pressedCancel)
 			closeThisModal = true;
 	}
 
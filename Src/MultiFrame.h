@@ -21,5 +21,8 @@ namespace Viewer
 	void DoSaveMultiFrameModal(bool saveMultiFramePressed);
 	void DoSaveExtractFramesModal(bool saveExtractFramesPressed);
 
+	// The extract thread encodes pictures owned by the current image. Call this before any images are deleted.
+	void WaitForExtract();
+
 	tString GetFrameFilename(int frameNum, const tString& dir, const tString& baseName, tSystem::tFileType);
 }
@@ -195,6 +195,7 @@ void Viewer::DoSavePopup()
 				Image* foundImage = FindImage(SaveAsFile);
 				if (foundImage)
 				{
+					foundImage->DiscardBackgroundLoad();
 					foundImage->Unload(true);
 					foundImage->ClearDirty();
 					foundImage->RequestInvalidateThumbnail();
@@ -203,7 +204,7 @@ void Viewer::DoSavePopup()
 					AddSavedImageIfNecessary(SaveAsFile);
 
 				SortImages(profile.GetSortKey(), profile.SortAscending);
-				SetCurrentImage(SaveAsFile);
+				SetCurrentImage(SaveAsFile, true);
 			}
 			closeThisModal = true;
 		}
@@ -223,6 +224,7 @@ void Viewer::DoSavePopup()
 				Image* foundImage = FindImage(SaveAsFile);
 				if (foundImage)
 				{
+					foundImage->DiscardBackgroundLoad();
 					foundImage->Unload(true);
 					foundImage->ClearDirty();
 					foundImage->RequestInvalidateThumbnail();
@@ -231,7 +233,7 @@ void Viewer::DoSavePopup()
 					AddSavedImageIfNecessary(SaveAsFile);
 
 				SortImages(profile.GetSortKey(), profile.SortAscending);
-				SetCurrentImage(SaveAsFile);
+				SetCurrentImage(SaveAsFile, true);
 			}
 		}
 		if (pressedOK || pressedCancel)
@@ -977,6 +979,7 @@ void Viewer::SaveAllImages(const tString& destDir, const tString& extension, flo
 			Image* foundImage = FindImage(outFile);
 			if (foundImage)
 			{
+				foundImage->DiscardBackgroundLoad();
 				foundImage->Unload(true);
 				foundImage->ClearDirty();
 				foundImage->RequestInvalidateThumbnail();
@@ -1007,7 +1010,6 @@ void Viewer::AddSavedImageIfNecessary(const tString& savedFile)
 		// Add to list. It's still unloaded.
 		Image* newImg = new Image(savedFile);
 		Images.Append(newImg);
-		ImagesLoadTimeSorted.Append(newImg);
 	}
 }
 
@@ -0,0 +1,79 @@
+// Parallel.cpp
+//
+// A simple parallel-for used to spread independent pieces of work, like the frames of an animated image, over the
+// available cores. Work that is already running inside a parallel-for runs serially so nested use does not multiply
+// the number of threads.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <Foundation/tFundamentals.h>
+#include <System/tMachine.h>
+#include "Parallel.h"
+
+
+namespace Viewer
+{
+namespace Parallel
+{
+	std::atomic<int> MaxThreads(0);				// 0 means not yet set. Use the number of cores.
+	thread_local bool InsideFor = false;
+}
+}
+
+
+void Viewer::Parallel::SetMaxThreads(int maxThreads)
+{
+	MaxThreads = tMath::tClampMin(maxThreads, 1);
+}
+
+
+int Viewer::Parallel::GetMaxThreads()
+{
+	int maxThreads = MaxThreads;
+	if (maxThreads <= 0)
+		maxThreads = tSystem::tGetNumCores();
+	return tMath::tClampMin(maxThreads, 1);
+}
+
+
+void Viewer::Parallel::For(int count, const std::function<void(int)>& fn)
+{
+	if (count <= 0)
+		return;
+
+	int numThreads = tMath::tMin(count, GetMaxThreads());
+	if ((numThreads <= 1) || InsideFor)
+	{
+		for (int i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+
+	// Each thread takes the next index until there are none left. This balances work items of different sizes.
+	std::atomic<int> next(0);
+	auto worker = [&next, count, &fn]()
+	{
+		InsideFor = true;
+		for (int i = next++; i < count; i = next++)
+			fn(i);
+		InsideFor = false;
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
@@ -0,0 +1,34 @@
+// Parallel.h
+//
+// A simple parallel-for used to spread independent pieces of work, like the frames of an animated image, over the
+// available cores. Work that is already running inside a parallel-for runs serially so nested use does not multiply
+// the number of threads.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <functional>
+
+
+namespace Viewer
+{
+namespace Parallel
+{
+	// Calls fn(i) for every i in [0, count) and returns when all calls are done. Up to GetMaxThreads calls run at the
+	// same time, the calling thread being one of them. The order of the calls is not defined. Thread-safe.
+	void For(int count, const std::function<void(int)>& fn);
+
+	// The maximum number of threads a single For may use. Defaults to the number of cores. Values less than 1 are
+	// treated as 1. When other threads are already busy, for example the CLI jobs, this should be reduced.
+	void SetMaxThreads(int maxThreads);
+	int GetMaxThreads();
+}
+}
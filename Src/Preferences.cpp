@@ -376,6 +376,21 @@ void Viewer::ShowPreferencesWindow(bool* popen)
 			Gutil::HelpMark("Approx memory use limit of this app. Minimum 256 MB.");
 			tMath::tiClampMin(profile.MaxImageMemMB, 256);
 
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Max VRAM (MB)", &profile.MaxTextureMemMB); ImGui::SameLine();
+			Gutil::HelpMark("Approx video memory limit for image textures. Textures of images you\nhaven't looked at recently are released first, then frames of the current\nimage that won't be shown soon. Minimum 128 MB.");
+			tMath::tiClampMin(profile.MaxTextureMemMB, 128);
+
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Max Undo Mem (MB)", &profile.MaxUndoMemMB); ImGui::SameLine();
+			Gutil::HelpMark("Approx memory limit for undo history. Past it, the history of images you\nhaven't looked at recently is dropped. Minimum 64 MB.");
+			tMath::tiClampMin(profile.MaxUndoMemMB, 64);
+
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Prefetch Images", &profile.PrefetchImages); ImGui::SameLine();
+			Gutil::HelpMark("Number of images after the current one to load in the background, in the direction you\nare navigating. Half as many are loaded behind it. Prefetching stays within Max Mem.\nZero turns it off.");
+			tMath::tiClamp(profile.PrefetchImages, 0, 8);
+
 			ImGui::SetNextItemWidth(itemWidth);
 			ImGui::InputInt("Max Cache Files", &profile.MaxCacheFiles); ImGui::SameLine();
 			Gutil::HelpMark("Maximum number of cache files that may be created. Minimum 200.");
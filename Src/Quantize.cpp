@@ -35,16 +35,17 @@ float Viewer::ComputeApproxQuantizeDuration(const Image* image, tImage::tQuantiz
 	if (!image || (numColours < 2))
 		return 0.0f;
 
-	// We currently only consider scolorq and neu methods. The other two are quite fast.
+	// We currently only consider scolorq and neu methods. The other two are quite fast. Every frame is quantized.
+	int numFrames = tMath::tClampMin(image->GetNumFrames(), 1);
 	switch (method)
 	{
 		case tImage::tQuantize::Method::Spatial:
 			// 1024x1024 pixels, 2 colours -> approx 5 seconds.
-			return (5.0f*CurrImage->GetArea()*numColours) / (1024.0f*1024.0f*2.0f);
+			return (5.0f*image->GetArea()*numColours*numFrames) / (1024.0f*1024.0f*2.0f);
 
 		case tImage::tQuantize::Method::Neu:
 			// 1024x1024 pixels, 256 colours -> approx 3 seconds.
-			return (3.0f*CurrImage->GetArea()*numColours) / (1024.0f*1024.0f*256.0f);
+			return (3.0f*image->GetArea()*numColours*numFrames) / (1024.0f*1024.0f*256.0f);
 	}
 	return 0.0f;
 }
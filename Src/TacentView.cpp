@@ -17,6 +17,7 @@
 #include <locale.h>
 #endif
 
+#include <algorithm>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>				// Include glfw3.h after our OpenGL declarations.
 #ifdef PLATFORM_WINDOWS
@@ -311,9 +312,19 @@ namespace Viewer
 	tString ImagesDir;
 	tList<tStringItem> ImagesSubDirs;
 	tList<Image> Images;
-	tItList<Image> ImagesLoadTimeSorted(tListMode::External);		// We don't need static here cuz the list is only used after main().
 	tuint256 ImagesHash												= 0;
 	Image* CurrImage												= nullptr;
+
+	// Images with a background load in flight. Loads cancelled by navigating away stay here until their workers finish.
+	std::vector<Image*> ImagesLoading;
+
+	// Prefetching decodes the neighbours of the current image in the background so paging through them doesn't stall.
+	// NavDirection is 1 if the user last moved forward through the list and -1 if backward. Prefetched images that
+	// turned out too big for the memory limit are in PrefetchSkipped until the current image changes.
+	int NavDirection												= 1;
+	const int PrefetchMaxLoads										= 2;
+	std::vector<Image*> PrefetchSkipped;
+
 	// Removed unified preview toggles and complex slice caching to keep patch minimal.
 	tString ImageToLoad;
 
@@ -439,11 +450,32 @@ namespace Viewer
 	void SetUISize(Viewer::Config::ProfileData::UISizeEnum);
 
 	void DrawBackground(float l, float r, float b, float t, float drawW, float drawH);
+
+	// Publishes finished background loads. Called once per frame before anything looks at the current image.
+	void UpdateBackgroundLoads();
+
+	// Everything that happens once the current image has its pictures.
+	void OnCurrImageLoaded();
+
+	// Starts background loads for the images around the current one and cancels loads nobody needs any more. Only
+	// starts them while the current image is loaded and the memory limit allows. Called once per frame.
+	void UpdatePrefetch();
+	Image* GetNeighbourImage(Image*, int dir, bool circ);
+	int64 GetImageMemEstimate(Image*);
+
+	// Marks the current image as used and gives back memory from the least recently used images, never the current
+	// one, while over the pixel, texture, or undo budgets. Only a few images are dealt with per call. Called once per
+	// frame.
+	void UpdateResidency();
+	Residency::Budgets GetResidencyBudgets();
+	const int ResidencyEvictionsPerFrame							= 4;
+
+	// While the current image is decoding, its thumbnail (if there is one) is drawn in the work area instead.
+	void DrawLoadingThumbnail(float drawW, float drawH);
 	void PrintRedirectCallback(const char* text, int numChars);
 	void GlfwErrorCallback(int error, const char* description)															{ tPrintf("Glfw Error %d: %s\n", error, description); }
 	bool Compare_AlphabeticalAscending		(const tSystem::tFileInfo& a, const tSystem::tFileInfo& b)					{ return tStricmp(a.FileName.Chars(), b.FileName.Chars()) < 0; }
 	bool Compare_FileCreationTimeAscending	(const tSystem::tFileInfo& a, const tSystem::tFileInfo& b)					{ return a.CreationTime < b.CreationTime; }
-	bool Compare_ImageLoadTimeAscending		(const Image& a, const Image& b)											{ return a.GetLoadedTime() < b.GetLoadedTime(); }
 
 	// This is a 'FunctionObject'. Basically an object that acts like a function. This is sorta cool as it allows state
 	// to be stored in the object. In this case we use it as the compare function for a Sort call. Instead of a
@@ -907,8 +939,11 @@ void Viewer::PopulateImagesSubDirs()
 
 void Viewer::PopulateImages()
 {
+	// Deleting an image waits for its loader so nothing in ImagesLoading is left dangling.
+	WaitForExtract();
 	Images.Clear();
-	ImagesLoadTimeSorted.Clear();
+	ImagesLoading.clear();
+	PrefetchSkipped.clear();
 
 	tList<tSystem::tFileInfo> foundFiles;
 	ImagesDir = FindImagesInImageToLoadDir(foundFiles);
@@ -923,7 +958,6 @@ void Viewer::PopulateImages()
 		// It is important we don't call Load after newing. We save memory by not having all images loaded.
 		Image* newImg = new Image(*fileInfo);
 		Images.Append(newImg);
-		ImagesLoadTimeSorted.Append(newImg);
 	}
 
 	Config::ProfileData& profile = Config::GetProfileData();
@@ -934,6 +968,19 @@ void Viewer::PopulateImages()
 
 void Viewer::SortImages(Config::ProfileData::SortKeyEnum key, bool ascending)
 {
+	// Sorting by dimensions would otherwise have to wait for every thumbnail to be generated. Reading the headers is
+	// enough to get the order right straight away.
+	if
+	(
+		(key == Config::ProfileData::SortKeyEnum::ImageArea) ||
+		(key == Config::ProfileData::SortKeyEnum::ImageWidth) ||
+		(key == Config::ProfileData::SortKeyEnum::ImageHeight)
+	)
+	{
+		for (Image* img = Images.First(); img; img = img->Next())
+			img->ProbeDimensions();
+	}
+
 	ImageCompareFunctionObject compObj(key, ascending);
 	Images.Sort(compObj);
 }
@@ -1002,22 +1049,181 @@ void Viewer::AutoPropertyWindow()
 void Viewer::LoadCurrImage(bool forceReload)
 {
 	tAssert(CurrImage);
-	bool imgJustLoaded = false;
+
+	// Loads for images that are neither current nor neighbours are cancelled by UpdatePrefetch. Prefetches that didn't
+	// fit may fit now that the window has moved.
+	PrefetchSkipped.clear();
 
 	// Removed slice cache handling for minimal patch.
 
+	// A normal load happens on a worker so navigating stays responsive. OnCurrImageLoaded is called from
+	// UpdateBackgroundLoads when the pictures arrive.
+	if (!CurrImage->IsLoaded() && !forceReload)
+	{
+		if (CurrImage->RequestBackgroundLoad() && (std::find(ImagesLoading.begin(), ImagesLoading.end(), CurrImage) == ImagesLoading.end()))
+			ImagesLoading.push_back(CurrImage);
+
+		AutoPropertyWindow();
+		Gutil::SetWindowTitle();
+		ReticleVisibleOnSelect = false;
+		return;
+	}
+
 	if (!CurrImage->IsLoaded())
 	{
-		imgJustLoaded = CurrImage->Load();
+		CurrImage->Load();
 	}
 	else if (forceReload)
 	{
+		CurrImage->CancelBackgroundLoad();
 		CurrImage->Unbind();
 		CurrImage->Unload(true);
-		imgJustLoaded = CurrImage->Load();
+		CurrImage->Load();
 		CurrImage->Bind();
 	}
 
+	OnCurrImageLoaded();
+}
+
+
+void Viewer::UpdateBackgroundLoads()
+{
+	for (auto it = ImagesLoading.begin(); it != ImagesLoading.end(); )
+	{
+		Image* image = *it;
+		bool published = image->UpdateBackgroundLoad();
+		if (image->IsBackgroundLoadPending())
+		{
+			it++;
+			continue;
+		}
+
+		it = ImagesLoading.erase(it);
+		if (!published)
+			continue;
+
+		if (image == CurrImage)
+		{
+			OnCurrImageLoaded();
+			continue;
+		}
+
+		// A prefetch never unloads other images. If the estimate was low and it doesn't fit it is dropped instead.
+		Residency::Touch(image);
+		if (image->IsLoaded() && (Residency::GetPixelBytes() > GetResidencyBudgets().PixelBytes))
+		{
+			tPrintf("Prefetched %s does not fit in image mem. Unloading.\n", tSystem::tGetFileName(image->Filename).Chr());
+			image->Unload();
+			PrefetchSkipped.push_back(image);
+		}
+	}
+}
+
+
+Image* Viewer::GetNeighbourImage(Image* image, int dir, bool circ)
+{
+	if (dir > 0)
+		return circ ? Images.NextCirc(image) : image->Next();
+	return circ ? Images.PrevCirc(image) : image->Prev();
+}
+
+
+int64 Viewer::GetImageMemEstimate(Image* image)
+{
+	// Pictures are RGBA8. Extra frames and mipmaps aren't known before loading so this is a lower bound. The
+	// dimensions come from the thumbnail cache or a header probe and may not be known yet.
+	return tMath::tMax(int64(image->FileSizeB), int64(image->Cached_PrimaryArea) * 4);
+}
+
+
+void Viewer::UpdatePrefetch()
+{
+	Config::ProfileData& profile = Config::GetProfileData();
+
+	// The window holds the images worth having in memory, nearest first. More of it is in the direction of travel. A
+	// looping slideshow wraps around so the first images are prefetched near the end.
+	std::vector<Image*> window;
+	if (CurrImage && !profile.ShowImportRaw && (profile.PrefetchImages > 0))
+	{
+		bool circ = SlideshowPlaying && profile.SlideshowLooping;
+		int numAhead = profile.PrefetchImages;
+		int numBehind = (profile.PrefetchImages + 1) / 2;
+		Image* ahead = CurrImage;
+		Image* behind = CurrImage;
+		for (int n = 0; n < numAhead; n++)
+		{
+			ahead = ahead ? GetNeighbourImage(ahead, NavDirection, circ) : nullptr;
+			if (ahead && (ahead != CurrImage) && (std::find(window.begin(), window.end(), ahead) == window.end()))
+				window.push_back(ahead);
+
+			if (n >= numBehind)
+				continue;
+			behind = behind ? GetNeighbourImage(behind, -NavDirection, circ) : nullptr;
+			if (behind && (behind != CurrImage) && (std::find(window.begin(), window.end(), behind) == window.end()))
+				window.push_back(behind);
+		}
+	}
+
+	// Anything loading outside the window is wasted work. The decoders can't be stopped part way, so these are
+	// cancelled and their results dropped when they finish.
+	int numPrefetching = 0;
+	for (Image* loading : ImagesLoading)
+	{
+		if (loading == CurrImage)
+			continue;
+
+		if (std::find(window.begin(), window.end(), loading) == window.end())
+			loading->CancelBackgroundLoad();
+		else if (!loading->IsBackgroundLoadCancelled())
+			numPrefetching++;
+	}
+
+	// The current image gets the machine to itself until it is loaded.
+	if (window.empty() || !CurrImage->IsLoaded())
+		return;
+
+	int64 allowedMem = GetResidencyBudgets().PixelBytes;
+	int64 usedMem = -1;
+	for (Image* image : window)
+	{
+		if (numPrefetching >= PrefetchMaxLoads)
+			break;
+
+		bool pending = image->IsBackgroundLoadPending();
+		if (image->IsLoaded() || (pending && !image->IsBackgroundLoadCancelled()))
+			continue;
+
+		if (std::find(PrefetchSkipped.begin(), PrefetchSkipped.end(), image) != PrefetchSkipped.end())
+			continue;
+
+		// Loads in flight are counted by estimate. Nearer images come first so we stop at the first that won't fit.
+		if (usedMem < 0)
+		{
+			usedMem = Residency::GetPixelBytes();
+			for (Image* loading : ImagesLoading)
+				if (!loading->IsBackgroundLoadCancelled())
+					usedMem += GetImageMemEstimate(loading);
+		}
+		image->ProbeDimensions();
+		int64 estimate = GetImageMemEstimate(image);
+		if (usedMem + estimate > allowedMem)
+			break;
+
+		if (!image->RequestBackgroundLoad())
+			continue;
+
+		// A cancelled load that is still running is reused and is already in the list.
+		if (!pending)
+			ImagesLoading.push_back(image);
+		usedMem += estimate;
+		numPrefetching++;
+	}
+}
+
+
+void Viewer::OnCurrImageLoaded()
+{
+	tAssert(CurrImage);
 	AutoPropertyWindow();
 	Gutil::SetWindowTitle();
 	if (!CurrImage->IsLoaded())
@@ -1041,41 +1247,43 @@ void Viewer::LoadCurrImage(bool forceReload)
 
 	ResetPan();
 	Request_CropLineConstrain = true;
+	Residency::Touch(CurrImage);
+	ReticleVisibleOnSelect = false;
+}
 
-	// We only need to consider unloading an image when a new one is loaded... in this function.
-	// We currently do not allow unloading when in slideshow and the frame duration is small.
-	bool slideshowSmallDuration = SlideshowPlaying && (profile.SlideshowPeriod < 0.5f);
-	if (imgJustLoaded && !slideshowSmallDuration)
-	{
-		ImagesLoadTimeSorted.Sort(Compare_ImageLoadTimeAscending);
 
-		int64 usedMem = 0;
-		for (tItList<Image>::Iter iter = ImagesLoadTimeSorted.First(); iter; iter++)
-			usedMem += int64((*iter).Info.MemSizeBytes);
+Viewer::Residency::Budgets Viewer::GetResidencyBudgets()
+{
+	Config::ProfileData& profile = Config::GetProfileData();
+	Residency::Budgets budgets;
+	budgets.PixelBytes		= int64(profile.MaxImageMemMB) * 1024 * 1024;
+	budgets.TextureBytes	= int64(profile.MaxTextureMemMB) * 1024 * 1024;
+	budgets.UndoBytes		= int64(profile.MaxUndoMemMB) * 1024 * 1024;
+	return budgets;
+}
 
-		int64 allowedMem = int64(profile.MaxImageMemMB) * 1024 * 1024;
-		if (usedMem > allowedMem)
-		{
-			tPrintf("Used image mem (%|64d) bigger than max (%|64d). Unloading.\n", usedMem, allowedMem);
-			for (tItList<Image>::Iter iter = ImagesLoadTimeSorted.First(); iter; iter++)
-			{
-				Image* i = iter.GetObject();
 
-				// Never unload the current image.
-				if (i->IsLoaded() && (i != CurrImage))
-				{
-					tPrintf("Unloading %s freeing %d Bytes\n", tSystem::tGetFileName(i->Filename).Chr(), i->Info.MemSizeBytes);
-					usedMem -= i->Info.MemSizeBytes;
-					i->Unload();
-					if (usedMem < allowedMem)
-						break;
-				}
-			}
-			tPrintf("Used mem %|64dB out of max %|64dB.\n", usedMem, allowedMem);
-		}
-	}
+void Viewer::UpdateResidency()
+{
+	// The current image may have been drawn, edited, or had its undo history change since last frame.
+	if (CurrImage)
+		Residency::Touch(CurrImage);
 
-	ReticleVisibleOnSelect = false;
+	// We currently do not allow unloading when in slideshow and the frame duration is small.
+	Config::ProfileData& profile = Config::GetProfileData();
+	bool slideshowSmallDuration = SlideshowPlaying && (profile.SlideshowPeriod < 0.5f);
+	Residency::Budgets budgets = GetResidencyBudgets();
+	int numEvicted = 0;
+	if (!slideshowSmallDuration)
+		numEvicted = Residency::Evict(budgets, CurrImage, ResidencyEvictionsPerFrame);
+
+	// If other images had nothing left to give, the current image releases frames that won't be drawn soon. Frames are
+	// uploaded again when shown so this is fine during a slideshow too.
+	if (CurrImage && (numEvicted == 0) && (Residency::GetTextureBytes() > budgets.TextureBytes))
+	{
+		int64 otherBytes = Residency::GetTextureBytes() - CurrImage->ResidencyNode.TextureBytes;
+		CurrImage->ReleaseFrameTextures(tMath::tMax(budgets.TextureBytes - otherBytes, int64(0)));
+	}
 }
 
 
@@ -1096,6 +1304,7 @@ bool Viewer::OnNextImage(bool next)
 	if (SlideshowPlaying)
 		SlideshowCountdown = profile.SlideshowPeriod;
 
+	NavDirection = next ? 1 : -1;
 	if (next)
 		{ CurrImage = circ ? Images.NextCirc(CurrImage) : CurrImage->Next(); }
 	else
@@ -1117,6 +1326,8 @@ bool Viewer::OnLastImage(bool last)
 	if (profile.ShowImportRaw)
 		return false;
 
+	// From the last image the only neighbours are behind it.
+	NavDirection = last ? -1 : 1;
 	CurrImage = last ? Images.Last() : Images.First();
 	LoadCurrImage();
 	return true;
@@ -1748,7 +1959,6 @@ bool Viewer::OnPasteFromClipboard()
 		//
 		Image* newImg = new Image(filename);
 		Images.Append(newImg);
-		ImagesLoadTimeSorted.Append(newImg);
 		SortImages(profile.GetSortKey(), profile.SortAscending);
 		SetCurrentImage(filename);
 
@@ -2026,6 +2236,41 @@ int Viewer::GetPanY()
 }
 
 
+void Viewer::DrawLoadingThumbnail(float drawW, float drawH)
+{
+	tAssert(CurrImage);
+	uint64 thumbID = CurrImage->BindThumbnail();
+	if (!thumbID)
+		return;
+
+	// The thumbnail keeps the image aspect inside a fixed size frame, so the frame is fitted to the work area.
+	float thumbAspect = float(Image::ThumbWidth) / float(Image::ThumbHeight);
+	float w = drawW;
+	float h = drawW / thumbAspect;
+	if (h > drawH)
+	{
+		h = drawH;
+		w = drawH * thumbAspect;
+	}
+	float left		= tMath::tRound((drawW - w) / 2.0f);
+	float bottom	= tMath::tRound((drawH - h) / 2.0f);
+	float right		= left + w;
+	float top		= bottom + h;
+
+	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+	glEnable(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0f, 0.0f); glVertex2f(left,  bottom);
+	glTexCoord2f(0.0f, 1.0f); glVertex2f(left,  top);
+	glTexCoord2f(1.0f, 1.0f); glVertex2f(right, top);
+	glTexCoord2f(1.0f, 0.0f); glVertex2f(right, bottom);
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
+}
+
+
 void Viewer::DrawBackground(float l, float r, float b, float t, float drawW, float drawH)
 {
 	if (Config::Global.TransparentWorkArea)
@@ -3159,7 +3404,11 @@ void Viewer::Update(GLFWwindow* window, double dt, bool dopoll)
 	int mouseXi = int(mouseX);
 	int mouseYi = int(mouseY);
 	Config::ProfileData::ZoomModeEnum zoomMode = GetZoomMode();
+	UpdateBackgroundLoads();
+	UpdatePrefetch();
+	UpdateResidency();
 	bool imgAvail = CurrImage && CurrImage->IsLoaded();
+	bool imgLoading = CurrImage && !imgAvail && CurrImage->IsBackgroundLoadPending();
 
 	if (imgAvail)
 	{
@@ -3499,6 +3748,10 @@ void Viewer::Update(GLFWwindow* window, double dt, bool dopoll)
 		}
 		lastCropMode = CropMode;
 	}
+	else if (imgLoading)
+	{
+		DrawLoadingThumbnail(float(workAreaW), float(workAreaH));
+	}
 
 	// Show the big demo window. You can browse its code to learn more about Dear ImGui.
 	static bool showDemoWindow = false;
@@ -3514,6 +3767,23 @@ void Viewer::Update(GLFWwindow* window, double dt, bool dopoll)
 		DisappearCountdown -= dt;
 	tVector2 mousePos(mouseX, mouseY);
 
+	// There is no progress to report from the decoders so the loading indicator shows elapsed time.
+	if (imgLoading)
+	{
+		float elapsed = tSystem::tGetTime() - CurrImage->GetBackgroundLoadStartTime();
+		tString loadingText;
+		tsPrintf(loadingText, "Loading %s  %c %.1fs", tGetFileName(CurrImage->Filename).Chr(), "|/-\\"[int(elapsed*8.0f) & 3], elapsed);
+		tVector2 textSize = ImGui::CalcTextSize(loadingText.Chr());
+		ImGui::SetNextWindowPos(ImVec2((float(workAreaW)-textSize.x)*0.5f, float(topUIHeight) + (float(workAreaH)-textSize.y)*0.5f));
+		ImGui::SetNextWindowBgAlpha(0.6f);
+		ImGuiWindowFlags flagsLoading =
+			ImGuiWindowFlags_NoTitleBar		|	ImGuiWindowFlags_NoScrollbar	|	ImGuiWindowFlags_NoMove			| ImGuiWindowFlags_NoResize |
+			ImGuiWindowFlags_NoCollapse		|	ImGuiWindowFlags_NoNav			|	ImGuiWindowFlags_NoInputs		| ImGuiWindowFlags_AlwaysAutoResize;
+		ImGui::Begin("Loading", nullptr, flagsLoading);
+		ImGui::Text("%s", loadingText.Chr());
+		ImGui::End();
+	}
+
 	tVector2 prevNextArrowSize = Gutil::GetUIParamExtent(tVector2(18.0f, 72.0f), tVector2(32.0f, 128.0f));
 	float prevNextArrowMargin = 10.0f;
 
@@ -5111,6 +5381,7 @@ int main(int argc, char** argv)
 
 	// This is important. We need the destructors to run BEFORE we shutdown GLFW. Deconstructing the images may block for a bit while shutting
 	// down worker threads. We could show a 'shutting down' popup here if we wanted -- if Image::ThumbnailNumThreadsRunning is > 0.
+	Viewer::WaitForExtract();
 	Viewer::Images.Clear();
 	Viewer::UnloadAppImages();
 
@@ -39,6 +39,7 @@ namespace Viewer
 		ErrorCode_CLI_FailImageProcess		= 120,
 		ErrorCode_CLI_FailEarlyExit			= 130,
 		ErrorCode_CLI_FailImageSave			= 140,
+		ErrorCode_CLI_FailServe				= 150,
 	};
 
 	enum class Anchor
@@ -80,7 +81,6 @@ namespace Viewer
 	extern tString ImagesDir;
 	extern tList<tStringItem> ImagesSubDirs;
 	extern tList<Viewer::Image> Images;
-	extern tItList<Viewer::Image> ImagesLoadTimeSorted;
 	extern tColour4b PixelColour;
 	extern Viewer::Image Image_DefaultThumbnail;
 	extern Viewer::Image Image_File;
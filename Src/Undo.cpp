@@ -61,6 +61,33 @@ void Undo::Stack::Pop()
 }
 
 
+void Undo::Stack::Clear()
+{
+	while (!UndoSteps.IsEmpty())
+		delete UndoSteps.Remove();
+
+	while (!RedoSteps.IsEmpty())
+		delete RedoSteps.Remove();
+}
+
+
+int64 Undo::Stack::GetMemSizeBytes() const
+{
+	int64 numBytes = 0;
+	const tList<Step>* lists[2] = { &UndoSteps, &RedoSteps };
+	for (const tList<Step>* steps : lists)
+	{
+		for (Step* step = steps->First(); step; step = step->Next())
+		{
+			const tList<tPicture>& pics = ((Step_PictureList*)step)->Pictures;
+			for (tPicture* pic = pics.First(); pic; pic = pic->Next())
+				numBytes += int64(pic->GetNumPixels()) * sizeof(tPixel4b);
+		}
+	}
+	return numBytes;
+}
+
+
 void Undo::Stack::Undo(tList<tImage::tPicture>& currPics, bool& dirty)
 {
 	if (UndoSteps.IsEmpty())
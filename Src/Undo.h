@@ -57,6 +57,12 @@ public:
 	void Undo(tList<tImage::tPicture>& currPics, bool& dirty);
 	void Redo(tList<tImage::tPicture>& currPics, bool& dirty);
 
+	// Drops all undo and redo steps.
+	void Clear();
+
+	// Returns the approx main mem size of the pictures held by the undo and redo steps.
+	int64 GetMemSizeBytes() const;
+
 	bool UndoAvailable() const { return !UndoSteps.IsEmpty(); }
 	bool RedoAvailable() const { return !RedoSteps.IsEmpty(); }
 	tString GetUndoDesc() const;